@@ -558,6 +558,15 @@ void DestroyAssetTextures(struct AssetTexture **assetTextures, uint32_t count)
 	free(assetTextures);
 }
 
+static void PadToAlignment(FILE *assetFile, uint32_t alignment)
+{
+	static const unsigned char zeros[ASSET_PACK_PAYLOAD_ALIGNMENT] = { 0 };
+
+	long position = ftell(assetFile);
+	long padding = (alignment - position % alignment) % alignment;
+	fwrite(zeros, sizeof(unsigned char), padding, assetFile);
+}
+
 void WriteAssetFile(const struct Manifest *manifest, const char *fileName)
 {
 	assert(manifest != NULL);
@@ -576,6 +585,9 @@ void WriteAssetFile(const struct Manifest *manifest, const char *fileName)
 		abort();
 	}
 
+	const uint32_t packHeader[] = { ASSET_PACK_MAGIC, ASSET_PACK_VERSION, ASSET_PACK_PAYLOAD_ALIGNMENT };
+	fwrite(packHeader, sizeof(uint32_t), 3, assetFile);
+
 	fwrite(&manifest->textureCount, sizeof(uint32_t), 1, assetFile);
 	for (int i = 0; i < manifest->textureCount; ++i)
 	{
@@ -590,6 +602,10 @@ void WriteAssetFile(const struct Manifest *manifest, const char *fileName)
 		fwrite(&assetTexture->mipmap, sizeof(uint32_t), 1, assetFile);
 		fwrite(&assetTexture->mipmapCount, sizeof(uint32_t), 1, assetFile);
 		fwrite(&assetTexture->bufferSize, sizeof(uint64_t), 1, assetFile);
+		uint64_t hash = HashFnv1a64(assetTexture->buffer, assetTexture->bufferSize);
+		fwrite(&hash, sizeof(uint64_t), 1, assetFile);
+		// payloads start block aligned so the runtime can read them with O_DIRECT
+		PadToAlignment(assetFile, ASSET_PACK_PAYLOAD_ALIGNMENT);
 		fwrite(assetTexture->buffer, sizeof(unsigned char), assetTexture->bufferSize * sizeof(unsigned char), assetFile);
 	}
 
@@ -3,13 +3,39 @@
 //
 
 #include "AssetManager.h"
+#include "AsyncIO.h"
+#include "Vfs.h"
+#include "Profiler.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+// payloads are split into reads of this size so a deep queue keeps the device busy
+#define ASSET_READ_CHUNK_SIZE (1024 * 1024)
+
+#define ASSET_TEXTURE_HEADER_SIZE (5 * sizeof(uint32_t) + sizeof(uint64_t))
+
 static struct AssetTexture **s_AssetTextures = NULL;
 static uint32_t s_AssetTextureCount = 0;
 
+// kept open while textures are loaded, payloads are only read when they are uploaded
+static struct AsyncIOFile *s_AssetFile = NULL;
+
+static uint32_t s_QueueDepth = 32;
+static bool s_DirectIO = false;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void SetAssetLoadOptions(uint32_t queueDepth, bool directIO)
+{
+	s_QueueDepth = queueDepth > 0 ? queueDepth : 1;
+	s_DirectIO = directIO;
+}
+
 struct AssetTexture *GetTexture(const char* name)
 {
 	for (uint32_t i = 0; i < s_AssetTextureCount; ++i)
@@ -22,7 +48,276 @@ struct AssetTexture *GetTexture(const char* name)
 	return NULL;
 }
 
-void LoadTextures(FILE *assetFile)
+static void FreeTexture(struct AssetTexture *assetTexture)
+{
+	free(assetTexture->name);
+	AsyncIO_FreeAligned(assetTexture->buffer);
+	free(assetTexture);
+}
+
+static void FreeTextures(struct AssetTexture **assetTextures, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		FreeTexture(assetTextures[i]);
+	}
+	free(assetTextures);
+}
+
+/**
+ * @param end where the asset file ends, no length read from it may reach past that
+ */
+static struct AssetTexture *ReadTextureHeader(struct AsyncIOFile *file, uint64_t base, uint64_t end,
+					      uint64_t *cursor, uint32_t version, uint32_t alignment)
+{
+	uint64_t nameLen;
+	if (end - *cursor < sizeof(uint64_t) || !AsyncIO_Read(file, *cursor, &nameLen, sizeof(uint64_t)))
+	{
+		fprintf(stderr, "Could not read the texture name length\n");
+		return NULL;
+	}
+	*cursor += sizeof(uint64_t);
+
+	uint64_t headerSize = version >= 2 ? ASSET_TEXTURE_HEADER_SIZE + sizeof(uint64_t) : ASSET_TEXTURE_HEADER_SIZE;
+	if (end - *cursor < headerSize || nameLen > end - *cursor - headerSize)
+	{
+		fprintf(stderr, "Texture name length %llu runs past the end of the asset file\n",
+			(unsigned long long)nameLen);
+		return NULL;
+	}
+
+	struct AssetTexture *assetTexture = malloc(sizeof(struct AssetTexture));
+	if (assetTexture == NULL)
+	{
+		fprintf(stderr, "Could not allocate assetTexture\n");
+		return NULL;
+	}
+
+	assetTexture->name = malloc(nameLen * sizeof(char) + 1);
+	if (assetTexture->name == NULL)
+	{
+		fprintf(stderr, "Could not allocate assetTexture->name\n");
+		free(assetTexture);
+		return NULL;
+	}
+
+	unsigned char header[ASSET_TEXTURE_HEADER_SIZE + sizeof(uint64_t)];
+	if (!AsyncIO_Read(file, *cursor, assetTexture->name, nameLen) ||
+	    !AsyncIO_Read(file, *cursor + nameLen, header, headerSize))
+	{
+		fprintf(stderr, "Could not read the texture header\n");
+		free(assetTexture->name);
+		free(assetTexture);
+		return NULL;
+	}
+	assetTexture->name[nameLen] = '\0';
+	*cursor += nameLen + headerSize;
+
+	uint32_t mipmap;
+	memcpy(&assetTexture->width, &header[0], sizeof(uint32_t));
+	memcpy(&assetTexture->height, &header[4], sizeof(uint32_t));
+	memcpy(&assetTexture->channels, &header[8], sizeof(uint32_t));
+	memcpy(&mipmap, &header[12], sizeof(uint32_t));
+	memcpy(&assetTexture->mipmapCount, &header[16], sizeof(uint32_t));
+	memcpy(&assetTexture->bufferSize, &header[20], sizeof(uint64_t));
+	assetTexture->mipmap = (mipmap & 0xFF) != 0;
+
+	// packs without a stored hash report 0, which never compares as unchanged
+	assetTexture->hash = 0;
+	if (version >= 2)
+	{
+		memcpy(&assetTexture->hash, &header[28], sizeof(uint64_t));
+	}
+
+	assetTexture->fileOffset = base + AlignUp(*cursor - base, alignment);
+	assetTexture->buffer = NULL;
+	assetTexture->generation = 0;
+
+	if (assetTexture->fileOffset > end || assetTexture->bufferSize > end - assetTexture->fileOffset)
+	{
+		fprintf(stderr, "The payload of %s runs past the end of the asset file\n", assetTexture->name);
+		free(assetTexture->name);
+		free(assetTexture);
+		return NULL;
+	}
+
+	*cursor = assetTexture->fileOffset + assetTexture->bufferSize;
+
+	return assetTexture;
+}
+
+/*
+ * Walks the texture headers without touching the payloads.
+ * Payloads are read later by ReadTexturePayload, straight into the memory they are uploaded from.
+ */
+static struct AssetTexture **ReadTextureToc(struct AsyncIOFile *file, uint64_t base, uint64_t size, uint32_t *count)
+{
+	// a loose file may have shrunk since it was located
+	uint64_t end = base + size;
+	if (end > AsyncIO_GetSize(file))
+	{
+		end = AsyncIO_GetSize(file);
+	}
+	if (end < base || end - base < sizeof(uint32_t))
+	{
+		fprintf(stderr, "The asset file is too small to hold a header\n");
+		return NULL;
+	}
+
+	uint64_t cursor = base;
+	uint32_t version = 0;
+	uint32_t alignment = 1;
+
+	uint32_t first;
+	if (!AsyncIO_Read(file, cursor, &first, sizeof(uint32_t)))
+	{
+		fprintf(stderr, "Could not read the asset file header\n");
+		return NULL;
+	}
+	cursor += sizeof(uint32_t);
+
+	uint32_t textureCount = first;
+	if (first == ASSET_PACK_MAGIC)
+	{
+		uint32_t header[3];
+		if (end - cursor < sizeof header ||
+		    !AsyncIO_Read(file, cursor, header, sizeof header) || header[0] == 0 ||
+		    header[0] > ASSET_PACK_VERSION || header[1] == 0)
+		{
+			fprintf(stderr, "Unsupported or truncated asset pack header\n");
+			return NULL;
+		}
+		cursor += sizeof header;
+
+		version = header[0];
+		alignment = header[1];
+		textureCount = header[2];
+	}
+
+	// every texture takes at least a name length and a header, a count beyond that is garbage
+	if (textureCount > (end - cursor) / (sizeof(uint64_t) + ASSET_TEXTURE_HEADER_SIZE))
+	{
+		fprintf(stderr, "The asset file is too small for %u textures\n", textureCount);
+		return NULL;
+	}
+
+	struct AssetTexture **assetTextures = malloc(textureCount * sizeof(struct AssetTexture*));
+	if (assetTextures == NULL)
+	{
+		fprintf(stderr, "Could not allocate the texture table of contents\n");
+		return NULL;
+	}
+
+	*count = 0;
+	while (*count < textureCount)
+	{
+		struct AssetTexture *assetTexture = ReadTextureHeader(file, base, end, &cursor, version, alignment);
+		if (assetTexture == NULL)
+		{
+			// headers are chained, nothing after a broken one can be located
+			break;
+		}
+
+		assetTextures[(*count)++] = assetTexture;
+	}
+
+	return assetTextures;
+}
+
+bool ReadTexturePayload(const struct AssetTexture *texture, void *destination, uint64_t destinationSize)
+{
+	assert(destinationSize >= texture->bufferSize);
+
+	if (texture->buffer != NULL)
+	{
+		memcpy(destination, texture->buffer, texture->bufferSize);
+		return true;
+	}
+
+	if (s_AssetFile == NULL)
+	{
+		fprintf(stderr, "No asset file is open to read %s from\n", texture->name);
+		return false;
+	}
+
+	PROFILE_FUNCTION_BEGIN();
+
+	uint32_t requestCount = (uint32_t)(AlignUp(texture->bufferSize, ASSET_READ_CHUNK_SIZE) / ASSET_READ_CHUNK_SIZE);
+	struct AsyncIORequest *requests = malloc(requestCount * sizeof(struct AsyncIORequest));
+	if (requests == NULL && requestCount > 0)
+	{
+		fprintf(stderr, "Could not allocate the payload read requests\n");
+		abort();
+	}
+
+	unsigned char *bytes = destination;
+	uint32_t request = 0;
+	for (uint64_t offset = 0; offset < (uint64_t)texture->bufferSize; offset += ASSET_READ_CHUNK_SIZE)
+	{
+		uint64_t size = texture->bufferSize - offset;
+		if (size > ASSET_READ_CHUNK_SIZE)
+		{
+			size = ASSET_READ_CHUNK_SIZE;
+		}
+		else if (s_DirectIO && offset + AlignUp(size, ASYNC_IO_ALIGNMENT) <= destinationSize)
+		{
+			// round the final chunk up to whole blocks so it can still go through O_DIRECT
+			size = AlignUp(size, ASYNC_IO_ALIGNMENT);
+		}
+
+		requests[request++] = (struct AsyncIORequest){ .offset = texture->fileOffset + offset,
+							      .size = size,
+							      .buffer = bytes + offset };
+	}
+
+	AsyncIO_ReadBatch(s_AssetFile, requests, requestCount);
+
+	bool success = true;
+	for (uint32_t i = 0; i < requestCount; ++i)
+	{
+		uint64_t required = texture->bufferSize - (uint64_t)i * ASSET_READ_CHUNK_SIZE;
+		if (required > ASSET_READ_CHUNK_SIZE)
+		{
+			required = ASSET_READ_CHUNK_SIZE;
+		}
+
+		if (requests[i].result != 0 || requests[i].bytesRead < required)
+		{
+			fprintf(stderr, "Could not read the payload of %s\n", texture->name);
+			success = false;
+			break;
+		}
+	}
+
+	free(requests);
+
+	PROFILE_END();
+
+	return success;
+}
+
+static struct AssetTexture **ReadTextures(const char *assetFileName, uint32_t *count, struct AsyncIOFile **file)
+{
+	// the asset file may be a loose file or stored inside a mounted pack
+	struct VfsLocation location;
+	*file = Vfs_Locate(assetFileName, &location) ? AsyncIO_Open(location.hostPath, s_DirectIO, s_QueueDepth) : NULL;
+	if (*file == NULL)
+	{
+		fprintf(stderr, "Could not open asset file: %s\n", assetFileName);
+		return NULL;
+	}
+
+	struct AssetTexture **assetTextures = ReadTextureToc(*file, location.offset, location.size, count);
+	if (assetTextures == NULL)
+	{
+		AsyncIO_Close(*file);
+		*file = NULL;
+	}
+
+	return assetTextures;
+}
+
+void LoadTextures(const char *assetFileName)
 {
 	if (s_AssetTextureCount > 0 || s_AssetTextures != NULL)
 	{
@@ -30,71 +325,120 @@ void LoadTextures(FILE *assetFile)
 		return;
 	}
 
-	uint32_t textureCount;
-	fread(&textureCount, sizeof(uint32_t), 1, assetFile);
+	PROFILE_FUNCTION_BEGIN();
 
 	s_AssetTextureCount = 0;
-	s_AssetTextures = malloc(textureCount * sizeof(struct AssetTexture*));
+	s_AssetTextures = ReadTextures(assetFileName, &s_AssetTextureCount, &s_AssetFile);
+
+	PROFILE_END();
+}
+
+uint32_t ReloadTextures(const char *assetFileName)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	// a rebuilt pack is indexed again, the old table of contents would point into the wrong places of the new file
+	struct VfsLocation location;
+	if (Vfs_Locate(assetFileName, &location))
+	{
+		Vfs_RemountPack(location.hostPath);
+	}
 
-	while (s_AssetTextureCount < textureCount)
+	uint32_t textureCount = 0;
+	struct AsyncIOFile *file = NULL;
+	struct AssetTexture **reloadedTextures = ReadTextures(assetFileName, &textureCount, &file);
+	if (reloadedTextures == NULL)
 	{
-		struct AssetTexture *assetTexture = malloc(sizeof(struct AssetTexture));
+		PROFILE_END();
+		return 0;
+	}
+
+	struct AssetTexture **assetTextures =
+		realloc(s_AssetTextures, (s_AssetTextureCount + textureCount) * sizeof(struct AssetTexture*));
+	if (assetTextures == NULL)
+	{
+		fprintf(stderr, "Could not grow the loaded texture list\n");
+		FreeTextures(reloadedTextures, textureCount);
+		AsyncIO_Close(file);
+		PROFILE_END();
+		return 0;
+	}
+	s_AssetTextures = assetTextures;
 
-		uint64_t nameLen;
-		fread(&nameLen, sizeof(uint64_t), 1, assetFile);
-		assetTexture->name = malloc(nameLen * sizeof(char) + 1);
-		if (assetTexture->name == NULL)
+	// payloads are read lazily, so every texture from here on refers to the new pack
+	AsyncIO_Close(s_AssetFile);
+	s_AssetFile = file;
+
+	uint32_t changedCount = 0;
+	for (uint32_t i = 0; i < textureCount; ++i)
+	{
+		struct AssetTexture *reloaded = reloadedTextures[i];
+
+		struct AssetTexture *loaded = GetTexture(reloaded->name);
+		if (loaded == NULL)
 		{
-			fprintf(stderr, "Could not allocate assetTexture->name\n");
-			free(assetTexture);
+			fprintf(stdout, "Hot reload added texture %s\n", reloaded->name);
+			s_AssetTextures[s_AssetTextureCount++] = reloaded;
+			++changedCount;
 			continue;
 		}
 
-		fread(assetTexture->name, sizeof(char), nameLen, assetFile);
-		assetTexture->name[nameLen] = '\0';
-
-		fread(&assetTexture->width, sizeof(uint32_t), 1, assetFile);
-		fread(&assetTexture->height, sizeof(uint32_t), 1, assetFile);
-		fread(&assetTexture->channels, sizeof(uint32_t), 1, assetFile);
-		fread(&assetTexture->mipmap, sizeof(uint32_t), 1, assetFile);
-		fread(&assetTexture->mipmapCount, sizeof(uint32_t), 1, assetFile);
-		fread(&assetTexture->bufferSize, sizeof(uint64_t), 1, assetFile);
+		// the payload may have moved even when it did not change
+		loaded->fileOffset = reloaded->fileOffset;
 
-		assetTexture->buffer = malloc(assetTexture->bufferSize * sizeof(unsigned char));
-		if (assetTexture->buffer == NULL)
+		if (loaded->hash != 0 && loaded->hash == reloaded->hash && loaded->bufferSize == reloaded->bufferSize &&
+		    loaded->width == reloaded->width && loaded->height == reloaded->height &&
+		    loaded->mipmapCount == reloaded->mipmapCount)
 		{
-			fprintf(stderr, "Could not allocate assetTexture->buffer\n");
-			free(assetTexture->name);
-			free(assetTexture);
+			FreeTexture(reloaded);
 			continue;
 		}
 
-		fread(assetTexture->buffer, sizeof(unsigned char), assetTexture->bufferSize * sizeof(unsigned char), assetFile);
+		// swap the contents so pointers handed out by GetTexture stay valid
+		unsigned char *staleBuffer = loaded->buffer;
+		uint32_t generation = loaded->generation + 1;
+		char *name = loaded->name;
 
-		s_AssetTextures[s_AssetTextureCount++] = assetTexture;
+		*loaded = *reloaded;
+		loaded->name = name;
+		loaded->generation = generation;
+
+		AsyncIO_FreeAligned(staleBuffer);
+		free(reloaded->name);
+		free(reloaded);
+
+		fprintf(stdout, "Hot reload replaced texture %s (generation %u)\n", loaded->name, loaded->generation);
+		++changedCount;
 	}
+
+	free(reloadedTextures);
+
+	PROFILE_END();
+
+	return changedCount;
 }
 
 void DestroyTextures()
 {
-	if (s_AssetTextures != NULL)
+	if (s_AssetTextures == NULL)
 	{
 		return;
 	}
 
 	for (int i = 0; i < s_AssetTextureCount; ++i)
 	{
-		struct AssetTexture *assetTexture = s_AssetTextures[i];
-		free(assetTexture->name);
-		free(assetTexture->buffer);
-		free(assetTexture);
+		FreeTexture(s_AssetTextures[i]);
 	}
 	free(s_AssetTextures);
+	s_AssetTextures = NULL;
 
 	s_AssetTextureCount = 0;
+
+	AsyncIO_Close(s_AssetFile);
+	s_AssetFile = NULL;
 }
 
 void Destroy()
 {
 	DestroyTextures();
-}
\ No newline at end of file
+}
@@ -4,7 +4,33 @@
 
 #include "AssetStructures.h"
 
+/**
+ * @param queueDepth number of payload reads kept in flight while loading
+ * @param directIO read payloads with O_DIRECT, bypassing the page cache
+ */
+void SetAssetLoadOptions(uint32_t queueDepth, bool directIO);
+
 struct AssetTexture *GetTexture(const char* name);
-void LoadTextures(FILE *assetFile);
+
+/**
+ * Reads the texture headers of the asset file and keeps it open, payloads are read by ReadTexturePayload
+ */
+void LoadTextures(const char *assetFileName);
+
+/**
+ * Reads the pixel payload of a loaded texture into destination, e.g. mapped staging memory
+ * @param destinationSize may exceed bufferSize; up to ASYNC_IO_ALIGNMENT bytes of slack keeps the final read O_DIRECT eligible
+ * @return false if the payload could not be read
+ */
+bool ReadTexturePayload(const struct AssetTexture *texture, void *destination, uint64_t destinationSize);
+
+/**
+ * Re-reads the headers of the asset file and replaces the loaded textures whose payload hash changed.
+ * Changed textures keep their address and get their generation bumped. A pack holding the asset file is remounted
+ * first, see Vfs_RemountPack.
+ * @return number of textures that were added or replaced
+ */
+uint32_t ReloadTextures(const char *assetFileName);
+
 void DestroyTextures();
 void Destroy();
\ No newline at end of file
@@ -3,6 +3,16 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/*
+ * Asset pack layout: magic, version, payload alignment, texture count, then per texture its header
+ * followed by the pixel payload starting at the next multiple of the payload alignment.
+ * Version 2 headers end with a 64-bit FNV-1a hash of the payload.
+ * Packs without the magic are the original unaligned layout starting at the texture count.
+ */
+#define ASSET_PACK_MAGIC 0x504E484Fu // "OHNP"
+#define ASSET_PACK_VERSION 2
+#define ASSET_PACK_PAYLOAD_ALIGNMENT 4096
+
 struct AssetTexture {
 	int32_t width;
 	int32_t height;
@@ -12,6 +22,9 @@ struct AssetTexture {
 	uint32_t mipmapCount;
 	char *name;
 	unsigned char *buffer;
+	uint64_t fileOffset;
+	uint64_t hash;
+	uint32_t generation;
 };
 
 struct AssetModel
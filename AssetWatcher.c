@@ -0,0 +1,209 @@
+#include "AssetWatcher.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#define MAX_WATCHED_FILES 32
+#define MAX_WATCHED_PATH 256
+
+struct WatchedFile {
+	const char *path;
+	const char *fileName;
+	char directory[MAX_WATCHED_PATH];
+#ifdef _WIN32
+	HANDLE changeHandle;
+	time_t lastModified;
+#else
+	int watchDescriptor;
+#endif
+};
+
+static struct WatchedFile s_WatchedFiles[MAX_WATCHED_FILES];
+static uint32_t s_WatchedFileCount = 0;
+
+#ifndef _WIN32
+static int s_InotifyFd = -1;
+#endif
+
+static void SplitPath(struct WatchedFile *watchedFile)
+{
+	const char *slash = strrchr(watchedFile->path, '/');
+	const char *backslash = strrchr(watchedFile->path, '\\');
+	if (backslash != NULL && (slash == NULL || backslash > slash))
+	{
+		slash = backslash;
+	}
+
+	if (slash == NULL)
+	{
+		strcpy(watchedFile->directory, ".");
+		watchedFile->fileName = watchedFile->path;
+		return;
+	}
+
+	size_t directoryLength = slash - watchedFile->path;
+	if (directoryLength >= MAX_WATCHED_PATH)
+	{
+		fprintf(stderr, "Watched path is too long: %s\n", watchedFile->path);
+		abort();
+	}
+
+	memcpy(watchedFile->directory, watchedFile->path, directoryLength);
+	watchedFile->directory[directoryLength] = '\0';
+	watchedFile->fileName = slash + 1;
+}
+
+#ifdef _WIN32
+static time_t GetLastModified(const char *path)
+{
+	struct stat sb;
+	if (stat(path, &sb) != 0)
+	{
+		return 0;
+	}
+	return sb.st_mtime;
+}
+#endif
+
+void AssetWatcher_Start(const char **filePaths, uint32_t count)
+{
+	assert(filePaths != NULL);
+	assert(count <= MAX_WATCHED_FILES);
+
+#ifndef _WIN32
+	s_InotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (s_InotifyFd < 0)
+	{
+		fprintf(stderr, "inotify_init1 failed, hot reload is disabled\n");
+		return;
+	}
+#endif
+
+	s_WatchedFileCount = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		struct WatchedFile *watchedFile = &s_WatchedFiles[s_WatchedFileCount++];
+		watchedFile->path = filePaths[i];
+		SplitPath(watchedFile);
+
+#ifdef _WIN32
+		watchedFile->lastModified = GetLastModified(watchedFile->path);
+		watchedFile->changeHandle = FindFirstChangeNotificationA(
+			watchedFile->directory, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (watchedFile->changeHandle == INVALID_HANDLE_VALUE)
+		{
+			fprintf(stderr, "Could not watch %s\n", watchedFile->directory);
+		}
+#else
+		watchedFile->watchDescriptor =
+			inotify_add_watch(s_InotifyFd, watchedFile->directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (watchedFile->watchDescriptor < 0)
+		{
+			fprintf(stderr, "Could not watch %s\n", watchedFile->directory);
+		}
+#endif
+	}
+
+	printf("Watching %u asset files for changes\n", s_WatchedFileCount);
+}
+
+uint32_t AssetWatcher_Poll()
+{
+	uint32_t changed = 0;
+
+#ifdef _WIN32
+	for (uint32_t i = 0; i < s_WatchedFileCount; ++i)
+	{
+		struct WatchedFile *watchedFile = &s_WatchedFiles[i];
+		if (watchedFile->changeHandle == INVALID_HANDLE_VALUE ||
+		    WaitForSingleObject(watchedFile->changeHandle, 0) != WAIT_OBJECT_0)
+		{
+			continue;
+		}
+
+		FindNextChangeNotification(watchedFile->changeHandle);
+
+		// the notification is per directory, so confirm this file is the one that moved
+		time_t lastModified = GetLastModified(watchedFile->path);
+		if (lastModified != watchedFile->lastModified)
+		{
+			watchedFile->lastModified = lastModified;
+			changed |= 1u << i;
+		}
+	}
+#else
+	if (s_InotifyFd < 0)
+	{
+		return 0;
+	}
+
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;)
+	{
+		ssize_t bytesRead = read(s_InotifyFd, events, sizeof events);
+		if (bytesRead <= 0)
+		{
+			if (bytesRead < 0 && errno != EAGAIN)
+			{
+				fprintf(stderr, "Reading inotify events failed\n");
+			}
+			break;
+		}
+
+		for (char *cursor = events; cursor < events + bytesRead;)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)cursor;
+			cursor += sizeof(struct inotify_event) + event->len;
+
+			if (event->len == 0)
+			{
+				continue;
+			}
+
+			for (uint32_t i = 0; i < s_WatchedFileCount; ++i)
+			{
+				struct WatchedFile *watchedFile = &s_WatchedFiles[i];
+				if (watchedFile->watchDescriptor == event->wd &&
+				    strcmp(watchedFile->fileName, event->name) == 0)
+				{
+					changed |= 1u << i;
+				}
+			}
+		}
+	}
+#endif
+
+	return changed;
+}
+
+void AssetWatcher_Stop()
+{
+#ifdef _WIN32
+	for (uint32_t i = 0; i < s_WatchedFileCount; ++i)
+	{
+		if (s_WatchedFiles[i].changeHandle != INVALID_HANDLE_VALUE)
+		{
+			FindCloseChangeNotification(s_WatchedFiles[i].changeHandle);
+		}
+	}
+#else
+	if (s_InotifyFd >= 0)
+	{
+		close(s_InotifyFd);
+		s_InotifyFd = -1;
+	}
+#endif
+
+	s_WatchedFileCount = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Starts watching the given files for modifications.
+ * The containing directories are watched so files replaced by rename are picked up too.
+ * @param filePaths relative or absolute paths, must outlive the watcher
+ * @param count number of paths
+ */
+void AssetWatcher_Start(const char **filePaths, uint32_t count);
+
+/**
+ * Non-blocking check for modifications since the last poll
+ * @return bitmask of the indices passed to AssetWatcher_Start that changed
+ */
+uint32_t AssetWatcher_Poll();
+
+void AssetWatcher_Stop();
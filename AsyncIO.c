@@ -0,0 +1,395 @@
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "AsyncIO.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef OHNONO_HAS_IO_URING
+#include <liburing.h>
+#endif
+
+struct AsyncIOFile {
+#ifdef _WIN32
+	HANDLE handle;
+	HANDLE directHandle;
+#else
+	int fd;
+	int directFd;
+#endif
+	uint64_t size;
+	uint32_t queueDepth;
+#ifdef OHNONO_HAS_IO_URING
+	struct io_uring ring;
+	bool hasRing;
+#endif
+};
+
+static bool IsAligned(uint64_t offset, uint64_t size, const void *buffer)
+{
+	return offset % ASYNC_IO_ALIGNMENT == 0 && size % ASYNC_IO_ALIGNMENT == 0 &&
+	       (uintptr_t)buffer % ASYNC_IO_ALIGNMENT == 0;
+}
+
+struct AsyncIOFile *AsyncIO_Open(const char *fileName, bool direct, uint32_t queueDepth)
+{
+	assert(fileName != NULL);
+	assert(queueDepth > 0);
+
+	struct AsyncIOFile *file = malloc(sizeof(struct AsyncIOFile));
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not allocate struct AsyncIOFile\n");
+		abort();
+	}
+
+	file->queueDepth = queueDepth;
+
+#ifdef _WIN32
+	file->handle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				   FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file->handle == INVALID_HANDLE_VALUE)
+	{
+		free(file);
+		return NULL;
+	}
+
+	file->directHandle = INVALID_HANDLE_VALUE;
+	if (direct)
+	{
+		file->directHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						 FILE_FLAG_NO_BUFFERING, NULL);
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file->handle, &fileSize);
+	file->size = fileSize.QuadPart;
+#else
+	file->fd = open(fileName, O_RDONLY | O_CLOEXEC);
+	if (file->fd < 0)
+	{
+		free(file);
+		return NULL;
+	}
+
+	file->directFd = -1;
+#ifdef O_DIRECT
+	if (direct)
+	{
+		// not every filesystem supports O_DIRECT, those reads simply stay buffered
+		file->directFd = open(fileName, O_RDONLY | O_CLOEXEC | O_DIRECT);
+	}
+#endif
+
+	struct stat sb;
+	fstat(file->fd, &sb);
+	file->size = sb.st_size;
+
+	posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#ifdef OHNONO_HAS_IO_URING
+	file->hasRing = io_uring_queue_init(queueDepth, &file->ring, 0) == 0;
+	if (!file->hasRing)
+	{
+		fprintf(stderr, "io_uring is not available, falling back to pread for %s\n", fileName);
+	}
+#endif
+
+	return file;
+}
+
+void AsyncIO_Close(struct AsyncIOFile *file)
+{
+	if (file == NULL)
+	{
+		return;
+	}
+
+#ifdef OHNONO_HAS_IO_URING
+	if (file->hasRing)
+	{
+		io_uring_queue_exit(&file->ring);
+	}
+#endif
+
+#ifdef _WIN32
+	if (file->directHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file->directHandle);
+	}
+	CloseHandle(file->handle);
+#else
+	if (file->directFd >= 0)
+	{
+		close(file->directFd);
+	}
+	close(file->fd);
+#endif
+
+	free(file);
+}
+
+uint64_t AsyncIO_GetSize(const struct AsyncIOFile *file)
+{
+	return file->size;
+}
+
+// some filesystems accept O_DIRECT at open and only turn it down with EINVAL on the first read
+static void CloseDirect(struct AsyncIOFile *file)
+{
+#ifdef _WIN32
+	if (file->directHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file->directHandle);
+		file->directHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (file->directFd >= 0)
+	{
+		close(file->directFd);
+		file->directFd = -1;
+	}
+#endif
+}
+
+static int32_t ReadBlocking(struct AsyncIOFile *file, struct AsyncIORequest *request)
+{
+	char *buffer = request->buffer;
+	bool aligned = IsAligned(request->offset, request->size, request->buffer);
+
+	request->bytesRead = 0;
+	while (request->bytesRead < request->size)
+	{
+		uint64_t remaining = request->size - request->bytesRead;
+		uint64_t offset = request->offset + request->bytesRead;
+
+#ifdef _WIN32
+		HANDLE handle = aligned && file->directHandle != INVALID_HANDLE_VALUE ? file->directHandle : file->handle;
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD bytesRead = 0;
+		DWORD chunk = remaining > (1u << 30) ? (1u << 30) : (DWORD)remaining;
+		if (!ReadFile(handle, buffer + request->bytesRead, chunk, &bytesRead, &overlapped))
+		{
+			DWORD error = GetLastError();
+			if (error == ERROR_HANDLE_EOF)
+			{
+				break;
+			}
+			if (error == ERROR_INVALID_PARAMETER && handle == file->directHandle)
+			{
+				CloseDirect(file);
+				continue;
+			}
+			return -EIO;
+		}
+#else
+		int fd = aligned && file->directFd >= 0 ? file->directFd : file->fd;
+		ssize_t bytesRead = pread(fd, buffer + request->bytesRead, remaining, (off_t)offset);
+		if (bytesRead < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EINVAL && fd == file->directFd)
+			{
+				CloseDirect(file);
+				continue;
+			}
+			return -errno;
+		}
+#endif
+
+		if (bytesRead == 0)
+		{
+			break;
+		}
+
+		request->bytesRead += bytesRead;
+		// a short direct read leaves an unaligned remainder, finish it through the page cache
+		aligned = false;
+	}
+
+	return 0;
+}
+
+#ifdef OHNONO_HAS_IO_URING
+static void PrepareRead(struct AsyncIOFile *file, struct AsyncIORequest *request)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&file->ring);
+	assert(sqe != NULL);
+
+	char *buffer = (char *)request->buffer + request->bytesRead;
+	uint64_t offset = request->offset + request->bytesRead;
+	uint64_t remaining = request->size - request->bytesRead;
+	assert(remaining <= UINT32_MAX);
+
+	bool direct = file->directFd >= 0 && IsAligned(offset, remaining, buffer);
+
+	io_uring_prep_read(sqe, direct ? file->directFd : file->fd, buffer, (unsigned)remaining, offset);
+	// the low bit marks direct reads, requests are at least 4 byte aligned
+	io_uring_sqe_set_data(sqe, (void *)((uintptr_t)request | (direct ? 1 : 0)));
+}
+
+static bool ReadBatchUring(struct AsyncIOFile *file, struct AsyncIORequest *requests, uint32_t count)
+{
+	uint32_t submitted = 0;
+	uint32_t completed = 0;
+	uint32_t inFlight = 0;
+	bool success = true;
+
+	while (completed < count)
+	{
+		while (submitted < count && inFlight < file->queueDepth)
+		{
+			PrepareRead(file, &requests[submitted++]);
+			++inFlight;
+		}
+
+		int submitResult = io_uring_submit_and_wait(&file->ring, 1);
+		if (submitResult < 0 && submitResult != -EINTR)
+		{
+			fprintf(stderr, "io_uring_submit_and_wait failed: %d\n", submitResult);
+			abort();
+		}
+
+		struct io_uring_cqe *cqe;
+		unsigned head;
+		unsigned seen = 0;
+		io_uring_for_each_cqe(&file->ring, head, cqe)
+		{
+			uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+			struct AsyncIORequest *request = (struct AsyncIORequest *)(data & ~(uintptr_t)1);
+			++seen;
+
+			if (cqe->res == -EINVAL && (data & 1) != 0)
+			{
+				// resubmitted buffered, the other direct reads in flight fail the same way and follow
+				CloseDirect(file);
+				PrepareRead(file, request);
+				continue;
+			}
+
+			if (cqe->res < 0)
+			{
+				request->result = cqe->res;
+				success = false;
+			}
+			else
+			{
+				request->bytesRead += cqe->res;
+				if (cqe->res > 0 && request->bytesRead < request->size)
+				{
+					// short read, queue the remainder in the slot this one just freed
+					PrepareRead(file, request);
+					continue;
+				}
+
+				// nothing more to read, the end of the file came first
+				success = success && request->bytesRead == request->size;
+			}
+
+			--inFlight;
+			++completed;
+		}
+
+		io_uring_cq_advance(&file->ring, seen);
+	}
+
+	return success;
+}
+#endif
+
+bool AsyncIO_ReadBatch(struct AsyncIOFile *file, struct AsyncIORequest *requests, uint32_t count)
+{
+	assert(file != NULL);
+	assert(requests != NULL || count == 0);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		requests[i].bytesRead = 0;
+		requests[i].result = 0;
+	}
+
+#ifdef OHNONO_HAS_IO_URING
+	if (file->hasRing)
+	{
+		return ReadBatchUring(file, requests, count);
+	}
+#endif
+
+	bool success = true;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		requests[i].result = ReadBlocking(file, &requests[i]);
+		success = success && requests[i].result == 0 && requests[i].bytesRead == requests[i].size;
+	}
+
+	return success;
+}
+
+bool AsyncIO_Read(struct AsyncIOFile *file, uint64_t offset, void *buffer, uint64_t size)
+{
+	struct AsyncIORequest request = { .offset = offset, .size = size, .buffer = buffer };
+	request.result = ReadBlocking(file, &request);
+
+	return request.result == 0 && request.bytesRead == size;
+}
+
+void *AsyncIO_AllocAligned(uint64_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, ASYNC_IO_ALIGNMENT);
+#else
+	void *buffer = NULL;
+	if (posix_memalign(&buffer, ASYNC_IO_ALIGNMENT, size) != 0)
+	{
+		return NULL;
+	}
+	return buffer;
+#endif
+}
+
+void AsyncIO_FreeAligned(void *buffer)
+{
+#ifdef _WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+const char *AsyncIO_BackendName(const struct AsyncIOFile *file)
+{
+#ifdef OHNONO_HAS_IO_URING
+	if (file->hasRing)
+	{
+		return "io_uring";
+	}
+#else
+	(void)file;
+#endif
+
+#ifdef _WIN32
+	return "ReadFile";
+#else
+	return "pread";
+#endif
+}
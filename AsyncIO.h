@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Offsets, sizes and buffers of O_DIRECT reads have to be a multiple of this
+#define ASYNC_IO_ALIGNMENT 4096
+
+struct AsyncIOFile;
+
+struct AsyncIORequest {
+	uint64_t offset;
+	uint64_t size;
+	void *buffer;
+	uint64_t bytesRead; // filled in on completion, short only at end of file
+	int32_t result; // 0 or a negative errno
+};
+
+/**
+ * Opens a file for positioned reads. Uses io_uring when built with OHNONO_HAS_IO_URING,
+ * otherwise every read is a blocking pread (ReadFile on Windows).
+ * @param fileName path of the file
+ * @param direct bypass the page cache for requests that are ASYNC_IO_ALIGNMENT aligned
+ * @param queueDepth maximum number of reads in flight
+ * @return NULL if the file could not be opened
+ */
+struct AsyncIOFile *AsyncIO_Open(const char *fileName, bool direct, uint32_t queueDepth);
+
+void AsyncIO_Close(struct AsyncIOFile *file);
+
+uint64_t AsyncIO_GetSize(const struct AsyncIOFile *file);
+
+/**
+ * Submits all requests, keeping up to the queue depth in flight, and waits for them to finish
+ * @return true if every request completed without an error and read all of its size, a request reaching past the
+ * end of the file stops short with bytesRead < size
+ */
+bool AsyncIO_ReadBatch(struct AsyncIOFile *file, struct AsyncIORequest *requests, uint32_t count);
+
+/**
+ * Blocking read of size bytes at offset
+ * @return true if all bytes were read
+ */
+bool AsyncIO_Read(struct AsyncIOFile *file, uint64_t offset, void *buffer, uint64_t size);
+
+void *AsyncIO_AllocAligned(uint64_t size);
+void AsyncIO_FreeAligned(void *buffer);
+
+const char *AsyncIO_BackendName(const struct AsyncIOFile *file);
@@ -0,0 +1,178 @@
+#include "CommandRecorder.h"
+#include "Profiler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct CommandRecorderFrame {
+	VkCommandPool primaryPool;
+	VkCommandBuffer primary;
+	// one pool per thread, pools must only be used by one thread at a time
+	VkCommandPool pools[COMMAND_RECORDER_MAX_THREADS];
+	VkCommandBuffer secondaries[COMMAND_RECORDER_MAX_THREADS];
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static struct CommandRecorderFrame *s_Frames = NULL;
+static uint32_t s_FrameCount = 0;
+static uint32_t s_CurrentFrame = 0;
+static uint32_t s_ThreadCount = 0;
+static struct WorkerPool *s_Pool = NULL;
+
+// the recording, read by the pool's threads while CommandRecorder_RecordParallel waits for them
+static const VkCommandBufferInheritanceInfo *s_Inheritance = NULL;
+static CommandRecorderSliceFunction s_Record = NULL;
+static void *s_UserData = NULL;
+
+static VkCommandPool CreatePool(uint32_t queueFamily)
+{
+	VkCommandPoolCreateInfo poolCreateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+						   .pNext = NULL,
+						   .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+						   .queueFamilyIndex = queueFamily };
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(s_Device, &poolCreateInfo, NULL, &pool) != VK_SUCCESS)
+	{
+		printf("Could not create command pool\n");
+		abort();
+	}
+
+	return pool;
+}
+
+static VkCommandBuffer AllocateCommandBuffer(VkCommandPool pool, VkCommandBufferLevel level)
+{
+	VkCommandBufferAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+						     .pNext = NULL,
+						     .commandPool = pool,
+						     .level = level,
+						     .commandBufferCount = 1 };
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(s_Device, &allocateInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		printf("Could not allocate command buffer\n");
+		abort();
+	}
+
+	return commandBuffer;
+}
+
+static void RecordSlice(uint32_t slice, uint32_t first, uint32_t count, void *userData)
+{
+	PROFILE_BEGIN("RecordSlice");
+
+	VkCommandBuffer commandBuffer = ((struct CommandRecorderFrame *)userData)->secondaries[slice];
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					       .pNext = NULL,
+					       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+							VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+					       .pInheritanceInfo = s_Inheritance };
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		printf("Could not begin secondary command buffer\n");
+		abort();
+	}
+
+	s_Record(commandBuffer, first, count, s_UserData);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		printf("Could not end secondary command buffer\n");
+		abort();
+	}
+
+	PROFILE_END();
+}
+
+void CommandRecorder_Init(VkDevice device, uint32_t queueFamily, uint32_t frameCount)
+{
+	assert(s_Device == VK_NULL_HANDLE);
+
+	s_Device = device;
+	s_FrameCount = frameCount;
+	s_CurrentFrame = 0;
+
+	s_Pool = WorkerPool_Create("CommandRecorder", 0);
+	s_ThreadCount = WorkerPool_ThreadCount(s_Pool);
+
+	s_Frames = malloc(frameCount * sizeof(struct CommandRecorderFrame));
+	if (s_Frames == NULL)
+	{
+		abort();
+	}
+
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		struct CommandRecorderFrame *frame = &s_Frames[i];
+		frame->primaryPool = CreatePool(queueFamily);
+		frame->primary = AllocateCommandBuffer(frame->primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+		for (uint32_t thread = 0; thread < s_ThreadCount; ++thread)
+		{
+			frame->pools[thread] = CreatePool(queueFamily);
+			frame->secondaries[thread] =
+				AllocateCommandBuffer(frame->pools[thread], VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		}
+	}
+
+	printf("Created command recorder with %u threads\n", s_ThreadCount);
+}
+
+void CommandRecorder_Destroy()
+{
+	WorkerPool_Destroy(s_Pool);
+	s_Pool = NULL;
+
+	// destroying a pool frees its command buffers
+	for (uint32_t i = 0; i < s_FrameCount; ++i)
+	{
+		vkDestroyCommandPool(s_Device, s_Frames[i].primaryPool, NULL);
+		for (uint32_t thread = 0; thread < s_ThreadCount; ++thread)
+		{
+			vkDestroyCommandPool(s_Device, s_Frames[i].pools[thread], NULL);
+		}
+	}
+
+	free(s_Frames);
+	s_Frames = NULL;
+	s_Device = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer CommandRecorder_BeginFrame(uint32_t frame)
+{
+	assert(frame < s_FrameCount);
+
+	s_CurrentFrame = frame;
+
+	struct CommandRecorderFrame *recorderFrame = &s_Frames[frame];
+	vkResetCommandPool(s_Device, recorderFrame->primaryPool, 0);
+	for (uint32_t thread = 0; thread < s_ThreadCount; ++thread)
+	{
+		vkResetCommandPool(s_Device, recorderFrame->pools[thread], 0);
+	}
+
+	return recorderFrame->primary;
+}
+
+void CommandRecorder_RecordParallel(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo *inheritance,
+				    uint32_t itemCount, CommandRecorderSliceFunction record, void *userData)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	struct CommandRecorderFrame *frame = &s_Frames[s_CurrentFrame];
+
+	s_Inheritance = inheritance;
+	s_Record = record;
+	s_UserData = userData;
+
+	// slices are contiguous, executing them in slice order keeps the item order
+	uint32_t sliceCount = WorkerPool_Run(s_Pool, itemCount, COMMAND_RECORDER_MIN_SLICE, 1, RecordSlice, frame);
+	vkCmdExecuteCommands(primary, sliceCount, frame->secondaries);
+
+	PROFILE_END();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#include "WorkerPool.h"
+
+// threads recording secondaries, the calling thread included
+#define COMMAND_RECORDER_MAX_THREADS WORKER_POOL_MAX_THREADS
+// fewest items recorded into a secondary of their own. The renderer's items are draw batches, each an indirect
+// draw of any number of instances, so every batch is worth a thread.
+#define COMMAND_RECORDER_MIN_SLICE 1
+
+/**
+ * Records items [first, first + count) into a secondary command buffer that has been begun inside the render pass.
+ * Nothing is inherited, bind everything the slice draws with.
+ */
+typedef void (*CommandRecorderSliceFunction)(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count,
+					     void *userData);
+
+/**
+ * Creates a primary and a pool per thread for every frame in flight and starts the recording threads
+ * @param queueFamily family the command buffers are submitted to
+ */
+void CommandRecorder_Init(VkDevice device, uint32_t queueFamily, uint32_t frameCount);
+void CommandRecorder_Destroy();
+
+/**
+ * Resets every pool of the frame in one call each, instead of resetting command buffers one by one.
+ * Call once the frame's fence has signalled.
+ * @return primary command buffer of the frame, ready to begin
+ */
+VkCommandBuffer CommandRecorder_BeginFrame(uint32_t frame);
+
+/**
+ * Splits itemCount items into slices recorded in parallel, the calling thread records the first one.
+ * Returns once every slice is recorded and executed from the primary in item order.
+ * @param primary primary of the current frame, inside a render pass begun with secondary command buffer contents
+ * @param inheritance render pass, subpass and framebuffer the secondaries continue
+ */
+void CommandRecorder_RecordParallel(VkCommandBuffer primary, const VkCommandBufferInheritanceInfo *inheritance,
+				    uint32_t itemCount, CommandRecorderSliceFunction record, void *userData);
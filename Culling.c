@@ -0,0 +1,346 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "Culling.h"
+#include "Profiler.h"
+#include "external/cglm/frustum.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CULLING_HAS_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without flags
+#define CULLING_TARGET_AVX
+#else
+#define CULLING_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+#define CULLING_ALIGNMENT (CULLING_LANES * sizeof(float))
+
+typedef uint32_t (*CullingRangeFunction)(const struct CullingBounds *bounds, const struct CullingFrustum *frustum,
+					 uint32_t first, uint32_t count, uint32_t *visible);
+
+struct CullingSlice {
+	uint32_t first;
+	uint32_t count;
+	uint32_t visibleCount;
+};
+
+static bool s_Initialized = false;
+static enum CullingPath s_Path = CULLING_PATH_SCALAR;
+static bool s_Supported[CULLING_PATH_COUNT];
+static struct WorkerPool *s_Pool = NULL;
+
+// the list being culled, read by the pool's threads while Culling_Cull waits for them
+static const struct CullingBounds *s_Bounds = NULL;
+static const struct CullingFrustum *s_Frustum = NULL;
+static uint32_t *s_Visible = NULL;
+static struct CullingSlice s_Slices[CULLING_MAX_THREADS];
+
+static uint32_t CullScalar(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t first,
+			   uint32_t count, uint32_t *visible)
+{
+	uint32_t visibleCount = 0;
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		float x = bounds->centerX[i];
+		float y = bounds->centerY[i];
+		float z = bounds->centerZ[i];
+		float negativeRadius = -bounds->radius[i];
+
+		bool inside = true;
+		for (uint32_t plane = 0; plane < 6; ++plane)
+		{
+			float distance = x * frustum->planeX[plane] + y * frustum->planeY[plane] +
+					 z * frustum->planeZ[plane] + frustum->planeW[plane];
+			// every plane is tested, an early out mispredicts on most objects near the frustum edges
+			inside &= distance >= negativeRadius;
+		}
+
+		// always written, only kept when visible, so the loop has no unpredictable branch
+		visible[visibleCount] = i;
+		visibleCount += inside ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+#ifdef CULLING_HAS_X86_SIMD
+// SSE2 is part of x86-64, so this path needs no check
+static uint32_t CullSse(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t first,
+			uint32_t count, uint32_t *visible)
+{
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t plane = 0; plane < 6; ++plane)
+	{
+		planeX[plane] = _mm_set1_ps(frustum->planeX[plane]);
+		planeY[plane] = _mm_set1_ps(frustum->planeY[plane]);
+		planeZ[plane] = _mm_set1_ps(frustum->planeZ[plane]);
+		planeW[plane] = _mm_set1_ps(frustum->planeW[plane]);
+	}
+
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	uint32_t end = first + count;
+	uint32_t visibleCount = 0;
+	uint32_t i = first;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(bounds->centerX + i);
+		__m128 y = _mm_loadu_ps(bounds->centerY + i);
+		__m128 z = _mm_loadu_ps(bounds->centerZ + i);
+		__m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(bounds->radius + i), signMask);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t plane = 0; plane < 6; ++plane)
+		{
+			__m128 xy = _mm_add_ps(_mm_mul_ps(x, planeX[plane]), _mm_mul_ps(y, planeY[plane]));
+			__m128 distance = _mm_add_ps(xy, _mm_add_ps(_mm_mul_ps(z, planeZ[plane]), planeW[plane]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; ++lane)
+		{
+			visible[visibleCount] = i + lane;
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount + CullScalar(bounds, frustum, i, end - i, visible + visibleCount);
+}
+
+static CULLING_TARGET_AVX uint32_t CullAvx(const struct CullingBounds *bounds, const struct CullingFrustum *frustum,
+					   uint32_t first, uint32_t count, uint32_t *visible)
+{
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (uint32_t plane = 0; plane < 6; ++plane)
+	{
+		planeX[plane] = _mm256_set1_ps(frustum->planeX[plane]);
+		planeY[plane] = _mm256_set1_ps(frustum->planeY[plane]);
+		planeZ[plane] = _mm256_set1_ps(frustum->planeZ[plane]);
+		planeW[plane] = _mm256_set1_ps(frustum->planeW[plane]);
+	}
+
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	uint32_t end = first + count;
+	uint32_t visibleCount = 0;
+	uint32_t i = first;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(bounds->centerX + i);
+		__m256 y = _mm256_loadu_ps(bounds->centerY + i);
+		__m256 z = _mm256_loadu_ps(bounds->centerZ + i);
+		__m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(bounds->radius + i), signMask);
+
+		// AVX without FMA, which arrived later
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t plane = 0; plane < 6; ++plane)
+		{
+			__m256 xy = _mm256_add_ps(_mm256_mul_ps(x, planeX[plane]), _mm256_mul_ps(y, planeY[plane]));
+			__m256 zw = _mm256_add_ps(_mm256_mul_ps(z, planeZ[plane]), planeW[plane]);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(xy, zw), negativeRadius, _CMP_GE_OQ));
+		}
+
+		uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 8; ++lane)
+		{
+			visible[visibleCount] = i + lane;
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+
+	return visibleCount + CullSse(bounds, frustum, i, end - i, visible + visibleCount);
+}
+
+// the CPU must support AVX and the OS must save the YMM registers on context switches
+static bool HasAvx()
+{
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 1);
+	bool osxsave = (registers[2] & (1 << 27)) != 0;
+	bool avx = (registers[2] & (1 << 28)) != 0;
+	return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
+
+static const CullingRangeFunction s_RangeFunctions[CULLING_PATH_COUNT] = {
+	[CULLING_PATH_SCALAR] = CullScalar,
+#ifdef CULLING_HAS_X86_SIMD
+	[CULLING_PATH_SSE] = CullSse,
+	[CULLING_PATH_AVX] = CullAvx,
+#endif
+};
+
+static void CullSlice(uint32_t slice, uint32_t first, uint32_t count, void *userData)
+{
+	(void)userData;
+	PROFILE_BEGIN("CullSlice");
+
+	// each slice writes its indices where its range starts, Culling_Cull closes the gaps
+	uint32_t visibleCount = s_RangeFunctions[s_Path](s_Bounds, s_Frustum, first, count, s_Visible + first);
+	s_Slices[slice] = (struct CullingSlice){ .first = first, .count = count, .visibleCount = visibleCount };
+
+	PROFILE_END();
+}
+
+void Culling_Init(uint32_t threadCount)
+{
+	assert(!s_Initialized);
+
+	s_Supported[CULLING_PATH_SCALAR] = true;
+#ifdef CULLING_HAS_X86_SIMD
+	s_Supported[CULLING_PATH_SSE] = true;
+	s_Supported[CULLING_PATH_AVX] = HasAvx();
+#endif
+
+	s_Path = CULLING_PATH_SCALAR;
+	for (uint32_t path = 0; path < CULLING_PATH_COUNT; ++path)
+	{
+		s_Path = s_Supported[path] ? (enum CullingPath)path : s_Path;
+	}
+
+	s_Pool = WorkerPool_Create("Culling", threadCount);
+	s_Initialized = true;
+
+	printf("Culling with %s on %u threads\n", Culling_PathName(s_Path), WorkerPool_ThreadCount(s_Pool));
+}
+
+void Culling_Destroy()
+{
+	WorkerPool_Destroy(s_Pool);
+	s_Pool = NULL;
+	s_Initialized = false;
+}
+
+bool Culling_SetPath(enum CullingPath path)
+{
+	if (path >= CULLING_PATH_COUNT || !s_Supported[path])
+	{
+		return false;
+	}
+
+	s_Path = path;
+	return true;
+}
+
+enum CullingPath Culling_GetPath()
+{
+	return s_Path;
+}
+
+const char *Culling_PathName(enum CullingPath path)
+{
+	switch (path)
+	{
+	case CULLING_PATH_SCALAR:
+		return "scalar";
+	case CULLING_PATH_SSE:
+		return "SSE";
+	case CULLING_PATH_AVX:
+		return "AVX";
+	default:
+		return "unknown";
+	}
+}
+
+void Culling_CreateBounds(struct CullingBounds *bounds, uint32_t capacity)
+{
+	uint32_t padded = (capacity + CULLING_LANES - 1) / CULLING_LANES * CULLING_LANES;
+	size_t size = 4 * (size_t)padded * sizeof(float);
+
+	// one block, each array starts on a lane boundary
+	float *block = NULL;
+#ifdef _WIN32
+	block = _aligned_malloc(size, CULLING_ALIGNMENT);
+#else
+	if (posix_memalign((void **)&block, CULLING_ALIGNMENT, size) != 0)
+	{
+		block = NULL;
+	}
+#endif
+	if (block == NULL)
+	{
+		printf("Could not allocate bounds for %u objects\n", capacity);
+		abort();
+	}
+
+	memset(block, 0, size);
+
+	bounds->centerX = block;
+	bounds->centerY = block + padded;
+	bounds->centerZ = block + 2 * padded;
+	bounds->radius = block + 3 * padded;
+	bounds->count = 0;
+	bounds->capacity = capacity;
+}
+
+void Culling_DestroyBounds(struct CullingBounds *bounds)
+{
+#ifdef _WIN32
+	_aligned_free(bounds->centerX);
+#else
+	free(bounds->centerX);
+#endif
+	memset(bounds, 0, sizeof(struct CullingBounds));
+}
+
+void Culling_ExtractFrustum(mat4 viewProj, struct CullingFrustum *frustum)
+{
+	vec4 planes[6];
+	glm_frustum_planes(viewProj, planes);
+
+	for (uint32_t plane = 0; plane < 6; ++plane)
+	{
+		frustum->planeX[plane] = planes[plane][0];
+		frustum->planeY[plane] = planes[plane][1];
+		frustum->planeZ[plane] = planes[plane][2];
+		frustum->planeW[plane] = planes[plane][3];
+	}
+}
+
+uint32_t Culling_CullRange(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t first,
+			   uint32_t count, uint32_t *visible)
+{
+	assert(first + count <= bounds->count);
+
+	return s_RangeFunctions[s_Path](bounds, frustum, first, count, visible);
+}
+
+uint32_t Culling_Cull(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t *visible)
+{
+	assert(s_Initialized);
+
+	PROFILE_FUNCTION_BEGIN();
+
+	s_Bounds = bounds;
+	s_Frustum = frustum;
+	s_Visible = visible;
+
+	// slices of whole lanes, so only the last one has a scalar tail
+	uint32_t sliceCount = WorkerPool_Run(s_Pool, bounds->count, CULLING_MIN_SLICE, CULLING_LANES, CullSlice, NULL);
+
+	// every slice starts at or after the end of the compacted ones before it, so moving them down is safe
+	uint32_t visibleCount = s_Slices[0].visibleCount;
+	for (uint32_t slice = 1; slice < sliceCount; ++slice)
+	{
+		memmove(visible + visibleCount, visible + s_Slices[slice].first,
+			s_Slices[slice].visibleCount * sizeof(uint32_t));
+		visibleCount += s_Slices[slice].visibleCount;
+	}
+
+	PROFILE_END();
+	return visibleCount;
+}
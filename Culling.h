@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "WorkerPool.h"
+#include "external/cglm/types.h"
+
+// the widest path tests this many objects at once, bounds arrays are padded and aligned to it
+#define CULLING_LANES 8
+// threads culling a list, the calling thread included
+#define CULLING_MAX_THREADS WORKER_POOL_MAX_THREADS
+// fewest spheres culled on a thread of their own, a multiple of CULLING_LANES
+#define CULLING_MIN_SLICE 16384
+
+enum CullingPath {
+	CULLING_PATH_SCALAR,
+	CULLING_PATH_SSE, // 4 objects per iteration
+	CULLING_PATH_AVX, // 8 objects per iteration
+	CULLING_PATH_COUNT
+};
+
+/**
+ * World space bounding spheres in structure of arrays form, so each plane test loads whole vectors of one component.
+ * Write the first count entries of the arrays directly.
+ */
+struct CullingBounds {
+	float *centerX;
+	float *centerY;
+	float *centerZ;
+	float *radius;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+/**
+ * Left, right, bottom, top, near and far planes, split by component so the SIMD paths broadcast them.
+ * A point is inside a plane when x * planeX + y * planeY + z * planeZ + planeW >= 0.
+ */
+struct CullingFrustum {
+	float planeX[6];
+	float planeY[6];
+	float planeZ[6];
+	float planeW[6];
+};
+
+/**
+ * Picks the widest path the CPU supports and starts the culling threads
+ * @param threadCount threads including the calling one, 0 for one per core but one, at most CULLING_MAX_THREADS
+ */
+void Culling_Init(uint32_t threadCount);
+void Culling_Destroy();
+
+/**
+ * @return false if the CPU or build does not support the path, which then stays unchanged
+ */
+bool Culling_SetPath(enum CullingPath path);
+enum CullingPath Culling_GetPath();
+const char *Culling_PathName(enum CullingPath path);
+
+/**
+ * Allocates the arrays padded to CULLING_LANES, the padding is zeroed. count starts at 0.
+ */
+void Culling_CreateBounds(struct CullingBounds *bounds, uint32_t capacity);
+void Culling_DestroyBounds(struct CullingBounds *bounds);
+
+/**
+ * Extracts normalized world space planes.
+ * The near plane assumes a -1 to 1 depth range, for 0 to 1 projections that only makes it more conservative.
+ */
+void Culling_ExtractFrustum(mat4 viewProj, struct CullingFrustum *frustum);
+
+/**
+ * Culls bounds [first, first + count) on the calling thread
+ * @param visible receives the indices of the spheres touching the frustum in increasing order, room for count
+ * @return number of visible spheres
+ */
+uint32_t Culling_CullRange(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t first,
+			   uint32_t count, uint32_t *visible);
+
+/**
+ * Culls every sphere of bounds, split over the culling threads when the list is large enough
+ * @param visible receives the indices of the spheres touching the frustum in increasing order, room for bounds->count
+ * @return number of visible spheres
+ */
+uint32_t Culling_Cull(const struct CullingBounds *bounds, const struct CullingFrustum *frustum, uint32_t *visible);
@@ -0,0 +1,165 @@
+/*
+ * Compares the CPU frustum culling paths on a field of random bounding spheres around the camera,
+ * each on one thread and split over the culling threads. Every path must find the same visible set.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <argtable3.h>
+
+#include "external/cglm/cam.h"
+#include "external/cglm/mat4.h"
+
+#include "Culling.h"
+#include "Profiler.h"
+#include "Timer.h"
+
+// objects spread over a cube this wide centered on the camera, about a tenth of them land in the frustum
+#define FIELD_SIZE 1000.0f
+
+static float RandomFloat(float min, float max)
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static void Report(const char *method, double *seconds, uint32_t runs, uint32_t objectCount, uint32_t visibleCount)
+{
+	double best = seconds[0];
+	double sum = 0.0;
+	for (uint32_t i = 0; i < runs; ++i)
+	{
+		best = seconds[i] < best ? seconds[i] : best;
+		sum += seconds[i];
+	}
+
+	printf("%-18s best %8.3f ms %10.0f objects/ms  average %8.3f ms  %u visible\n", method, best * 1000.0,
+	       objectCount / (best * 1000.0), sum / runs * 1000.0, visibleCount);
+}
+
+int main(int argc, char **argv)
+{
+	struct arg_int *objects = arg_int0("o", "objects", "<n>", "bounding spheres to cull (default 1000000)");
+	struct arg_int *runs = arg_int0("r", "runs", "<n>", "runs per path (default 20)");
+	struct arg_int *threads = arg_int0("t", "threads", "<n>", "culling threads, 0 for one per core but one");
+	struct arg_lit *help = arg_lit0(NULL, "help", "print this help and exit");
+	struct arg_end *end = arg_end(20);
+	void *argtable[] = { objects, runs, threads, help, end };
+	const char *progname = "CullingBenchmark";
+	int exitcode = 0;
+
+	if (arg_nullcheck(argtable) != 0)
+	{
+		printf("%s: insufficient memory\n", progname);
+		exitcode = 1;
+		goto exit;
+	}
+
+	int nerrors = arg_parse(argc, argv, argtable);
+	if (help->count > 0 || nerrors > 0)
+	{
+		if (nerrors > 0)
+		{
+			arg_print_errors(stdout, end, progname);
+		}
+		printf("Usage: %s", progname);
+		arg_print_syntax(stdout, argtable, "\n");
+		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+		exitcode = nerrors > 0;
+		goto exit;
+	}
+
+	uint32_t objectCount = objects->count > 0 && objects->ival[0] > 0 ? objects->ival[0] : 1000000;
+	uint32_t runCount = runs->count > 0 && runs->ival[0] > 0 ? runs->ival[0] : 20;
+	uint32_t threadCount = threads->count > 0 && threads->ival[0] > 0 ? threads->ival[0] : 0;
+
+	Timer_Start();
+	Profiler_Init(false);
+	Culling_Init(threadCount);
+
+	struct CullingBounds bounds;
+	Culling_CreateBounds(&bounds, objectCount);
+	srand(1);
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		bounds.centerX[i] = RandomFloat(-FIELD_SIZE / 2.0f, FIELD_SIZE / 2.0f);
+		bounds.centerY[i] = RandomFloat(-FIELD_SIZE / 2.0f, FIELD_SIZE / 2.0f);
+		bounds.centerZ[i] = RandomFloat(-FIELD_SIZE / 2.0f, FIELD_SIZE / 2.0f);
+		bounds.radius[i] = RandomFloat(0.5f, 5.0f);
+	}
+	bounds.count = objectCount;
+
+	mat4 view, proj, viewProj;
+	glm_lookat((vec3){ 0.0f, 0.0f, 0.0f }, (vec3){ 0.0f, 0.0f, -1.0f }, (vec3){ 0.0f, 1.0f, 0.0f }, view);
+	glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, FIELD_SIZE / 2.0f, proj);
+	glm_mat4_mul(proj, view, viewProj);
+
+	struct CullingFrustum frustum;
+	Culling_ExtractFrustum(viewProj, &frustum);
+
+	uint32_t *visible = malloc(objectCount * sizeof(uint32_t));
+	uint32_t *reference = malloc(objectCount * sizeof(uint32_t));
+	double *seconds = malloc(runCount * sizeof(double));
+	if (visible == NULL || reference == NULL || seconds == NULL)
+	{
+		printf("Could not allocate lists for %u objects\n", objectCount);
+		exitcode = 1;
+		goto exit;
+	}
+
+	printf("%u objects, %u runs per path\n", objectCount, runCount);
+
+	uint32_t referenceCount = 0;
+	bool haveReference = false;
+	for (uint32_t path = 0; path < CULLING_PATH_COUNT; ++path)
+	{
+		if (!Culling_SetPath((enum CullingPath)path))
+		{
+			printf("%-18s not supported\n", Culling_PathName((enum CullingPath)path));
+			continue;
+		}
+
+		for (uint32_t parallel = 0; parallel < 2; ++parallel)
+		{
+			uint32_t visibleCount = 0;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				uint64_t begin = Timer_Ticks();
+
+				visibleCount = parallel ? Culling_Cull(&bounds, &frustum, visible)
+							: Culling_CullRange(&bounds, &frustum, 0, objectCount, visible);
+
+				seconds[run] = Timer_TicksToSeconds(Timer_Ticks() - begin);
+			}
+
+			char method[32];
+			snprintf(method, sizeof(method), "%s%s", Culling_PathName((enum CullingPath)path),
+				 parallel ? " threaded" : "");
+			Report(method, seconds, runCount, objectCount, visibleCount);
+
+			if (!haveReference)
+			{
+				memcpy(reference, visible, visibleCount * sizeof(uint32_t));
+				referenceCount = visibleCount;
+				haveReference = true;
+			}
+			else if (visibleCount != referenceCount ||
+				 memcmp(reference, visible, visibleCount * sizeof(uint32_t)) != 0)
+			{
+				printf("%s disagrees with %s\n", method, Culling_PathName(CULLING_PATH_SCALAR));
+				exitcode = 1;
+			}
+		}
+	}
+
+	free(seconds);
+	free(reference);
+	free(visible);
+	Culling_DestroyBounds(&bounds);
+	Culling_Destroy();
+	Profiler_Shutdown();
+
+exit:
+	arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+	return exitcode;
+}
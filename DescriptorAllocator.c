@@ -0,0 +1,220 @@
+#include "DescriptorAllocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// descriptors of each type a pool has room for per set, the pool is sized for DESCRIPTOR_ALLOCATOR_SETS_PER_POOL sets
+static const VkDescriptorPoolSize s_SizesPerSet[] = {
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 4 },
+	{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = 1 },
+	{ .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = 1 }
+};
+
+#define DESCRIPTOR_POOL_TYPE_COUNT (sizeof(s_SizesPerSet) / sizeof(s_SizesPerSet[0]))
+
+struct DescriptorPoolChain {
+	VkDescriptorPool *pools;
+	uint32_t poolCount;
+	uint32_t poolCapacity;
+	uint32_t current; // pools before it are full, pools after it are empty
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static uint32_t s_FrameCount = 0;
+static uint32_t s_Frame = 0;
+// a chain per frame slot, then the persistent one
+static struct DescriptorPoolChain *s_Chains = NULL;
+// empty pools given back by the chains, taken before creating one
+static struct DescriptorPoolChain s_FreePools;
+
+static VkDescriptorPool CreatePool()
+{
+	VkDescriptorPoolSize poolSizes[DESCRIPTOR_POOL_TYPE_COUNT];
+	for (uint32_t i = 0; i < DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+	{
+		poolSizes[i].type = s_SizesPerSet[i].type;
+		poolSizes[i].descriptorCount = s_SizesPerSet[i].descriptorCount * DESCRIPTOR_ALLOCATOR_SETS_PER_POOL;
+	}
+
+	// sets are only ever released by resetting the whole pool
+	VkDescriptorPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+						.pNext = NULL,
+						.flags = 0,
+						.maxSets = DESCRIPTOR_ALLOCATOR_SETS_PER_POOL,
+						.poolSizeCount = DESCRIPTOR_POOL_TYPE_COUNT,
+						.pPoolSizes = poolSizes };
+
+	VkDescriptorPool pool;
+	VkResult result = vkCreateDescriptorPool(s_Device, &poolInfo, NULL, &pool);
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not create descriptor pool\n");
+		abort();
+	}
+
+	return pool;
+}
+
+static void PushPool(struct DescriptorPoolChain *chain, VkDescriptorPool pool)
+{
+	if (chain->poolCount == chain->poolCapacity)
+	{
+		uint32_t capacity = chain->poolCapacity == 0 ? 4 : chain->poolCapacity * 2;
+		VkDescriptorPool *grown = realloc(chain->pools, capacity * sizeof(VkDescriptorPool));
+		if (grown == NULL)
+		{
+			printf("Could not grow the descriptor pool chain\n");
+			abort();
+		}
+
+		chain->pools = grown;
+		chain->poolCapacity = capacity;
+	}
+
+	chain->pools[chain->poolCount++] = pool;
+}
+
+static VkDescriptorPool TakePool()
+{
+	return s_FreePools.poolCount > 0 ? s_FreePools.pools[--s_FreePools.poolCount] : CreatePool();
+}
+
+static VkDescriptorSet AllocateFromChain(struct DescriptorPoolChain *chain, VkDescriptorSetLayout layout)
+{
+	if (chain->poolCount == 0)
+	{
+		PushPool(chain, TakePool());
+	}
+
+	VkDescriptorSetAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+						     .pNext = NULL,
+						     .descriptorPool = chain->pools[chain->current],
+						     .descriptorSetCount = 1,
+						     .pSetLayouts = &layout };
+
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets(s_Device, &allocateInfo, &set);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// the pool is full, the rest of the chain's sets go to the next one, which is empty
+		if (++chain->current == chain->poolCount)
+		{
+			PushPool(chain, TakePool());
+		}
+
+		allocateInfo.descriptorPool = chain->pools[chain->current];
+		result = vkAllocateDescriptorSets(s_Device, &allocateInfo, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not allocate a descriptor set, its layout may not fit a pool\n");
+		abort();
+	}
+
+	return set;
+}
+
+static void DestroyChain(struct DescriptorPoolChain *chain)
+{
+	for (uint32_t i = 0; i < chain->poolCount; ++i)
+	{
+		vkDestroyDescriptorPool(s_Device, chain->pools[i], NULL);
+	}
+
+	free(chain->pools);
+	chain->pools = NULL;
+	chain->poolCount = 0;
+	chain->poolCapacity = 0;
+	chain->current = 0;
+}
+
+void DescriptorAllocator_Init(VkDevice device, uint32_t frameCount)
+{
+	s_Device = device;
+	s_FrameCount = frameCount;
+	s_Frame = 0;
+
+	s_Chains = calloc(frameCount + 1, sizeof(struct DescriptorPoolChain));
+	if (s_Chains == NULL)
+	{
+		printf("Could not allocate the descriptor pool chains\n");
+		abort();
+	}
+}
+
+void DescriptorAllocator_Destroy()
+{
+	for (uint32_t i = 0; i < s_FrameCount + 1; ++i)
+	{
+		DestroyChain(&s_Chains[i]);
+	}
+	DestroyChain(&s_FreePools);
+
+	free(s_Chains);
+	s_Chains = NULL;
+	s_Device = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator_BeginFrame(uint32_t frame)
+{
+	assert(frame < s_FrameCount);
+
+	struct DescriptorPoolChain *chain = &s_Chains[frame];
+	for (uint32_t i = 0; i < chain->poolCount && i <= chain->current; ++i)
+	{
+		vkResetDescriptorPool(s_Device, chain->pools[i], 0);
+	}
+
+	// the pools a busy frame grew into go to whichever chain runs out next
+	for (uint32_t i = chain->poolCount; i > 1; --i)
+	{
+		PushPool(&s_FreePools, chain->pools[i - 1]);
+	}
+	chain->poolCount = chain->poolCount > 1 ? 1 : chain->poolCount;
+	chain->current = 0;
+
+	s_Frame = frame;
+}
+
+VkDescriptorSet DescriptorAllocator_Allocate(VkDescriptorSetLayout layout)
+{
+	return AllocateFromChain(&s_Chains[s_Frame], layout);
+}
+
+VkDescriptorSet DescriptorAllocator_AllocatePersistent(VkDescriptorSetLayout layout)
+{
+	return AllocateFromChain(&s_Chains[s_FrameCount], layout);
+}
+
+VkDescriptorUpdateTemplate DescriptorAllocator_CreateTemplate(VkDescriptorSetLayout layout,
+							       const VkDescriptorUpdateTemplateEntry *entries,
+							       uint32_t entryCount)
+{
+	VkDescriptorUpdateTemplateCreateInfo createInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.descriptorUpdateEntryCount = entryCount,
+		.pDescriptorUpdateEntries = entries,
+		.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+		.descriptorSetLayout = layout,
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS, // only read for push descriptor templates
+		.pipelineLayout = VK_NULL_HANDLE,
+		.set = 0
+	};
+
+	VkDescriptorUpdateTemplate updateTemplate;
+	VkResult result = vkCreateDescriptorUpdateTemplate(s_Device, &createInfo, NULL, &updateTemplate);
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not create descriptor update template\n");
+		abort();
+	}
+
+	return updateTemplate;
+}
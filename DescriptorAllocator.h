@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+// every pool holds this many sets, with room for DescriptorAllocator.c's descriptors per set of each type
+#define DESCRIPTOR_ALLOCATOR_SETS_PER_POOL 64
+
+/**
+ * Descriptor sets are allocated from chains of pools: one per frame slot, reset wholesale once the slot's fence
+ * has signalled, and one for sets living until shutdown. A chain that runs out moves on to its next pool, taking
+ * one reset by another chain before creating a new one, so once the chains have grown to the peak allocating a
+ * set never creates a pool or calls malloc, and no set is ever freed on its own. Render thread only.
+ * @param frameCount frame slots, see DescriptorAllocator_BeginFrame
+ */
+void DescriptorAllocator_Init(VkDevice device, uint32_t frameCount);
+
+/**
+ * Destroys every pool and with them every set allocated
+ */
+void DescriptorAllocator_Destroy();
+
+/**
+ * Resets the frame slot's pools and makes it the one transient sets are allocated from.
+ * The slot's fence must have signalled.
+ */
+void DescriptorAllocator_BeginFrame(uint32_t frame);
+
+/**
+ * A set valid until the current frame slot begins again, aborts if the layout does not fit an empty pool
+ */
+VkDescriptorSet DescriptorAllocator_Allocate(VkDescriptorSetLayout layout);
+
+/**
+ * A set valid until DescriptorAllocator_Destroy, for sets bound by command buffers that are submitted again
+ */
+VkDescriptorSet DescriptorAllocator_AllocatePersistent(VkDescriptorSetLayout layout);
+
+/**
+ * A template writing every binding of the layout at once from one struct, with an entry's offset and stride
+ * locating its descriptor infos in the struct. Destroy with vkDestroyDescriptorUpdateTemplate.
+ */
+VkDescriptorUpdateTemplate DescriptorAllocator_CreateTemplate(VkDescriptorSetLayout layout,
+							       const VkDescriptorUpdateTemplateEntry *entries,
+							       uint32_t entryCount);
@@ -0,0 +1,97 @@
+#include "DrawList.h"
+#include "Profiler.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define DRAW_KEY_MESH_SHIFT DRAW_KEY_DEPTH_BITS
+#define DRAW_KEY_MATERIAL_SHIFT (DRAW_KEY_MESH_SHIFT + DRAW_KEY_MESH_BITS)
+#define DRAW_KEY_PIPELINE_SHIFT (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_PASS_SHIFT (DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS)
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+#define FIELD_MASK(bits) ((1u << (bits)) - 1)
+
+uint64_t DrawList_MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+	assert(pass <= FIELD_MASK(DRAW_KEY_PASS_BITS) && pipeline <= FIELD_MASK(DRAW_KEY_PIPELINE_BITS));
+	assert(material <= FIELD_MASK(DRAW_KEY_MATERIAL_BITS) && mesh <= FIELD_MASK(DRAW_KEY_MESH_BITS));
+	assert(depth <= FIELD_MASK(DRAW_KEY_DEPTH_BITS));
+
+	return (uint64_t)pass << DRAW_KEY_PASS_SHIFT | (uint64_t)pipeline << DRAW_KEY_PIPELINE_SHIFT |
+	       (uint64_t)material << DRAW_KEY_MATERIAL_SHIFT | (uint64_t)mesh << DRAW_KEY_MESH_SHIFT | depth;
+}
+
+uint32_t DrawList_KeyPipeline(uint64_t key)
+{
+	return (uint32_t)(key >> DRAW_KEY_PIPELINE_SHIFT) & FIELD_MASK(DRAW_KEY_PIPELINE_BITS);
+}
+
+uint32_t DrawList_KeyMaterial(uint64_t key)
+{
+	return (uint32_t)(key >> DRAW_KEY_MATERIAL_SHIFT) & FIELD_MASK(DRAW_KEY_MATERIAL_BITS);
+}
+
+uint32_t DrawList_KeyMesh(uint64_t key)
+{
+	return (uint32_t)(key >> DRAW_KEY_MESH_SHIFT) & FIELD_MASK(DRAW_KEY_MESH_BITS);
+}
+
+uint32_t DrawList_QuantizeDepth(float distance, float near, float far)
+{
+	float t = (distance - near) / (far - near);
+	t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+	return (uint32_t)(t * (float)FIELD_MASK(DRAW_KEY_DEPTH_BITS));
+}
+
+struct DrawListEntry *DrawList_Sort(struct DrawListEntry *entries, struct DrawListEntry *scratch, uint32_t count)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	// the bits any two keys differ in, counting bytes every key shares would serialize on one bucket's counter
+	uint64_t varying = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		varying |= entries[i].key ^ entries[0].key;
+	}
+
+	struct DrawListEntry *source = entries;
+	struct DrawListEntry *destination = scratch;
+	for (uint32_t pass = 0; pass < RADIX_PASSES; ++pass)
+	{
+		uint32_t shift = pass * RADIX_BITS;
+		if (((varying >> shift) & (RADIX_BUCKETS - 1)) == 0)
+		{
+			continue;
+		}
+
+		uint32_t offsets[RADIX_BUCKETS] = { 0 };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			++offsets[(source[i].key >> shift) & (RADIX_BUCKETS - 1)];
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+		{
+			uint32_t bucketCount = offsets[bucket];
+			offsets[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			destination[offsets[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[i];
+		}
+
+		struct DrawListEntry *swap = source;
+		source = destination;
+		destination = swap;
+	}
+
+	PROFILE_END();
+	return source;
+}
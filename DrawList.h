@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Sort key bits, most significant first. Sorting by the key groups draws by the state they bind, the most
+ * expensive state to change first, and orders draws sharing all of it by depth.
+ */
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_PIPELINE_BITS 12
+#define DRAW_KEY_MATERIAL_BITS 12
+#define DRAW_KEY_MESH_BITS 12
+#define DRAW_KEY_DEPTH_BITS 24
+
+// draws with equal state bits can share binds and one indirect draw command
+#define DRAW_KEY_STATE(key) ((key) >> DRAW_KEY_DEPTH_BITS)
+
+struct DrawListEntry {
+	uint64_t key;
+	uint32_t draw; // index into the caller's draws
+};
+
+/**
+ * Packs the key, each field must fit its bits
+ * @param depth see DrawList_QuantizeDepth
+ */
+uint64_t DrawList_MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth);
+uint32_t DrawList_KeyPipeline(uint64_t key);
+uint32_t DrawList_KeyMaterial(uint64_t key);
+uint32_t DrawList_KeyMesh(uint64_t key);
+
+/**
+ * Maps a view space distance to DRAW_KEY_DEPTH_BITS, nearer first. Distances outside [near, far] are clamped.
+ */
+uint32_t DrawList_QuantizeDepth(float distance, float near, float far);
+
+/**
+ * Stable LSD radix sort by key, a byte per pass. Bytes every key has in common are skipped, so the passes spent
+ * follow the bits that actually vary, often only the depth and a few state bits.
+ * @param scratch room for count entries
+ * @return entries or scratch, whichever holds the sorted list
+ */
+struct DrawListEntry *DrawList_Sort(struct DrawListEntry *entries, struct DrawListEntry *scratch, uint32_t count);
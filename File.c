@@ -2,39 +2,33 @@
 // Created by Anders on 13/09/2022.
 //
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
+#include <string.h>
 #include <assert.h>
 
 #include "File.h"
+#include "Vfs.h"
 
-static void GetBinaryFileSize(FILE *file, size_t *size)
-{
-	fseek(file, 0, SEEK_END);
-	*size = ftell(file);
-	rewind(file);
-}
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
-static FILE *OpenFile(const char *fileName, const char *mode)
+uint64_t GetFileSize(const char* fileName)
 {
-	FILE *file;
-	fopen_s(&file, fileName, mode);
-
-	if (file == NULL)
+	struct VfsLocation location;
+	if (!Vfs_Locate(fileName, &location))
 	{
-		fprintf(stderr, "Could not read input file: %s\n", fileName);
-		abort();
+		return 0;
 	}
 
-	return file;
-}
-
-uint64_t GetFileSize(const char* fileName)
-{
-	struct stat sb;
-	stat(fileName, &sb);
-	return sb.st_size;
+	return location.size;
 }
 
 void ReadAllText(const char *fileName, char *buffer, uint64_t *bufferSize)
@@ -42,67 +36,106 @@ void ReadAllText(const char *fileName, char *buffer, uint64_t *bufferSize)
 	assert(fileName != NULL);
 	assert(bufferSize != NULL);
 
-	FILE *file = OpenFile(fileName, "r");
-	if (file == NULL)
+	struct VfsView view;
+	if (!Vfs_Open(fileName, &view))
 	{
 		fprintf(stderr, "Could not open file: %s\n", fileName);
 		abort();
 	}
 
-	*bufferSize = GetFileSize(fileName) * sizeof(char);
+	*bufferSize = view.size * sizeof(char);
+	memcpy(buffer, view.data, view.size);
+
+	//have to null-terminate
+	buffer[view.size] = '\0';
 
-	uint64_t bytesRead = fread_s(buffer, *bufferSize, 1, *bufferSize, file);
+	Vfs_Close(&view);
+}
 
-	uint32_t hadFileReadError = ferror(file);
-	if (hadFileReadError != 0)
+//let user allocate void* buffer
+const char *ReadBytes(const char *fileName, uint64_t *size)
+{
+	struct VfsView view;
+	if (!Vfs_Open(fileName, &view))
 	{
-		fprintf(stderr, "Error when reading file: %s\n", fileName);
-		fclose(file);
+		fprintf(stderr, "Could not open file: %s\n", fileName);
 		abort();
 	}
 
-	if (bytesRead > *bufferSize)
+	*size = view.size;
+
+	// directory mounts already handed over a private copy
+	if (view.owned != NULL)
+	{
+		return view.owned;
+	}
+
+	char *fileData = malloc(*size);
+	if (fileData == NULL)
 	{
-		fprintf(stderr, "Read more bytes than was allocated: %s\n", fileName);
-		fclose(file);
 		abort();
 	}
 
-	//have to null-terminate
-	buffer[bytesRead] = '\0';
+	memcpy(fileData, view.data, *size);
 
-	fclose(file);
+	return fileData;
 }
 
-//let user allocate void* buffer
-const char *ReadBytes(const char *fileName, size_t *size)
+static bool ReplaceFile(const char *from, const char *to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+FILE *BeginAtomicWrite(const char *fileName, char *tempFileName)
 {
-	FILE *file;
-	fopen_s(&file, fileName, "rb");
+	if (snprintf(tempFileName, TEMP_FILE_PATH_SIZE, "%s.tmp", fileName) >= TEMP_FILE_PATH_SIZE)
+	{
+		fprintf(stderr, "Path too long: %s\n", fileName);
+		return NULL;
+	}
 
+	FILE *file = fopen(tempFileName, "wb");
 	if (file == NULL)
 	{
-		abort();
+		fprintf(stderr, "Could not open file: %s\n", tempFileName);
 	}
 
-	fseek(file, 0, SEEK_END);
-	*size = ftell(file);
-	rewind(file);
+	return file;
+}
 
-	char *fileData = malloc(*size);
-	if (fileData == NULL)
+bool FinishAtomicWrite(FILE *file, const char *tempFileName, const char *fileName, bool written)
+{
+	written = written && fflush(file) == 0;
+#ifndef _WIN32
+	// the data has to be on disk before the rename is, or a power loss can leave an empty file behind
+	written = written && fsync(fileno(file)) == 0;
+#endif
+	written = fclose(file) == 0 && written;
+
+	if (!written || !ReplaceFile(tempFileName, fileName))
 	{
-		abort();
+		fprintf(stderr, "Could not write file: %s\n", fileName);
+		remove(tempFileName);
+		return false;
 	}
 
-	size_t bytesRead = fread_s(fileData, *size, 1, *size, file);
+	return true;
+}
 
-	if (bytesRead != *size)
+bool WriteBytesAtomic(const char *fileName, const void *header, uint64_t headerSize, const void *data,
+		      uint64_t dataSize)
+{
+	char tempFileName[TEMP_FILE_PATH_SIZE];
+	FILE *file = BeginAtomicWrite(fileName, tempFileName);
+	if (file == NULL)
 	{
-		abort();
+		return false;
 	}
 
-	fclose(file);
-
-	return fileData;
+	bool written = fwrite(header, 1, headerSize, file) == headerSize && fwrite(data, 1, dataSize, file) == dataSize;
+	return FinishAtomicWrite(file, tempFileName, fileName, written);
 }
@@ -1,20 +1,49 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define TEMP_FILE_PATH_SIZE 1024
 
 /**
  * Reads the given fileName into a null-terminated text buffer
- * @param fileName absolute path with file name
+ * @param fileName virtual path, resolved through the mounted Vfs before the host filesystem
  * @param buffer has at minimum allocated bufferSize + 1
  * @param bufferSize size of buffer
  */
 void ReadAllText(const char *fileName, char *buffer, uint64_t *bufferSize);
 
 /**
- * @param fileName absolute path with file name
- * @return size of file in bytes
+ * @param fileName virtual path, resolved through the mounted Vfs before the host filesystem
+ * @return size of file in bytes, 0 if it does not exist
  */
 uint64_t GetFileSize(const char* fileName);
 
 //TODO: similar signature as ReadAllText
+/**
+ * @return malloced copy of the file, prefer Vfs_Open to avoid the copy for files in packs
+ */
 const char *ReadBytes(const char *fileName, uint64_t *size);
+
+/**
+ * Writes header then data to a temporary file and renames it over fileName, so readers never see a partial file
+ * @param fileName host path
+ * @return false if the file could not be written, fileName is left as it was
+ */
+bool WriteBytesAtomic(const char *fileName, const void *header, uint64_t headerSize, const void *data,
+		      uint64_t dataSize);
+
+/**
+ * Opens a temporary file next to fileName to write it in pieces, see FinishAtomicWrite
+ * @param tempFileName receives the temporary path, TEMP_FILE_PATH_SIZE
+ * @return NULL if it could not be created
+ */
+FILE *BeginAtomicWrite(const char *fileName, char *tempFileName);
+
+/**
+ * Closes the temporary file and renames it over fileName, or removes it if anything went wrong
+ * @param written whether every write to the file succeeded
+ * @return false if the file was not replaced, fileName is left as it was
+ */
+bool FinishAtomicWrite(FILE *file, const char *tempFileName, const char *fileName, bool written);
@@ -0,0 +1,214 @@
+#include "FrameStats.h"
+#include "Timer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// refresh rate boundaries, so a histogram shows at a glance which vsync interval frames landed in
+static const double s_BucketLimits[FRAME_STATS_HISTOGRAM_BUCKETS - 1] = { 4.0,  8.34,  11.12, 16.67, 20.0,
+									  25.0, 33.34, 50.0,  100.0 };
+
+static const char *s_MetricNames[FRAME_STATS_METRIC_COUNT] = { "frame",   "cpu",    "fence",   "acquire",
+								 "present", "packet", "limiter" };
+
+// rolling window per metric in milliseconds
+static float s_Samples[FRAME_STATS_METRIC_COUNT][FRAME_STATS_WINDOW];
+static uint32_t s_SampleCount = 0; // total ever written, the ring index is this modulo the window
+
+static uint64_t s_Waits[FRAME_STATS_WAIT_COUNT];
+static uint64_t s_FrameEnd = 0;
+
+static uint32_t s_Histogram[FRAME_STATS_HISTOGRAM_BUCKETS];
+static uint32_t s_ReportHistogram[FRAME_STATS_HISTOGRAM_BUCKETS]; // since the last report
+static uint64_t s_ReportTicks = 0;
+static uint64_t s_LastReport = 0;
+static uint32_t s_FramesSinceReport = 0;
+
+void FrameStats_Init(double reportSeconds)
+{
+	memset(s_Samples, 0, sizeof s_Samples);
+	memset(s_Waits, 0, sizeof s_Waits);
+	memset(s_Histogram, 0, sizeof s_Histogram);
+	memset(s_ReportHistogram, 0, sizeof s_ReportHistogram);
+	s_SampleCount = 0;
+	s_FramesSinceReport = 0;
+	s_ReportTicks = Timer_SecondsToTicks(reportSeconds);
+	s_FrameEnd = Timer_Ticks();
+	s_LastReport = s_FrameEnd;
+}
+
+void FrameStats_AddWait(enum FrameStatsWait wait, uint64_t ticks)
+{
+	s_Waits[wait] += ticks;
+}
+
+double FrameStats_BucketLimit(uint32_t bucket)
+{
+	return bucket < FRAME_STATS_HISTOGRAM_BUCKETS - 1 ? s_BucketLimits[bucket] : INFINITY;
+}
+
+static uint32_t FindBucket(double milliseconds)
+{
+	uint32_t bucket = 0;
+	while (bucket < FRAME_STATS_HISTOGRAM_BUCKETS - 1 && milliseconds >= s_BucketLimits[bucket])
+	{
+		++bucket;
+	}
+
+	return bucket;
+}
+
+static double TicksToMilliseconds(uint64_t ticks)
+{
+	return Timer_TicksToSeconds(ticks) * 1000.0;
+}
+
+static int CompareFloats(const void *a, const void *b)
+{
+	float left = *(const float *)a;
+	float right = *(const float *)b;
+	return (left > right) - (left < right);
+}
+
+// nearest rank on a sorted copy, a 1024 entry sort every few seconds is far below the noise
+static void ComputePercentiles(const float *samples, uint32_t count, struct FrameStatsPercentiles *percentiles)
+{
+	if (count == 0)
+	{
+		memset(percentiles, 0, sizeof *percentiles);
+		return;
+	}
+
+	float sorted[FRAME_STATS_WINDOW];
+	memcpy(sorted, samples, count * sizeof(float));
+	qsort(sorted, count, sizeof(float), CompareFloats);
+
+	percentiles->p50 = sorted[(count - 1) * 50 / 100];
+	percentiles->p95 = sorted[(count - 1) * 95 / 100];
+	percentiles->p99 = sorted[(count - 1) * 99 / 100];
+}
+
+void FrameStats_GetSummary(struct FrameStatsSummary *summary)
+{
+	uint32_t count = s_SampleCount < FRAME_STATS_WINDOW ? s_SampleCount : FRAME_STATS_WINDOW;
+
+	summary->frameCount = count;
+	summary->totalFrameCount = s_SampleCount;
+	for (uint32_t metric = 0; metric < FRAME_STATS_METRIC_COUNT; ++metric)
+	{
+		// the percentiles do not depend on order, so the ring is used as is
+		ComputePercentiles(s_Samples[metric], count, &summary->milliseconds[metric]);
+	}
+	memcpy(summary->histogram, s_Histogram, sizeof s_Histogram);
+}
+
+static void PrintReport(double seconds)
+{
+	struct FrameStatsSummary summary;
+	FrameStats_GetSummary(&summary);
+
+	printf("Frame stats: %u frames in %.1fs, p50/p95/p99 ms:", s_FramesSinceReport, seconds);
+	for (uint32_t metric = 0; metric < FRAME_STATS_METRIC_COUNT; ++metric)
+	{
+		const struct FrameStatsPercentiles *percentiles = &summary.milliseconds[metric];
+		printf(" %s %.2f/%.2f/%.2f", s_MetricNames[metric], percentiles->p50, percentiles->p95,
+		       percentiles->p99);
+	}
+	printf("\nFrame time histogram:");
+	for (uint32_t bucket = 0; bucket < FRAME_STATS_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		if (bucket < FRAME_STATS_HISTOGRAM_BUCKETS - 1)
+		{
+			printf(" <%.1f:%u", s_BucketLimits[bucket], s_ReportHistogram[bucket]);
+		}
+		else
+		{
+			printf(" rest:%u", s_ReportHistogram[bucket]);
+		}
+	}
+	printf("\n");
+}
+
+void FrameStats_EndFrame()
+{
+	uint64_t now = Timer_Ticks();
+	uint64_t frameTicks = now - s_FrameEnd;
+	s_FrameEnd = now;
+
+	uint64_t waitTicks = 0;
+	for (uint32_t wait = 0; wait < FRAME_STATS_WAIT_COUNT; ++wait)
+	{
+		waitTicks += s_Waits[wait];
+	}
+
+	uint32_t index = s_SampleCount % FRAME_STATS_WINDOW;
+	s_Samples[FRAME_STATS_METRIC_FRAME][index] = (float)TicksToMilliseconds(frameTicks);
+	s_Samples[FRAME_STATS_METRIC_CPU][index] =
+		(float)TicksToMilliseconds(frameTicks > waitTicks ? frameTicks - waitTicks : 0);
+	s_Samples[FRAME_STATS_METRIC_FENCE][index] = (float)TicksToMilliseconds(s_Waits[FRAME_STATS_WAIT_FENCE]);
+	s_Samples[FRAME_STATS_METRIC_ACQUIRE][index] = (float)TicksToMilliseconds(s_Waits[FRAME_STATS_WAIT_ACQUIRE]);
+	s_Samples[FRAME_STATS_METRIC_PRESENT][index] = (float)TicksToMilliseconds(s_Waits[FRAME_STATS_WAIT_PRESENT]);
+	s_Samples[FRAME_STATS_METRIC_PACKET][index] = (float)TicksToMilliseconds(s_Waits[FRAME_STATS_WAIT_PACKET]);
+	s_Samples[FRAME_STATS_METRIC_LIMITER][index] = (float)TicksToMilliseconds(s_Waits[FRAME_STATS_WAIT_LIMITER]);
+	++s_SampleCount;
+
+	uint32_t bucket = FindBucket(s_Samples[FRAME_STATS_METRIC_FRAME][index]);
+	++s_Histogram[bucket];
+	++s_ReportHistogram[bucket];
+	++s_FramesSinceReport;
+	memset(s_Waits, 0, sizeof s_Waits);
+
+	if (s_ReportTicks != 0 && now - s_LastReport >= s_ReportTicks)
+	{
+		PrintReport(Timer_TicksToSeconds(now - s_LastReport));
+
+		memset(s_ReportHistogram, 0, sizeof s_ReportHistogram);
+		s_FramesSinceReport = 0;
+		s_LastReport = now;
+	}
+}
+
+bool FrameStats_WriteSummary(const char *fileName)
+{
+	FILE *file = fopen(fileName, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open %s for the frame stats\n", fileName);
+		return false;
+	}
+
+	struct FrameStatsSummary summary;
+	FrameStats_GetSummary(&summary);
+
+	fprintf(file, "{\n\t\"frames\": %u,\n\t\"window\": %u,\n", summary.totalFrameCount, summary.frameCount);
+	for (uint32_t metric = 0; metric < FRAME_STATS_METRIC_COUNT; ++metric)
+	{
+		const struct FrameStatsPercentiles *percentiles = &summary.milliseconds[metric];
+		fprintf(file, "\t\"%s\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f },\n", s_MetricNames[metric],
+			percentiles->p50, percentiles->p95, percentiles->p99);
+	}
+
+	// bucket upper bounds in milliseconds, null for the open ended last bucket
+	fprintf(file, "\t\"histogram\": [");
+	for (uint32_t bucket = 0; bucket < FRAME_STATS_HISTOGRAM_BUCKETS; ++bucket)
+	{
+		fprintf(file, "%s{ \"below\": ", bucket == 0 ? "" : ", ");
+		if (bucket < FRAME_STATS_HISTOGRAM_BUCKETS - 1)
+		{
+			fprintf(file, "%.2f", s_BucketLimits[bucket]);
+		}
+		else
+		{
+			fprintf(file, "null");
+		}
+		fprintf(file, ", \"count\": %u }", summary.histogram[bucket]);
+	}
+	fprintf(file, "]\n}\n");
+
+	bool success = ferror(file) == 0;
+	success = fclose(file) == 0 && success;
+
+	return success;
+}
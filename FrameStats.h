@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// frames kept for the rolling percentiles
+#define FRAME_STATS_WINDOW 1024
+#define FRAME_STATS_HISTOGRAM_BUCKETS 10
+
+enum FrameStatsWait {
+	FRAME_STATS_WAIT_FENCE, // CPU ahead of the GPU by MAX_FRAMES_IN_FLIGHT frames
+	FRAME_STATS_WAIT_ACQUIRE, // no swapchain image free, the present engine is holding them
+	FRAME_STATS_WAIT_PRESENT, // the driver blocking in vkQueuePresentKHR, typically FIFO throttling
+	FRAME_STATS_WAIT_PACKET, // render thread waiting for the main thread to fill a packet
+	FRAME_STATS_WAIT_LIMITER, // render thread waiting while the main thread sleeps in the frame limiter
+	FRAME_STATS_WAIT_COUNT
+};
+
+enum FrameStatsMetric {
+	FRAME_STATS_METRIC_FRAME, // time between the ends of two frames
+	FRAME_STATS_METRIC_CPU, // frame time minus every wait
+	FRAME_STATS_METRIC_FENCE,
+	FRAME_STATS_METRIC_ACQUIRE,
+	FRAME_STATS_METRIC_PRESENT,
+	FRAME_STATS_METRIC_PACKET,
+	FRAME_STATS_METRIC_LIMITER,
+	FRAME_STATS_METRIC_COUNT
+};
+
+struct FrameStatsPercentiles {
+	double p50;
+	double p95;
+	double p99;
+};
+
+struct FrameStatsSummary {
+	uint32_t frameCount; // frames in the rolling window
+	uint32_t totalFrameCount; // frames since FrameStats_Init
+	struct FrameStatsPercentiles milliseconds[FRAME_STATS_METRIC_COUNT];
+	// frame times since FrameStats_Init, bucket i counts frames below FrameStats_BucketLimit(i)
+	uint32_t histogram[FRAME_STATS_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Requires Timer_Start to have been called
+ * @param reportSeconds interval of the report printed from FrameStats_EndFrame, 0 to never print
+ */
+void FrameStats_Init(double reportSeconds);
+
+/**
+ * Adds time the render loop spent blocked, may be called several times per frame
+ * @param ticks Timer_Ticks based duration
+ */
+void FrameStats_AddWait(enum FrameStatsWait wait, uint64_t ticks);
+
+/**
+ * Closes the frame: everything since the previous call that was not a wait counts as CPU time
+ */
+void FrameStats_EndFrame();
+
+void FrameStats_GetSummary(struct FrameStatsSummary *summary);
+
+/**
+ * Writes the summary as JSON, for comparing benchmark runs
+ * @return false if the file could not be written
+ */
+bool FrameStats_WriteSummary(const char *fileName);
+
+/**
+ * @return upper bound of a histogram bucket in milliseconds, infinity for the last one
+ */
+double FrameStats_BucketLimit(uint32_t bucket);
@@ -0,0 +1,583 @@
+#include "GpuAllocator.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GPU_ALLOCATOR_NO_LEAF UINT32_MAX
+#define GPU_ALLOCATOR_NOT_FREE UINT8_MAX
+#define GPU_ALLOCATOR_MAX_ORDERS 32
+
+/*
+ * Binary buddy allocator over one VkDeviceMemory. The block is split into leaves of GPU_ALLOCATOR_MIN_SIZE
+ * and a free range of order k covers 2^k leaves starting at a leaf aligned to 2^k, so every range is
+ * aligned to its own size. Free ranges of each order form a doubly linked list threaded through the
+ * per-leaf arrays, freeOrder marks the first leaf of a free range so a buddy is found in constant time.
+ */
+struct GpuAllocatorBlock {
+	VkDeviceMemory memory;
+	void *mapped;
+	VkDeviceSize size;
+	VkDeviceSize usedBytes;
+	enum GpuResourceKind kind;
+	uint32_t allocationCount;
+	uint32_t maxOrder;
+	uint32_t freeHeads[GPU_ALLOCATOR_MAX_ORDERS];
+	uint32_t *next;
+	uint32_t *previous;
+	uint8_t *freeOrder;
+};
+
+struct GpuAllocatorPool {
+	struct GpuAllocatorBlock **blocks;
+	uint32_t blockCount;
+	uint32_t blockCapacity;
+};
+
+struct GpuAllocatorTypeStats {
+	VkDeviceSize blockBytes;
+	VkDeviceSize usedBytes;
+	VkDeviceSize dedicatedBytes;
+	uint32_t blockCount;
+	uint32_t allocationCount;
+	uint32_t dedicatedCount;
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static VkPhysicalDeviceMemoryProperties s_MemoryProperties;
+static VkDeviceSize s_NonCoherentAtomSize = 1;
+static uint32_t s_MaxAllocationCount = 0;
+static uint32_t s_DeviceAllocationCount = 0; // live vkAllocateMemory allocations
+
+static VkDeviceSize s_BlockSizes[VK_MAX_MEMORY_TYPES];
+static struct GpuAllocatorPool s_Pools[VK_MAX_MEMORY_TYPES][GPU_RESOURCE_KIND_COUNT];
+static struct GpuAllocatorTypeStats s_TypeStats[VK_MAX_MEMORY_TYPES];
+
+static bool IsHostVisible(uint32_t memoryType)
+{
+	return (s_MemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+static uint32_t OrderForSize(VkDeviceSize size)
+{
+	uint32_t order = 0;
+	while ((GPU_ALLOCATOR_MIN_SIZE << order) < size)
+	{
+		order++;
+	}
+	return order;
+}
+
+static bool AllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory *memory, void **mapped)
+{
+	if (s_MaxAllocationCount != 0 && s_DeviceAllocationCount >= s_MaxAllocationCount)
+	{
+		printf("GPU allocator reached maxMemoryAllocationCount (%u)\n", s_MaxAllocationCount);
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+					      .pNext = NULL,
+					      .allocationSize = size,
+					      .memoryTypeIndex = memoryType };
+
+	if (vkAllocateMemory(s_Device, &allocateInfo, NULL, memory) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	*mapped = NULL;
+	// mapped once for its lifetime, a VkDeviceMemory may not be mapped twice at the same time
+	if (IsHostVisible(memoryType) && vkMapMemory(s_Device, *memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+	{
+		vkFreeMemory(s_Device, *memory, NULL);
+		return false;
+	}
+
+	s_DeviceAllocationCount++;
+	return true;
+}
+
+static void FreeDeviceMemory(VkDeviceMemory memory, void *mapped)
+{
+	if (mapped != NULL)
+	{
+		vkUnmapMemory(s_Device, memory);
+	}
+	vkFreeMemory(s_Device, memory, NULL);
+	s_DeviceAllocationCount--;
+}
+
+static void PushFree(struct GpuAllocatorBlock *block, uint32_t leaf, uint32_t order)
+{
+	uint32_t head = block->freeHeads[order];
+	block->next[leaf] = head;
+	block->previous[leaf] = GPU_ALLOCATOR_NO_LEAF;
+	if (head != GPU_ALLOCATOR_NO_LEAF)
+	{
+		block->previous[head] = leaf;
+	}
+	block->freeHeads[order] = leaf;
+	block->freeOrder[leaf] = (uint8_t)order;
+}
+
+static void RemoveFree(struct GpuAllocatorBlock *block, uint32_t leaf)
+{
+	uint32_t order = block->freeOrder[leaf];
+	uint32_t next = block->next[leaf];
+	uint32_t previous = block->previous[leaf];
+
+	if (previous != GPU_ALLOCATOR_NO_LEAF)
+	{
+		block->next[previous] = next;
+	}
+	else
+	{
+		block->freeHeads[order] = next;
+	}
+	if (next != GPU_ALLOCATOR_NO_LEAF)
+	{
+		block->previous[next] = previous;
+	}
+	block->freeOrder[leaf] = GPU_ALLOCATOR_NOT_FREE;
+}
+
+static struct GpuAllocatorBlock *CreateBlock(uint32_t memoryType, enum GpuResourceKind kind)
+{
+	VkDeviceSize size = s_BlockSizes[memoryType];
+
+	VkDeviceMemory memory;
+	void *mapped;
+	if (!AllocateDeviceMemory(memoryType, size, &memory, &mapped))
+	{
+		return NULL;
+	}
+
+	uint32_t leafCount = (uint32_t)(size / GPU_ALLOCATOR_MIN_SIZE);
+
+	struct GpuAllocatorBlock *block = malloc(sizeof(struct GpuAllocatorBlock));
+	block->memory = memory;
+	block->mapped = mapped;
+	block->size = size;
+	block->usedBytes = 0;
+	block->kind = kind;
+	block->allocationCount = 0;
+	block->maxOrder = OrderForSize(size);
+	block->next = malloc(leafCount * sizeof(uint32_t));
+	block->previous = malloc(leafCount * sizeof(uint32_t));
+	block->freeOrder = malloc(leafCount * sizeof(uint8_t));
+	memset(block->freeOrder, GPU_ALLOCATOR_NOT_FREE, leafCount * sizeof(uint8_t));
+	for (uint32_t i = 0; i < GPU_ALLOCATOR_MAX_ORDERS; i++)
+	{
+		block->freeHeads[i] = GPU_ALLOCATOR_NO_LEAF;
+	}
+	PushFree(block, 0, block->maxOrder);
+
+	s_TypeStats[memoryType].blockBytes += size;
+	s_TypeStats[memoryType].blockCount++;
+
+	return block;
+}
+
+static void DestroyBlock(struct GpuAllocatorBlock *block, uint32_t memoryType)
+{
+	s_TypeStats[memoryType].blockBytes -= block->size;
+	s_TypeStats[memoryType].blockCount--;
+
+	FreeDeviceMemory(block->memory, block->mapped);
+	free(block->next);
+	free(block->previous);
+	free(block->freeOrder);
+	free(block);
+}
+
+static bool AllocateFromBlock(struct GpuAllocatorBlock *block, uint32_t order, uint32_t *leaf)
+{
+	uint32_t available = order;
+	while (available <= block->maxOrder && block->freeHeads[available] == GPU_ALLOCATOR_NO_LEAF)
+	{
+		available++;
+	}
+	if (available > block->maxOrder)
+	{
+		return false;
+	}
+
+	uint32_t first = block->freeHeads[available];
+	RemoveFree(block, first);
+
+	// split down to the requested order, the upper halves stay free
+	while (available > order)
+	{
+		available--;
+		PushFree(block, first + (1u << available), available);
+	}
+
+	*leaf = first;
+	return true;
+}
+
+static void FreeToBlock(struct GpuAllocatorBlock *block, uint32_t leaf, uint32_t order)
+{
+	while (order < block->maxOrder)
+	{
+		uint32_t buddy = leaf ^ (1u << order);
+		if (block->freeOrder[buddy] != order)
+		{
+			break;
+		}
+		RemoveFree(block, buddy);
+		leaf = leaf < buddy ? leaf : buddy;
+		order++;
+	}
+
+	PushFree(block, leaf, order);
+}
+
+static void AddBlock(struct GpuAllocatorPool *pool, struct GpuAllocatorBlock *block)
+{
+	if (pool->blockCount == pool->blockCapacity)
+	{
+		pool->blockCapacity = pool->blockCapacity == 0 ? 4 : pool->blockCapacity * 2;
+		pool->blocks = realloc(pool->blocks, pool->blockCapacity * sizeof(struct GpuAllocatorBlock *));
+	}
+	pool->blocks[pool->blockCount++] = block;
+}
+
+static bool AllocateDedicated(uint32_t memoryType, VkDeviceSize size, struct GpuAllocation *allocation)
+{
+	VkDeviceMemory memory;
+	void *mapped;
+	if (!AllocateDeviceMemory(memoryType, size, &memory, &mapped))
+	{
+		return false;
+	}
+
+	*allocation = (struct GpuAllocation){ .memory = memory,
+					      .offset = 0,
+					      .size = size,
+					      .mapped = mapped,
+					      .block = NULL,
+					      .memoryType = memoryType,
+					      .order = 0 };
+
+	s_TypeStats[memoryType].dedicatedBytes += size;
+	s_TypeStats[memoryType].dedicatedCount++;
+	return true;
+}
+
+void GpuAllocator_Init(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	assert(s_Device == VK_NULL_HANDLE);
+
+	s_Device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &s_MemoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	s_NonCoherentAtomSize = deviceProperties.limits.nonCoherentAtomSize;
+	s_MaxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+	// small heaps such as the 256 MiB BAR window get smaller blocks so one block can't exhaust them
+	for (uint32_t i = 0; i < s_MemoryProperties.memoryTypeCount; i++)
+	{
+		VkDeviceSize heapSize = s_MemoryProperties.memoryHeaps[s_MemoryProperties.memoryTypes[i].heapIndex].size;
+		VkDeviceSize blockSize = GPU_ALLOCATOR_BLOCK_SIZE;
+		while (blockSize > GPU_ALLOCATOR_MIN_SIZE && blockSize > heapSize / 8)
+		{
+			blockSize /= 2;
+		}
+		s_BlockSizes[i] = blockSize;
+	}
+
+	memset(s_Pools, 0, sizeof(s_Pools));
+	memset(s_TypeStats, 0, sizeof(s_TypeStats));
+	s_DeviceAllocationCount = 0;
+}
+
+void GpuAllocator_Destroy()
+{
+	for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++)
+	{
+		for (uint32_t kind = 0; kind < GPU_RESOURCE_KIND_COUNT; kind++)
+		{
+			struct GpuAllocatorPool *pool = &s_Pools[type][kind];
+			for (uint32_t i = 0; i < pool->blockCount; i++)
+			{
+				if (pool->blocks[i]->allocationCount != 0)
+				{
+					printf("GPU allocator destroyed with %u live allocations in memory type %u\n",
+					       pool->blocks[i]->allocationCount, type);
+				}
+				DestroyBlock(pool->blocks[i], type);
+			}
+			free(pool->blocks);
+		}
+	}
+
+	if (s_DeviceAllocationCount != 0)
+	{
+		printf("GPU allocator destroyed with %u live dedicated allocations\n", s_DeviceAllocationCount);
+	}
+
+	memset(s_Pools, 0, sizeof(s_Pools));
+	s_Device = VK_NULL_HANDLE;
+}
+
+uint32_t GpuAllocator_FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < s_MemoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (s_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	printf("Failed to find suitable memory type\n");
+	abort();
+}
+
+bool GpuAllocator_Allocate(const VkMemoryRequirements *requirements, VkMemoryPropertyFlags properties,
+			   enum GpuResourceKind kind, struct GpuAllocation *allocation)
+{
+	assert(s_Device != VK_NULL_HANDLE);
+
+	uint32_t memoryType = GpuAllocator_FindMemoryType(requirements->memoryTypeBits, properties);
+	VkDeviceSize blockSize = s_BlockSizes[memoryType];
+
+	// ranges are aligned to their size, so a large alignment is met by rounding the size up to it
+	VkDeviceSize size = requirements->size > requirements->alignment ? requirements->size : requirements->alignment;
+
+	if (size > blockSize / GPU_ALLOCATOR_DEDICATED_DIVISOR)
+	{
+		return AllocateDedicated(memoryType, requirements->size, allocation);
+	}
+
+	uint32_t order = OrderForSize(size);
+	struct GpuAllocatorPool *pool = &s_Pools[memoryType][kind];
+
+	struct GpuAllocatorBlock *block = NULL;
+	uint32_t leaf = 0;
+	for (uint32_t i = 0; i < pool->blockCount; i++)
+	{
+		if (AllocateFromBlock(pool->blocks[i], order, &leaf))
+		{
+			block = pool->blocks[i];
+			break;
+		}
+	}
+
+	if (block == NULL)
+	{
+		block = CreateBlock(memoryType, kind);
+		if (block == NULL)
+		{
+			return false;
+		}
+		AddBlock(pool, block);
+
+		bool allocated = AllocateFromBlock(block, order, &leaf);
+		assert(allocated);
+		(void)allocated;
+	}
+
+	VkDeviceSize offset = (VkDeviceSize)leaf * GPU_ALLOCATOR_MIN_SIZE;
+	VkDeviceSize rangeSize = GPU_ALLOCATOR_MIN_SIZE << order;
+
+	*allocation = (struct GpuAllocation){ .memory = block->memory,
+					      .offset = offset,
+					      .size = rangeSize,
+					      .mapped = block->mapped != NULL ? (char *)block->mapped + offset : NULL,
+					      .block = block,
+					      .memoryType = memoryType,
+					      .order = order };
+
+	block->usedBytes += rangeSize;
+	block->allocationCount++;
+	s_TypeStats[memoryType].usedBytes += rangeSize;
+	s_TypeStats[memoryType].allocationCount++;
+
+	return true;
+}
+
+void GpuAllocator_AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, struct GpuAllocation *allocation)
+{
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(s_Device, buffer, &memoryRequirements);
+
+	if (!GpuAllocator_Allocate(&memoryRequirements, properties, GPU_RESOURCE_LINEAR, allocation))
+	{
+		printf("Failed to allocate %llu bytes of buffer memory\n", (unsigned long long)memoryRequirements.size);
+		abort();
+	}
+
+	vkBindBufferMemory(s_Device, buffer, allocation->memory, allocation->offset);
+}
+
+void GpuAllocator_AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties,
+				struct GpuAllocation *allocation)
+{
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(s_Device, image, &memoryRequirements);
+
+	enum GpuResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? GPU_RESOURCE_OPTIMAL : GPU_RESOURCE_LINEAR;
+	if (!GpuAllocator_Allocate(&memoryRequirements, properties, kind, allocation))
+	{
+		printf("Failed to allocate %llu bytes of image memory\n", (unsigned long long)memoryRequirements.size);
+		abort();
+	}
+
+	vkBindImageMemory(s_Device, image, allocation->memory, allocation->offset);
+}
+
+void GpuAllocator_Free(struct GpuAllocation *allocation)
+{
+	if (allocation->memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	uint32_t memoryType = allocation->memoryType;
+	struct GpuAllocatorBlock *block = allocation->block;
+
+	if (block == NULL)
+	{
+		s_TypeStats[memoryType].dedicatedBytes -= allocation->size;
+		s_TypeStats[memoryType].dedicatedCount--;
+		FreeDeviceMemory(allocation->memory, allocation->mapped);
+		memset(allocation, 0, sizeof(struct GpuAllocation));
+		return;
+	}
+
+	uint32_t leaf = (uint32_t)(allocation->offset / GPU_ALLOCATOR_MIN_SIZE);
+	FreeToBlock(block, leaf, allocation->order);
+
+	block->usedBytes -= allocation->size;
+	block->allocationCount--;
+	s_TypeStats[memoryType].usedBytes -= allocation->size;
+	s_TypeStats[memoryType].allocationCount--;
+
+	// empty blocks go back to the driver, except the first of each pool so a resource recreated every
+	// swapchain resize doesn't allocate a fresh block each time
+	if (block->allocationCount == 0)
+	{
+		struct GpuAllocatorPool *pool = &s_Pools[memoryType][block->kind];
+		for (uint32_t i = 1; i < pool->blockCount; i++)
+		{
+			if (pool->blocks[i] == block)
+			{
+				pool->blocks[i] = pool->blocks[--pool->blockCount];
+				DestroyBlock(block, memoryType);
+				break;
+			}
+		}
+	}
+
+	memset(allocation, 0, sizeof(struct GpuAllocation));
+}
+
+uint32_t GpuAllocator_HeapCount()
+{
+	return s_MemoryProperties.memoryHeapCount;
+}
+
+void GpuAllocator_GetHeapStats(uint32_t heapIndex, struct GpuHeapStats *stats)
+{
+	memset(stats, 0, sizeof(struct GpuHeapStats));
+	stats->heapSize = s_MemoryProperties.memoryHeaps[heapIndex].size;
+
+	for (uint32_t i = 0; i < s_MemoryProperties.memoryTypeCount; i++)
+	{
+		if (s_MemoryProperties.memoryTypes[i].heapIndex != heapIndex)
+		{
+			continue;
+		}
+
+		stats->blockBytes += s_TypeStats[i].blockBytes;
+		stats->usedBytes += s_TypeStats[i].usedBytes;
+		stats->dedicatedBytes += s_TypeStats[i].dedicatedBytes;
+		stats->blockCount += s_TypeStats[i].blockCount;
+		stats->allocationCount += s_TypeStats[i].allocationCount;
+		stats->dedicatedCount += s_TypeStats[i].dedicatedCount;
+	}
+}
+
+void GpuAllocator_PrintStats()
+{
+	const double mebibyte = 1024.0 * 1024.0;
+
+	for (uint32_t i = 0; i < s_MemoryProperties.memoryHeapCount; i++)
+	{
+		struct GpuHeapStats stats;
+		GpuAllocator_GetHeapStats(i, &stats);
+		if (stats.blockCount == 0 && stats.dedicatedCount == 0)
+		{
+			continue;
+		}
+
+		const char *location =
+			(s_MemoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device" : "host";
+		printf("GPU heap %u (%s, %.0f MiB): %u blocks %.2f MiB, %u sub-allocations %.2f MiB, "
+		       "%u dedicated %.2f MiB\n",
+		       i, location, (double)stats.heapSize / mebibyte, stats.blockCount,
+		       (double)stats.blockBytes / mebibyte, stats.allocationCount, (double)stats.usedBytes / mebibyte,
+		       stats.dedicatedCount, (double)stats.dedicatedBytes / mebibyte);
+	}
+}
+
+void GpuLinearPool_Create(struct GpuLinearPool *pool, VkDeviceSize capacity, VkBufferUsageFlags usage,
+			  VkMemoryPropertyFlags properties)
+{
+	VkBufferCreateInfo bufferCreateInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+						.pNext = NULL,
+						.flags = 0,
+						.size = capacity,
+						.usage = usage,
+						.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+						.queueFamilyIndexCount = 0,
+						.pQueueFamilyIndices = NULL };
+
+	if (vkCreateBuffer(s_Device, &bufferCreateInfo, NULL, &pool->buffer) != VK_SUCCESS)
+	{
+		printf("Failed to create linear pool buffer\n");
+		abort();
+	}
+
+	GpuAllocator_AllocateBuffer(pool->buffer, properties, &pool->allocation);
+	pool->capacity = capacity;
+	pool->head = 0;
+}
+
+void GpuLinearPool_Destroy(struct GpuLinearPool *pool)
+{
+	vkDestroyBuffer(s_Device, pool->buffer, NULL);
+	GpuAllocator_Free(&pool->allocation);
+	memset(pool, 0, sizeof(struct GpuLinearPool));
+}
+
+void *GpuLinearPool_Allocate(struct GpuLinearPool *pool, VkDeviceSize size, VkDeviceSize alignment,
+			     VkDeviceSize *offset)
+{
+	// non-coherent memory is flushed in atoms, keep allocations from sharing one
+	if (alignment < s_NonCoherentAtomSize)
+	{
+		alignment = s_NonCoherentAtomSize;
+	}
+
+	VkDeviceSize start = (pool->head + alignment - 1) / alignment * alignment;
+	if (pool->allocation.mapped == NULL || start + size > pool->capacity)
+	{
+		return NULL;
+	}
+
+	pool->head = start + size;
+	*offset = start;
+	return (char *)pool->allocation.mapped + start;
+}
+
+void GpuLinearPool_Reset(struct GpuLinearPool *pool)
+{
+	pool->head = 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+// device memory is allocated in blocks of this size and sub-allocated with a buddy allocator
+#define GPU_ALLOCATOR_BLOCK_SIZE (64ull * 1024 * 1024)
+// smallest buddy, every sub-allocation is rounded up to a power of two multiple of it
+#define GPU_ALLOCATOR_MIN_SIZE 4096ull
+// resources larger than this fraction of a block get a dedicated vkAllocateMemory
+#define GPU_ALLOCATOR_DEDICATED_DIVISOR 2
+
+struct GpuAllocatorBlock;
+
+/*
+ * Resources with linear and optimal tiling are kept in separate blocks, so neighbouring
+ * sub-allocations never need padding to bufferImageGranularity
+ */
+enum GpuResourceKind {
+	GPU_RESOURCE_LINEAR, // buffers and linear images
+	GPU_RESOURCE_OPTIMAL, // optimally tiled images
+	GPU_RESOURCE_KIND_COUNT
+};
+
+struct GpuAllocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size; // rounded up size the allocation occupies
+	void *mapped; // persistently mapped pointer to offset when host visible, NULL otherwise
+	struct GpuAllocatorBlock *block; // NULL for dedicated allocations
+	uint32_t memoryType;
+	uint32_t order; // buddy order, size is GPU_ALLOCATOR_MIN_SIZE << order
+};
+
+struct GpuHeapStats {
+	VkDeviceSize heapSize;
+	VkDeviceSize blockBytes; // reserved in blocks
+	VkDeviceSize usedBytes; // handed out from blocks, including rounding
+	VkDeviceSize dedicatedBytes;
+	uint32_t blockCount;
+	uint32_t allocationCount; // sub-allocations
+	uint32_t dedicatedCount;
+};
+
+/**
+ * Caches the memory properties and limits of the device. Not thread safe, use from the thread owning the renderer.
+ */
+void GpuAllocator_Init(VkPhysicalDevice physicalDevice, VkDevice device);
+
+/**
+ * Frees every block, all allocations must have been freed before
+ */
+void GpuAllocator_Destroy();
+
+/**
+ * First memory type allowed by typeFilter with all of the properties, aborts if there is none
+ */
+uint32_t GpuAllocator_FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+/**
+ * Sub-allocates memory for the requirements, host visible memory comes back mapped
+ * @return false if the device is out of memory
+ */
+bool GpuAllocator_Allocate(const VkMemoryRequirements *requirements, VkMemoryPropertyFlags properties,
+			   enum GpuResourceKind kind, struct GpuAllocation *allocation);
+
+/**
+ * Allocates and binds memory for the buffer, aborts on failure
+ */
+void GpuAllocator_AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, struct GpuAllocation *allocation);
+
+/**
+ * Allocates and binds memory for the image, aborts on failure
+ */
+void GpuAllocator_AllocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties,
+				struct GpuAllocation *allocation);
+
+/**
+ * Returns the memory to its block. Does nothing for a zeroed allocation.
+ * The GPU must be done with the resource, see DeferDestruction.
+ */
+void GpuAllocator_Free(struct GpuAllocation *allocation);
+
+void GpuAllocator_GetHeapStats(uint32_t heapIndex, struct GpuHeapStats *stats);
+uint32_t GpuAllocator_HeapCount();
+
+/**
+ * Prints the usage of every heap with allocations to the log
+ */
+void GpuAllocator_PrintStats();
+
+/*
+ * Bump allocator over a single allocation, for transient data rewritten every frame.
+ * Reset once the frame that used it has retired.
+ */
+struct GpuLinearPool {
+	VkBuffer buffer;
+	struct GpuAllocation allocation;
+	VkDeviceSize capacity;
+	VkDeviceSize head;
+};
+
+/**
+ * Creates a buffer and its memory, host visible pools are persistently mapped
+ */
+void GpuLinearPool_Create(struct GpuLinearPool *pool, VkDeviceSize capacity, VkBufferUsageFlags usage,
+			  VkMemoryPropertyFlags properties);
+void GpuLinearPool_Destroy(struct GpuLinearPool *pool);
+
+/**
+ * @param offset receives the offset into pool->buffer
+ * @return mapped pointer to the space, NULL when the pool is full or not host visible
+ */
+void *GpuLinearPool_Allocate(struct GpuLinearPool *pool, VkDeviceSize size, VkDeviceSize alignment,
+			     VkDeviceSize *offset);
+void GpuLinearPool_Reset(struct GpuLinearPool *pool);
@@ -0,0 +1,396 @@
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Timer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GPU_PROFILER_QUERIES_PER_FRAME (GPU_PROFILER_MAX_SCOPES * 2)
+#define GPU_PROFILER_NO_SCOPE UINT32_MAX
+
+// ordered by bit, which is the order the results are written in
+#define GPU_PROFILER_STATISTICS                                                                           \
+	(VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |                                         \
+	 VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |                                       \
+	 VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |                                       \
+	 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |                                             \
+	 VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+struct GpuProfilerFrame {
+	const char *names[GPU_PROFILER_MAX_SCOPES];
+	uint32_t scopeCount;
+	uint32_t stack[GPU_PROFILER_MAX_SCOPES];
+	uint32_t depth;
+	uint32_t overflowDepth; // scopes nested deeper than the stack, labelled but not timed
+	bool statisticsWritten;
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static VkQueryPool s_TimestampPool = VK_NULL_HANDLE;
+static VkQueryPool s_StatisticsPool = VK_NULL_HANDLE;
+
+static struct GpuProfilerFrame *s_Frames = NULL;
+static uint32_t s_FrameCount = 0;
+static uint32_t s_CurrentFrame = 0;
+
+static double s_TimestampPeriod = 0.0; // nanoseconds per timestamp tick
+static uint64_t s_TimestampMask = 0;
+static uint64_t s_CalibrationGpu = 0;
+static uint64_t s_CalibrationCpu = 0;
+
+static int32_t s_Track = -1;
+static int32_t s_StatisticsTrack = -1;
+
+static PFN_vkCmdBeginDebugUtilsLabelEXT s_CmdBeginDebugUtilsLabel = NULL;
+static PFN_vkCmdEndDebugUtilsLabelEXT s_CmdEndDebugUtilsLabel = NULL;
+
+static struct GpuPipelineStatistics s_LastStatistics;
+static bool s_HasStatistics = false;
+
+static uint64_t ToCpuTicks(uint64_t gpuTimestamp)
+{
+	uint64_t elapsed = (gpuTimestamp - s_CalibrationGpu) & s_TimestampMask;
+	return s_CalibrationCpu + Timer_SecondsToTicks((double)elapsed * s_TimestampPeriod * 1e-9);
+}
+
+static uint64_t ToTickDuration(uint64_t begin, uint64_t end)
+{
+	return Timer_SecondsToTicks((double)((end - begin) & s_TimestampMask) * s_TimestampPeriod * 1e-9);
+}
+
+/*
+ * Pairs one GPU timestamp with the CPU clock. The timestamp lands somewhere between submit and the
+ * wait returning, the midpoint keeps the error to half the submission latency.
+ */
+static void CalibrateClocks(VkQueue queue, uint32_t queueFamilyIndex)
+{
+	VkCommandPoolCreateInfo poolCreateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+						   .pNext = NULL,
+						   .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+						   .queueFamilyIndex = queueFamilyIndex };
+
+	VkCommandPool commandPool;
+	if (vkCreateCommandPool(s_Device, &poolCreateInfo, NULL, &commandPool) != VK_SUCCESS)
+	{
+		printf("Could not create the GPU profiler calibration command pool\n");
+		abort();
+	}
+
+	VkCommandBufferAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+						     .pNext = NULL,
+						     .commandPool = commandPool,
+						     .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+						     .commandBufferCount = 1 };
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(s_Device, &allocateInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					       .pNext = NULL,
+					       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+					       .pInheritanceInfo = NULL };
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	vkCmdResetQueryPool(commandBuffer, s_TimestampPool, 0, 1);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_TimestampPool, 0);
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				    .pNext = NULL,
+				    .commandBufferCount = 1,
+				    .pCommandBuffers = &commandBuffer };
+
+	uint64_t submitTicks = Timer_Ticks();
+	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue);
+	uint64_t completeTicks = Timer_Ticks();
+
+	vkGetQueryPoolResults(s_Device, s_TimestampPool, 0, 1, sizeof(uint64_t), &s_CalibrationGpu, sizeof(uint64_t),
+			      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	s_CalibrationCpu = submitTicks + (completeTicks - submitTicks) / 2;
+
+	vkDestroyCommandPool(s_Device, commandPool, NULL);
+}
+
+void GpuProfiler_Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue,
+		      uint32_t queueFamilyIndex, uint32_t frameCount, bool pipelineStatistics)
+{
+	assert(frameCount > 0);
+
+	s_Device = device;
+	s_FrameCount = frameCount;
+	s_CurrentFrame = 0;
+	s_HasStatistics = false;
+
+	s_Frames = calloc(frameCount, sizeof(struct GpuProfilerFrame));
+	if (s_Frames == NULL)
+	{
+		printf("Could not allocate the GPU profiler frames\n");
+		abort();
+	}
+
+	if (instance != VK_NULL_HANDLE)
+	{
+		s_CmdBeginDebugUtilsLabel =
+			(PFN_vkCmdBeginDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT");
+		s_CmdEndDebugUtilsLabel =
+			(PFN_vkCmdEndDebugUtilsLabelEXT)vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT");
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+	VkQueueFamilyProperties *queueFamilies = malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+	uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	free(queueFamilies);
+
+	if (validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+	{
+		printf("The queue has no timestamps, GPU scopes will only be labelled\n");
+		return;
+	}
+
+	s_TimestampPeriod = properties.limits.timestampPeriod;
+	s_TimestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo timestampPoolInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+						    .pNext = NULL,
+						    .flags = 0,
+						    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+						    .queryCount = GPU_PROFILER_QUERIES_PER_FRAME * frameCount,
+						    .pipelineStatistics = 0 };
+
+	if (vkCreateQueryPool(device, &timestampPoolInfo, NULL, &s_TimestampPool) != VK_SUCCESS)
+	{
+		printf("Could not create the timestamp query pool\n");
+		abort();
+	}
+
+	if (pipelineStatistics)
+	{
+		VkQueryPoolCreateInfo statisticsPoolInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+							     .pNext = NULL,
+							     .flags = 0,
+							     .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+							     .queryCount = frameCount,
+							     .pipelineStatistics = GPU_PROFILER_STATISTICS };
+
+		if (vkCreateQueryPool(device, &statisticsPoolInfo, NULL, &s_StatisticsPool) != VK_SUCCESS)
+		{
+			printf("Could not create the pipeline statistics query pool\n");
+			abort();
+		}
+	}
+
+	CalibrateClocks(queue, queueFamilyIndex);
+
+	s_Track = Profiler_RegisterTrack("GPU");
+	if (s_StatisticsPool != VK_NULL_HANDLE)
+	{
+		s_StatisticsTrack = Profiler_RegisterTrack("GPU statistics");
+	}
+
+	printf("Created GPU profiler query pools\n");
+}
+
+void GpuProfiler_Destroy()
+{
+	if (s_TimestampPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(s_Device, s_TimestampPool, NULL);
+		s_TimestampPool = VK_NULL_HANDLE;
+	}
+
+	if (s_StatisticsPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(s_Device, s_StatisticsPool, NULL);
+		s_StatisticsPool = VK_NULL_HANDLE;
+	}
+
+	free(s_Frames);
+	s_Frames = NULL;
+	s_FrameCount = 0;
+
+	Profiler_ReleaseTrack(s_Track);
+	Profiler_ReleaseTrack(s_StatisticsTrack);
+	s_Track = -1;
+	s_StatisticsTrack = -1;
+}
+
+static void CollectFrame(uint32_t frame)
+{
+	struct GpuProfilerFrame *profilerFrame = &s_Frames[frame];
+
+	uint64_t frameStart = Timer_Ticks();
+	if (profilerFrame->scopeCount > 0)
+	{
+		uint64_t timestamps[GPU_PROFILER_QUERIES_PER_FRAME];
+		VkResult result = vkGetQueryPoolResults(s_Device, s_TimestampPool, frame * GPU_PROFILER_QUERIES_PER_FRAME,
+							profilerFrame->scopeCount * 2, sizeof timestamps, timestamps,
+							sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		// the frame's fence has signalled, anything not ready was never submitted
+		if (result == VK_SUCCESS)
+		{
+			frameStart = ToCpuTicks(timestamps[0]);
+			for (uint32_t i = 0; i < profilerFrame->scopeCount; ++i)
+			{
+				Profiler_AddScope(s_Track, profilerFrame->names[i], ToCpuTicks(timestamps[i * 2]),
+						  ToTickDuration(timestamps[i * 2], timestamps[i * 2 + 1]));
+			}
+		}
+	}
+
+	if (profilerFrame->statisticsWritten)
+	{
+		uint64_t statistics[5];
+		VkResult result = vkGetQueryPoolResults(s_Device, s_StatisticsPool, frame, 1, sizeof statistics, statistics,
+							sizeof statistics, VK_QUERY_RESULT_64_BIT);
+		if (result == VK_SUCCESS)
+		{
+			s_LastStatistics = (struct GpuPipelineStatistics){ .inputAssemblyVertices = statistics[0],
+									   .inputAssemblyPrimitives = statistics[1],
+									   .vertexShaderInvocations = statistics[2],
+									   .clippingPrimitives = statistics[3],
+									   .fragmentShaderInvocations = statistics[4] };
+			s_HasStatistics = true;
+
+			Profiler_AddCounter(s_StatisticsTrack, "Input assembly primitives", frameStart, statistics[1]);
+			Profiler_AddCounter(s_StatisticsTrack, "Vertex shader invocations", frameStart, statistics[2]);
+			Profiler_AddCounter(s_StatisticsTrack, "Fragment shader invocations", frameStart, statistics[4]);
+		}
+	}
+}
+
+void GpuProfiler_BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	assert(frame < s_FrameCount);
+
+	s_CurrentFrame = frame;
+
+	if (s_TimestampPool != VK_NULL_HANDLE)
+	{
+		CollectFrame(frame);
+
+		vkCmdResetQueryPool(commandBuffer, s_TimestampPool, frame * GPU_PROFILER_QUERIES_PER_FRAME,
+				    GPU_PROFILER_QUERIES_PER_FRAME);
+	}
+
+	if (s_StatisticsPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, s_StatisticsPool, frame, 1);
+	}
+
+	struct GpuProfilerFrame *profilerFrame = &s_Frames[frame];
+	profilerFrame->scopeCount = 0;
+	profilerFrame->depth = 0;
+	profilerFrame->overflowDepth = 0;
+	profilerFrame->statisticsWritten = false;
+}
+
+void GpuProfiler_ReplayFrame(uint32_t frame)
+{
+	assert(frame < s_FrameCount);
+
+	s_CurrentFrame = frame;
+
+	// the scopes recorded for the slot stay, the replayed command buffer writes the same queries again
+	if (s_TimestampPool != VK_NULL_HANDLE)
+	{
+		CollectFrame(frame);
+	}
+}
+
+void GpuProfiler_BeginScope(VkCommandBuffer commandBuffer, const char *name)
+{
+	if (s_CmdBeginDebugUtilsLabel != NULL)
+	{
+		VkDebugUtilsLabelEXT label = { .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
+					       .pNext = NULL,
+					       .pLabelName = name,
+					       .color = { 0.0f, 0.0f, 0.0f, 0.0f } };
+		s_CmdBeginDebugUtilsLabel(commandBuffer, &label);
+	}
+
+	struct GpuProfilerFrame *profilerFrame = &s_Frames[s_CurrentFrame];
+	if (profilerFrame->depth == GPU_PROFILER_MAX_SCOPES)
+	{
+		++profilerFrame->overflowDepth;
+		return;
+	}
+
+	uint32_t scope = GPU_PROFILER_NO_SCOPE;
+	if (s_TimestampPool != VK_NULL_HANDLE && profilerFrame->scopeCount < GPU_PROFILER_MAX_SCOPES)
+	{
+		scope = profilerFrame->scopeCount++;
+		profilerFrame->names[scope] = name;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, s_TimestampPool,
+				    s_CurrentFrame * GPU_PROFILER_QUERIES_PER_FRAME + scope * 2);
+	}
+
+	profilerFrame->stack[profilerFrame->depth++] = scope;
+}
+
+void GpuProfiler_EndScope(VkCommandBuffer commandBuffer)
+{
+	struct GpuProfilerFrame *profilerFrame = &s_Frames[s_CurrentFrame];
+	if (profilerFrame->overflowDepth > 0)
+	{
+		--profilerFrame->overflowDepth;
+	}
+	else if (profilerFrame->depth > 0)
+	{
+		uint32_t scope = profilerFrame->stack[--profilerFrame->depth];
+		if (scope != GPU_PROFILER_NO_SCOPE)
+		{
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, s_TimestampPool,
+					    s_CurrentFrame * GPU_PROFILER_QUERIES_PER_FRAME + scope * 2 + 1);
+		}
+	}
+
+	if (s_CmdEndDebugUtilsLabel != NULL)
+	{
+		s_CmdEndDebugUtilsLabel(commandBuffer);
+	}
+}
+
+void GpuProfiler_BeginStatistics(VkCommandBuffer commandBuffer)
+{
+	if (s_StatisticsPool == VK_NULL_HANDLE || s_Frames[s_CurrentFrame].statisticsWritten)
+	{
+		return;
+	}
+
+	vkCmdBeginQuery(commandBuffer, s_StatisticsPool, s_CurrentFrame, 0);
+}
+
+void GpuProfiler_EndStatistics(VkCommandBuffer commandBuffer)
+{
+	if (s_StatisticsPool == VK_NULL_HANDLE || s_Frames[s_CurrentFrame].statisticsWritten)
+	{
+		return;
+	}
+
+	vkCmdEndQuery(commandBuffer, s_StatisticsPool, s_CurrentFrame);
+	s_Frames[s_CurrentFrame].statisticsWritten = true;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler_StatisticsFlags()
+{
+	return s_StatisticsPool != VK_NULL_HANDLE ? GPU_PROFILER_STATISTICS : 0;
+}
+
+bool GpuProfiler_GetLastStatistics(struct GpuPipelineStatistics *statistics)
+{
+	if (s_HasStatistics)
+	{
+		*statistics = s_LastStatistics;
+	}
+
+	return s_HasStatistics;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+// timestamp scopes per frame, each uses two queries
+#define GPU_PROFILER_MAX_SCOPES 32
+
+struct GpuPipelineStatistics {
+	uint64_t inputAssemblyVertices;
+	uint64_t inputAssemblyPrimitives;
+	uint64_t vertexShaderInvocations;
+	uint64_t clippingPrimitives;
+	uint64_t fragmentShaderInvocations;
+};
+
+/**
+ * Creates the query pools and lines up GPU timestamps with Timer_Ticks.
+ * Does nothing but label command buffers when the queue family has no timestamps.
+ * @param frameCount number of frames in flight, results of a frame are read back when its slot is reused
+ * @param queue queue the profiled command buffers are submitted to, used once for the clock calibration
+ * @param pipelineStatistics the pipelineStatisticsQuery feature is enabled on the device
+ */
+void GpuProfiler_Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue,
+		      uint32_t queueFamilyIndex, uint32_t frameCount, bool pipelineStatistics);
+void GpuProfiler_Destroy();
+
+/**
+ * Collects the results of the last use of this frame slot and resets its queries.
+ * Call after the frame's fence has signalled, first thing in the command buffer outside a render pass.
+ */
+void GpuProfiler_BeginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+
+/**
+ * Collects the results of the last use of this frame slot, for frames that submit a command buffer recorded in an
+ * earlier frame instead of calling GpuProfiler_BeginFrame. It must have been recorded with the same scopes as the
+ * one recorded for the slot last.
+ */
+void GpuProfiler_ReplayFrame(uint32_t frame);
+
+/**
+ * Timestamps a scope and labels it through VK_EXT_debug_utils so captures in external tools match the trace
+ * @param name string literal, also used as the name in the trace
+ */
+void GpuProfiler_BeginScope(VkCommandBuffer commandBuffer, const char *name);
+void GpuProfiler_EndScope(VkCommandBuffer commandBuffer);
+
+/**
+ * Pipeline statistics for the work in between, at most one range per frame and not nested in itself
+ */
+void GpuProfiler_BeginStatistics(VkCommandBuffer commandBuffer);
+void GpuProfiler_EndStatistics(VkCommandBuffer commandBuffer);
+
+/**
+ * Secondaries executed inside the statistics range inherit the query, which needs the inheritedQueries feature
+ * @return the pipelineStatistics of VkCommandBufferInheritanceInfo, 0 without statistics
+ */
+VkQueryPipelineStatisticFlags GpuProfiler_StatisticsFlags();
+
+/**
+ * @return false if no statistics have been read back yet
+ */
+bool GpuProfiler_GetLastStatistics(struct GpuPipelineStatistics *statistics);
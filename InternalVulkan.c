@@ -17,24 +17,94 @@
 #include "Window.h"
 #include "Timer.h"
 #include "AssetManager.h"
+#include "Vfs.h"
+#include "Profiler.h"
+#include "GpuProfiler.h"
+#include "GpuAllocator.h"
+#include "Upload.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "CommandRecorder.h"
+#include "DrawList.h"
+#include "DescriptorAllocator.h"
+#include "FrameStats.h"
 #include "external/cglm/mat4.h"
-#include "external/cglm/affine.h"
-#include "external/cglm/clipspace/view_rh_zo.h"
+#include "external/cglm/frustum.h"
 #include "external/cglm/clipspace/persp_rh_zo.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "external/stb/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "external/stb/stb_image_write.h"
 
 #define ENGINE_NAME "DUNNO"
 
+#define VERTEX_SHADER_PATH "shaders/quad.glsl.vert.spv"
+#define FRAGMENT_SHADER_PATH "shaders/quad.glsl.frag.spv"
+#define CULL_SHADER_PATH "shaders/cull.glsl.comp.spv"
+
+// local_size_x of the culling shader
+#define CULL_GROUP_SIZE 64
+
+// depth range of the projection, draws are sorted by their distance within it
+#define PROJECTION_NEAR 0.1f
+#define PROJECTION_FAR 100.0f
+
+// relative to the working directory, validated against the device and driver on load
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+// pipelines requested in earlier runs, compiled in the background at startup
+#define PIPELINE_LIST_FILE "pipelines.bin"
+
 #define MAX_FRAMES_IN_FLIGHT 2
 
-struct UniformBufferObject {
+// headless targets are RGBA so read back frames can be written out as is
+#define HEADLESS_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
+// uniform data written per frame in flight, bump allocated and bound through dynamic offsets
+#define UNIFORM_RING_SIZE (1024 * 1024)
+
+// set 0, written once per frame
+struct FrameUniforms {
+	mat4 viewProj;
+	vec4 frustumPlanes[6]; // world space, a point is inside a plane when dot(xyz, point) + w >= 0
+	uint32_t objectCount;
+};
+
+// set 0 binding 1, one per object, read by the culling pass and by the vertex shader through the visible list
+struct InstanceData {
 	mat4 model;
-	mat4 view;
-	mat4 proj;
+	vec4 color;
+	vec4 boundingSphere; // object space center and radius
+	uint32_t batch; // draw command the instance is counted into
+	uint32_t textureSlot; // in the bindless texture array, see AcquireTextureSlot
+	uint32_t padding[2]; // std430 rounds the struct up to its 16 byte alignment
 };
 
+// where a mesh is in the shared vertex and index buffers, and what bounds it
+struct MeshInfo {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	vec4 boundingSphere;
+};
+
+// a batch is the draws sharing a mesh and material, their instances are contiguous in the instance buffer
+#define MAX_DRAW_BATCHES (MESH_COUNT * MATERIAL_COUNT)
+
+// render passes in the order the sort key draws them
+enum DrawPass {
+	DRAW_PASS_MAIN,
+	DRAW_PASS_COUNT
+};
+
+// pipelines a material can be drawn with, see drawPipelines
+enum DrawPipeline {
+	DRAW_PIPELINE_OPAQUE,
+	DRAW_PIPELINE_COUNT
+};
+
+static const enum DrawPipeline materialPipelines[MATERIAL_COUNT] = { [MATERIAL_TEXTURED] = DRAW_PIPELINE_OPAQUE };
+
 struct Vertex {
 	vec3 pos;
 	vec3 color;
@@ -87,13 +157,31 @@ static const struct Vertex vertices[] = {
 
 static const uint16_t indices[] = { 0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4 };
 
+static const struct MeshInfo meshes[MESH_COUNT] = {
+	[MESH_QUAD] = { .indexCount = 6,
+			.firstIndex = 0,
+			.vertexOffset = 0,
+			.boundingSphere = { 0.0f, 0.0f, 0.0f, 0.7072f } },
+	[MESH_QUAD_PAIR] = { .indexCount = 12,
+			     .firstIndex = 0,
+			     .vertexOffset = 0,
+			     .boundingSphere = { 0.0f, 0.0f, -0.25f, 0.75f } }
+};
+
 static VkInstance vulkanInstance;
 static VkPhysicalDevice vulkanPhysicalDevice; // implicitly destroyed when destroying VkInstance
 static VkDevice vulkanDevice;
 static VkQueue vulkanGraphicsQueue; // implicitly cleaned up
 static VkQueue vulkanPresentQueue;
+static VkQueue vulkanTransferQueue; // the graphics queue when there is no dedicated transfer family
+static uint32_t transferQueueFamilies[2]; // graphics and transfer, for resources shared between them
+static bool separateTransferFamily = false;
 static VkSurfaceKHR vulkanSurface;
 
+// renders into offscreen images that stand in for the swapchain images, with no window or surface
+static bool headless = false;
+static struct GpuAllocation *offscreenImageMemory = NULL;
+
 static VkSwapchainKHR vulkanSwapChain;
 static uint32_t swapChainImageCount = 0;
 static VkImage *swapChainImages = NULL;
@@ -101,40 +189,129 @@ static VkFormat swapChainImageFormat;
 static VkExtent2D swapChainExtent;
 
 static VkImage depthImage;
-static VkDeviceMemory depthImageMemory;
+static struct GpuAllocation depthImageMemory;
 static VkImageView depthImageView;
 
 static VkRenderPass vulkanRenderPass;
-static VkDescriptorSetLayout descriptorSetLayout;
+/*
+ * Sets are split by how often they change, so each is only rebound when its contents do:
+ * set 0 per frame, set 1 holds every texture and is bound once, per draw data is read from the frame's instance
+ * buffer, including which texture to sample
+ */
+static VkDescriptorSetLayout frameSetLayout;
+static VkDescriptorSetLayout textureSetLayout;
 static VkPipelineLayout vulkanPipelineLayout;
-static VkPipeline vulkanGraphicsPipeline;
+
+// the pipeline every other one falls back to while compiling, built before the first frame
+static struct PipelineDescription opaquePipeline;
+// indexed by enum DrawPipeline
+static struct PipelineDescription *const drawPipelines[DRAW_PIPELINE_COUNT] = { &opaquePipeline };
+
+// frustum culls the instances into the visible list and the draw commands, set 0 is the frame set
+static VkPipelineLayout cullPipelineLayout;
+static VkPipeline cullPipeline;
 
 static VkImageView *swapChainImageViews = NULL;
 static VkFramebuffer *swapChainFramebuffers = NULL;
 
 static VkCommandPool vulkanCommandPool;
-static VkCommandBuffer *vulkanCommandBuffers;
+
+/*
+ * With command caching, each frame slot keeps a command buffer per swapchain image that is submitted again as is
+ * until something it records changes, per frame data only reaches it through buffers
+ */
+struct CachedCommandBuffer {
+	VkCommandBuffer commandBuffer;
+	uint64_t generation; // commandCacheGeneration when recorded, 0 before the first recording
+	uint32_t batchCount;
+	uint64_t batchStateHash; // the binds between draws follow the batch states
+	uint32_t objectCount;
+	uint32_t uniformOffset;
+	bool fallbackBound; // a pipeline was still compiling, recorded again until every one has been bound
+};
+
+static bool commandCaching = false;
+static VkCommandPool commandCachePool = VK_NULL_HANDLE;
+static struct CachedCommandBuffer *commandCache = NULL; // MAX_FRAMES_IN_FLIGHT * swapChainImageCount
+static uint64_t commandCacheGeneration = 1; // bumped to record every cached command buffer again
 
 static VkSemaphore *imageAvailableSemaphore;
 static VkSemaphore *renderFinishedSemaphore;
 static VkFence *inFlightFence;
 
 static VkBuffer vertexBuffer;
-static VkDeviceMemory vertexBufferMemory;
+static struct GpuAllocation vertexBufferMemory;
 static VkBuffer indexBuffer;
-static VkDeviceMemory indexBufferMemory;
+static struct GpuAllocation indexBufferMemory;
+
+static struct GpuLinearPool uniformRings[MAX_FRAMES_IN_FLIGHT];
+static VkDeviceSize uniformAlignment; // minUniformBufferOffsetAlignment
+
+// FRAME_PACKET_MAX_DRAWS InstanceData per frame in flight, rewritten every frame
+static VkBuffer instanceBuffers[MAX_FRAMES_IN_FLIGHT];
+static struct GpuAllocation instanceBufferMemory[MAX_FRAMES_IN_FLIGHT];
+
+// per frame in flight, set 0 binding 2, instance indices that passed culling, only the GPU touches them
+static VkBuffer visibleBuffers[MAX_FRAMES_IN_FLIGHT];
+static struct GpuAllocation visibleBufferMemory[MAX_FRAMES_IN_FLIGHT];
 
-static VkBuffer *uniformBuffers;
-static VkDeviceMemory *uniformBuffersMemory;
+// per frame in flight, set 0 binding 3, one VkDrawIndexedIndirectCommand per batch, instance counts filled by culling
+static VkBuffer drawCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+static struct GpuAllocation drawCommandMemory[MAX_FRAMES_IN_FLIGHT];
+
+// the current frame's batches and instances, see BuildDrawBatches
+static uint32_t drawBatchCount = 0;
+static uint32_t drawObjectCount = 0;
+static uint64_t drawBatchKeys[MAX_DRAW_BATCHES]; // sort key of each batch's first draw, in draw order
+static uint64_t drawBatchStateHash = 0; // of the batches' DRAW_KEY_STATE in order
+
+// the packet's draws with their sort keys, sorted every frame
+static struct DrawListEntry drawListEntries[FRAME_PACKET_MAX_DRAWS];
+static struct DrawListEntry drawListScratch[FRAME_PACKET_MAX_DRAWS];
 
 static uint32_t mipLevels;
 static VkImage textureImage;
-static VkDeviceMemory textureImageMemory;
+static struct GpuAllocation textureImageMemory;
 static VkImageView textureImageView;
-static VkSampler textureSampler;
+static uint32_t textureSlot; // of textureImageView
+static VkSampler textureSampler; // shared by every texture
+static struct AssetTexture *boundTexture;
+static uint32_t boundTextureGeneration;
+
+/*
+ * Size of the bindless texture array. Slots are written once when a texture is created and freed once the frames
+ * that could sample it retire, so a slot in use is never rewritten. Slot 0 is never handed out, zero means none.
+ */
+#define TEXTURE_SLOT_COUNT 1024
+static uint32_t freeTextureSlots[TEXTURE_SLOT_COUNT];
+static uint32_t freeTextureSlotCount = 0;
+static uint32_t nextTextureSlot = 1;
+// the slot each material samples, written into its draws' instance data every frame
+static uint32_t materialTextureSlots[MATERIAL_COUNT];
+
+// persistent sets from the descriptor allocator, cached command buffers bind them again every frame
+static VkDescriptorSet cachedFrameSets[MAX_FRAMES_IN_FLIGHT];
+// the set the current frame binds, a transient one when its command buffer is recorded every frame
+static VkDescriptorSet frameDescriptorSet;
+static VkDescriptorUpdateTemplate frameSetTemplate; // reads a VkDescriptorBufferInfo per binding
+// update after bind, so textures are added while frames that bind the set are in flight
+static VkDescriptorPool textureDescriptorPool;
+static VkDescriptorSet textureDescriptorSet;
+
+// Resources replaced while frames are in flight are destroyed once those frames retire
+struct DeferredDestruction {
+	uint64_t frame;
+	VkImage image;
+	VkImageView imageView;
+	VkSampler sampler;
+	VkBuffer buffer;
+	struct GpuAllocation memory;
+	uint32_t textureSlot; // released for reuse, 0 for none
+};
 
-static VkDescriptorPool descriptorPool;
-static VkDescriptorSet *descriptorSets;
+static struct DeferredDestruction *deferredDestructions = NULL;
+static uint32_t deferredDestructionCount = 0;
+static uint32_t deferredDestructionCapacity = 0;
 
 static bool framebufferResized = false;
 
@@ -148,12 +325,23 @@ static const char *enabledValidationLayers[] = { "VK_LAYER_KHRONOS_validation" }
 static uint32_t deviceExtensionsCount = 1;
 static const char *deviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+// cleared in headless mode when the layers are not installed, as on most build hosts
+static bool validationLayersEnabled = false;
+
+static bool pipelineStatisticsSupported = false;
+static bool inheritedQueriesSupported = false;
+static bool extendedDynamicStateSupported = false;
+static bool multiDrawIndirectSupported = false;
+static bool samplerAnisotropySupported = false;
+
 static uint32_t currentFrame = 0;
+static uint64_t frameNumber = 0;
 
 struct QueueFamilyIndices {
 	bool isSet;
 	uint32_t graphicsFamily;
 	uint32_t presentFamily;
+	uint32_t transferFamily;
 };
 
 struct SwapChainSupportDetails {
@@ -317,11 +505,32 @@ static bool CheckDeviceExtensionSupport(VkPhysicalDevice device)
 	return deviceExtensionsCount == matchedExtensions;
 }
 
+static bool IsDeviceExtensionSupported(VkPhysicalDevice device, const char *extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
+
+	VkExtensionProperties *availableExtensions = malloc(extensionCount * sizeof(VkExtensionProperties));
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions);
+
+	bool supported = false;
+	for (uint32_t i = 0; i < extensionCount && !supported; ++i)
+	{
+		supported = strcmp(extensionName, availableExtensions[i].extensionName) == 0;
+	}
+
+	free(availableExtensions);
+
+	return supported;
+}
+
 static struct QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device)
 {
 	assert(device != NULL);
 
-	struct QueueFamilyIndices familyIndices = { .graphicsFamily = -1, .presentFamily = -1, .isSet = false };
+	struct QueueFamilyIndices familyIndices = {
+		.graphicsFamily = -1, .presentFamily = -1, .transferFamily = -1, .isSet = false
+	};
 
 	uint32_t queueFamilyCount = 0;
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
@@ -338,17 +547,37 @@ static struct QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device)
 		}
 
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vulkanSurface, &presentSupport);
+		if (headless)
+		{
+			// nothing is presented, the graphics queue stands in for the present queue
+			presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, vulkanSurface, &presentSupport);
+		}
 
 		if (presentSupport)
 		{
 			familyIndices.presentFamily = i;
 			familyIndices.isSet = true;
 		}
+
+		// a family with only transfer maps to the DMA engines, which copy without occupying the graphics queue
+		VkQueueFlags computeOrGraphics = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+		if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & computeOrGraphics))
+		{
+			familyIndices.transferFamily = i;
+		}
 	}
 
 	free(queueFamilies);
 
+	if (familyIndices.transferFamily == (uint32_t)-1)
+	{
+		familyIndices.transferFamily = familyIndices.graphicsFamily;
+	}
+
 	return familyIndices;
 }
 
@@ -429,6 +658,22 @@ static void CreateSwapChain()
 	printf("Created a swap chain\n");
 }
 
+// textures are sampled from one partially bound array indexed per instance, see CreateDescriptorSetLayouts
+static bool SupportsBindlessTextures(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .pNext = NULL
+	};
+	VkPhysicalDeviceFeatures2 features2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+						.pNext = &vulkan12Features };
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+
+	return vulkan12Features.descriptorIndexing && vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+	       vulkan12Features.descriptorBindingPartiallyBound &&
+	       vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+	       vulkan12Features.descriptorBindingUpdateUnusedWhilePending;
+}
+
 static bool IsDeviceSuitable(VkPhysicalDevice device)
 {
 	VkPhysicalDeviceProperties deviceProperties;
@@ -441,6 +686,18 @@ static bool IsDeviceSuitable(VkPhysicalDevice device)
 
 	struct QueueFamilyIndices indices = FindQueueFamilies(device);
 
+	// timeline semaphores and descriptor indexing are core from 1.2 on
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2 || !SupportsBindlessTextures(device))
+	{
+		return false;
+	}
+
+	if (headless)
+	{
+		// anything that can draw will do, including CPU implementations like lavapipe
+		return indices.isSet && deviceFeatures.drawIndirectFirstInstance;
+	}
+
 	bool hasRequiredDeviceExtensions = CheckDeviceExtensionSupport(device);
 
 	bool swapChainAdequate = false;
@@ -455,7 +712,25 @@ static bool IsDeviceSuitable(VkPhysicalDevice device)
 
 	return indices.isSet && deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
 	       deviceFeatures.geometryShader && hasRequiredDeviceExtensions && swapChainAdequate &&
-	       deviceFeatures.samplerAnisotropy;
+	       deviceFeatures.samplerAnisotropy && deviceFeatures.drawIndirectFirstInstance;
+}
+
+// only matters in headless mode, where a CPU implementation is the last resort
+static uint32_t DeviceTypeRank(VkPhysicalDeviceType deviceType)
+{
+	switch (deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		return 4;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		return 3;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		return 2;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU:
+		return 1;
+	default:
+		return 0;
+	}
 }
 
 static void PickPhysicalDevice()
@@ -474,12 +749,23 @@ static void PickPhysicalDevice()
 	VkPhysicalDevice *devices = malloc(deviceCount * sizeof(VkPhysicalDevice));
 	vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, devices);
 
+	uint32_t bestRank = 0;
 	for (uint32_t i = 0; i < deviceCount; ++i)
 	{
 		VkPhysicalDevice device = devices[i];
-		if (IsDeviceSuitable(device))
+		if (!IsDeviceSuitable(device))
+		{
+			continue;
+		}
+
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+		uint32_t rank = DeviceTypeRank(deviceProperties.deviceType);
+		if (rank >= bestRank)
 		{
 			vulkanPhysicalDevice = device;
+			bestRank = rank;
 		}
 	}
 
@@ -490,7 +776,9 @@ static void PickPhysicalDevice()
 		abort();
 	}
 
-	printf("Picked a compatible physical device\n");
+	VkPhysicalDeviceProperties pickedProperties;
+	vkGetPhysicalDeviceProperties(vulkanPhysicalDevice, &pickedProperties);
+	printf("Picked a compatible physical device: %s\n", pickedProperties.deviceName);
 }
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -519,18 +807,29 @@ static void CreateInstanceCreateInfo(VkApplicationInfo *applicationInfo)
 	};
 
 	struct SupportedVulkanExtensions supportedVulkanExtensions;
-	GetVulkanExtensions(&supportedVulkanExtensions);
+	if (headless)
+	{
+		// no surface extensions without a window, leaves room for debug utils
+		supportedVulkanExtensions.names = malloc(sizeof(const char *));
+		supportedVulkanExtensions.count = 0;
+	}
+	else
+	{
+		GetVulkanExtensions(&supportedVulkanExtensions);
+	}
 
-	if (enableValidationLayers)
+	if (validationLayersEnabled)
 	{
 		supportedVulkanExtensions.names[supportedVulkanExtensions.count++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
 	}
 
+	uint32_t layerCount = validationLayersEnabled ? enabledValidationLayerCount : 0;
+
 	VkInstanceCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-					    .pNext = &debugUtilsMessengerCreateInfoExtMessenger,
+					    .pNext = layerCount > 0 ? &debugUtilsMessengerCreateInfoExtMessenger : NULL,
 					    .flags = 0,
 					    .pApplicationInfo = applicationInfo,
-					    .enabledLayerCount = enabledValidationLayerCount,
+					    .enabledLayerCount = layerCount,
 					    .ppEnabledLayerNames = enabledValidationLayers,
 					    .enabledExtensionCount = supportedVulkanExtensions.count,
 					    .ppEnabledExtensionNames = supportedVulkanExtensions.names };
@@ -580,7 +879,7 @@ static bool CheckValidationLayerSupport()
 		for (int j = 0; j < validationLayerPropertyCount; ++j)
 		{
 			VkLayerProperties layerProperty = layerProperties[j];
-			if (strcmp(layerName, layerProperty.layerName) != 0)
+			if (strcmp(layerName, layerProperty.layerName) == 0)
 			{
 				layerFound = true;
 				break;
@@ -589,6 +888,7 @@ static bool CheckValidationLayerSupport()
 
 		if (!layerFound)
 		{
+			free(layerProperties);
 			return false;
 		}
 	}
@@ -657,22 +957,86 @@ static void CreateLogicalDevice()
 								  .queueCount = 1,
 								  .pQueuePriorities = &queuePriority };
 
-	struct VkPhysicalDeviceFeatures deviceFeatures = { .samplerAnisotropy = VK_TRUE };
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(vulkanPhysicalDevice, &supportedFeatures);
+	pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+	inheritedQueriesSupported = supportedFeatures.inheritedQueries == VK_TRUE;
+	samplerAnisotropySupported = supportedFeatures.samplerAnisotropy == VK_TRUE;
+	multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+	// the culling pass starts every batch's draw command at its first visible instance
+	struct VkPhysicalDeviceFeatures deviceFeatures = {
+		.samplerAnisotropy = supportedFeatures.samplerAnisotropy,
+		.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery,
+		.inheritedQueries = supportedFeatures.inheritedQueries,
+		.multiDrawIndirect = supportedFeatures.multiDrawIndirect,
+		.drawIndirectFirstInstance = VK_TRUE
+	};
+
+	struct VkDeviceQueueCreateInfo queueCreateInfos[3] = { graphicsQueueCreateInfo, presentQueueCreateInfo };
+
+	// a queue family may only be listed once
+	uint32_t queueCreateInfoCount = indices.graphicsFamily != indices.presentFamily ? 2 : 1;
+
+	// a transfer only family can't also support graphics or present, so it is never listed already
+	separateTransferFamily = indices.transferFamily != indices.graphicsFamily;
+	if (separateTransferFamily)
+	{
+		queueCreateInfos[queueCreateInfoCount] = graphicsQueueCreateInfo;
+		queueCreateInfos[queueCreateInfoCount].queueFamilyIndex = indices.transferFamily;
+		queueCreateInfoCount++;
+	}
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features = { .sType =
+								      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+							      .pNext = NULL,
+							      .descriptorIndexing = VK_TRUE,
+							      .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+							      .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+							      .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+							      .descriptorBindingPartiallyBound = VK_TRUE,
+							      .timelineSemaphore = VK_TRUE };
+
+	const char *enabledExtensions[2];
+	uint32_t enabledExtensionCount = 0;
+	for (uint32_t i = 0; i < deviceExtensionsCount && !headless; ++i)
+	{
+		enabledExtensions[enabledExtensionCount++] = deviceExtensions[i];
+	}
+
+	// optional, with cull and depth state set while recording they no longer multiply the pipelines
+	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+		.pNext = NULL,
+		.extendedDynamicState = VK_FALSE
+	};
+
+	if (IsDeviceExtensionSupported(vulkanPhysicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 features2 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+							.pNext = &extendedDynamicStateFeatures };
+		vkGetPhysicalDeviceFeatures2(vulkanPhysicalDevice, &features2);
+	}
 
-	struct VkDeviceQueueCreateInfo queueCreateInfos[2] = { graphicsQueueCreateInfo, presentQueueCreateInfo };
+	extendedDynamicStateSupported = extendedDynamicStateFeatures.extendedDynamicState == VK_TRUE;
+	if (extendedDynamicStateSupported)
+	{
+		enabledExtensions[enabledExtensionCount++] = VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME;
+		vulkan12Features.pNext = &extendedDynamicStateFeatures;
+	}
 
 	struct VkDeviceCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-						 .pNext = NULL,
+						 .pNext = &vulkan12Features,
 						 .flags = 0,
-						 .queueCreateInfoCount = 2,
+						 .queueCreateInfoCount = queueCreateInfoCount,
 						 .pQueueCreateInfos = queueCreateInfos,
 						 .enabledLayerCount = 0,
 						 .ppEnabledLayerNames = NULL,
-						 .enabledExtensionCount = deviceExtensionsCount,
-						 .ppEnabledExtensionNames = deviceExtensions,
+						 .enabledExtensionCount = enabledExtensionCount,
+						 .ppEnabledExtensionNames = enabledExtensions,
 						 .pEnabledFeatures = &deviceFeatures };
 
-	if (enableValidationLayers)
+	if (validationLayersEnabled)
 	{
 		createInfo.enabledLayerCount = enabledValidationLayerCount;
 		createInfo.ppEnabledLayerNames = enabledValidationLayers;
@@ -691,8 +1055,16 @@ static void CreateLogicalDevice()
 
 	vkGetDeviceQueue(vulkanDevice, indices.graphicsFamily, 0, &vulkanGraphicsQueue);
 	vkGetDeviceQueue(vulkanDevice, indices.presentFamily, 0, &vulkanPresentQueue);
+	vkGetDeviceQueue(vulkanDevice, indices.transferFamily, 0, &vulkanTransferQueue);
+
+	transferQueueFamilies[0] = indices.graphicsFamily;
+	transferQueueFamilies[1] = indices.transferFamily;
 
 	printf("Created a logical device and created graphics queue and present queue\n");
+	if (separateTransferFamily)
+	{
+		printf("Uploading on dedicated transfer queue family %u\n", indices.transferFamily);
+	}
 }
 
 static void CreateSurface()
@@ -738,234 +1110,123 @@ static void CreateImageViews()
 	printf("Created a set of image views\n");
 }
 
-static VkShaderModule CreateShaderModule(const char *byteCode, uint64_t size)
+static void CreatePipelineLayout()
 {
-	VkShaderModuleCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-						.pNext = NULL,
-						.codeSize = size,
-						.flags = 0,
-						.pCode = (const uint32_t *)byteCode };
+	VkDescriptorSetLayout setLayouts[] = { frameSetLayout, textureSetLayout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+							  .pNext = NULL,
+							  .flags = 0,
+							  .setLayoutCount = 2,
+							  .pSetLayouts = setLayouts,
+							  .pushConstantRangeCount = 0,
+							  .pPushConstantRanges = NULL };
 
-	VkShaderModule shaderModule;
-	VkResult result = vkCreateShaderModule(vulkanDevice, &createInfo, NULL, &shaderModule);
+	VkResult result = vkCreatePipelineLayout(vulkanDevice, &pipelineLayoutInfo, NULL, &vulkanPipelineLayout);
 	if (result != VK_SUCCESS)
 	{
-		printf("Could not create shadermodule\n");
+		printf("Could not create pipeline layout\n");
 		abort();
 	}
-
-	free(byteCode);
-
-	return shaderModule;
 }
 
-void CreateGraphicsPipeline()
+static void CreateCullPipeline()
 {
-	uint64_t vertShaderFileSize = 0;
-	const char *vertShaderCode = ReadBytes("shaders/quad.glsl.vert.spv", &vertShaderFileSize);
-	if (vertShaderCode == NULL)
+	VkPipelineLayoutCreateInfo layoutInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+						  .pNext = NULL,
+						  .flags = 0,
+						  .setLayoutCount = 1,
+						  .pSetLayouts = &frameSetLayout,
+						  .pushConstantRangeCount = 0,
+						  .pPushConstantRanges = NULL };
+
+	if (vkCreatePipelineLayout(vulkanDevice, &layoutInfo, NULL, &cullPipelineLayout) != VK_SUCCESS)
 	{
+		printf("Could not create culling pipeline layout\n");
 		abort();
 	}
 
-	//WriteBytes("shaders/quad.vert.write.spv", vertShaderCode, vertShaderFileSize);
-
-	uint64_t fragShaderFileSize = 0;
-	const char *fragShaderCode = ReadBytes("shaders/quad.glsl.frag.spv", &fragShaderFileSize);
-	if (fragShaderCode == NULL)
+	struct VfsView code;
+	if (!Vfs_Open(CULL_SHADER_PATH, &code))
 	{
+		printf("Could not open %s\n", CULL_SHADER_PATH);
 		abort();
 	}
 
-	//WriteBytes("shaders/quad.glsl.vert.frag.write.spv", fragShaderCode, fragShaderFileSize);
-
-	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode, vertShaderFileSize);
-	VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode, fragShaderFileSize);
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.stage = VK_SHADER_STAGE_VERTEX_BIT,
-		.module = vertShaderModule,
-		.pName = "main",
-		.pSpecializationInfo = NULL
-	};
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-		.module = fragShaderModule,
-		.pName = "main",
-		.pSpecializationInfo = NULL
-	};
-
-	VkPipelineShaderStageCreateInfo shaderStages[2] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	// for dynamic viewport and scissor setup
-	VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-
-	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.dynamicStateCount = 2,
-		.pDynamicStates = dynamicStates
-	};
-
-	struct VkVertexInputBindingDescription bindingDescription = GetVertexBindingDescription();
-
-	const struct VkVertexInputAttributeDescription *attributeDescription = GetAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &bindingDescription,
-		.vertexAttributeDescriptionCount = 3,
-		.pVertexAttributeDescriptions = attributeDescription
-	};
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.primitiveRestartEnable = VK_FALSE
-	};
-
-	VkViewport viewport = { .x = 0,
-				.y = 0,
-				.width = (float)swapChainExtent.width,
-				.height = (float)swapChainExtent.height,
-				.minDepth = 0.0f,
-				.maxDepth = 1.0f };
-
-	VkRect2D scissor = { .offset = { .x = 0, .y = 0 }, .extent = swapChainExtent };
-
-	VkPipelineViewportStateCreateInfo viewportState = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.viewportCount = 1,
-		.pViewports = NULL,
-		.scissorCount = 1,
-		.pScissors = NULL
-	};
-
-	VkPipelineRasterizationStateCreateInfo rasterizer = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.depthClampEnable = VK_FALSE,
-		.rasterizerDiscardEnable = VK_FALSE,
-		.polygonMode = VK_POLYGON_MODE_FILL,
-		.lineWidth = 1.0f,
-		.cullMode = VK_CULL_MODE_BACK_BIT,
-		.frontFace = VK_FRONT_FACE_CLOCKWISE,
-		.depthBiasEnable = VK_FALSE,
-		.depthBiasConstantFactor = 0.0f,
-		.depthBiasClamp = 0.0f,
-		.depthBiasSlopeFactor = 0.0f
-	};
-
-	VkPipelineMultisampleStateCreateInfo multisampling = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-		.sampleShadingEnable = VK_FALSE,
-		.minSampleShading = 1.0f,
-		.pSampleMask = NULL,
-		.alphaToCoverageEnable = VK_FALSE,
-		.alphaToOneEnable = VK_FALSE
-	};
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = { .blendEnable = VK_FALSE,
-								     /*.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-								     .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-								     .colorBlendOp = VK_BLEND_OP_ADD,
-								     .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-								     .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-								     .alphaBlendOp = VK_BLEND_OP_ADD,*/
-								     .colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-										       VK_COLOR_COMPONENT_G_BIT |
-										       VK_COLOR_COMPONENT_B_BIT |
-										       VK_COLOR_COMPONENT_A_BIT };
-
-	VkPipelineColorBlendStateCreateInfo colorBlending = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.logicOpEnable = VK_FALSE,
-		.logicOp = VK_LOGIC_OP_COPY,
-		.attachmentCount = 1,
-		.pAttachments = &colorBlendAttachment,
-		.blendConstants = { 0.0f, 0.0f, 0.0f, 0.0f }
-	};
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-							  .pNext = NULL,
-							  .flags = 0,
-							  .setLayoutCount = 1,
-							  .pSetLayouts = &descriptorSetLayout,
-							  .pushConstantRangeCount = 0,
-							  .pPushConstantRanges = NULL };
+	VkShaderModuleCreateInfo moduleInfo = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+						.pNext = NULL,
+						.flags = 0,
+						.codeSize = code.size,
+						.pCode = code.data };
 
-	VkResult result = vkCreatePipelineLayout(vulkanDevice, &pipelineLayoutInfo, NULL, &vulkanPipelineLayout);
+	VkShaderModule module;
+	VkResult result = vkCreateShaderModule(vulkanDevice, &moduleInfo, NULL, &module);
+	Vfs_Close(&code);
 	if (result != VK_SUCCESS)
 	{
-		printf("Could not create pipeline layout\n");
+		printf("Could not create shadermodule for %s\n", CULL_SHADER_PATH);
 		abort();
 	}
 
-	VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.depthTestEnable = VK_TRUE,
-		.depthWriteEnable = VK_TRUE,
-		.depthCompareOp = VK_COMPARE_OP_LESS,
-		.depthBoundsTestEnable = VK_FALSE,
-		.minDepthBounds = 0.0f,
-		.maxDepthBounds = 1.0f,
-		.stencilTestEnable = VK_FALSE
-	};
+	VkPipelineShaderStageCreateInfo stageInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+						      .pNext = NULL,
+						      .flags = 0,
+						      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+						      .module = module,
+						      .pName = "main",
+						      .pSpecializationInfo = NULL };
 
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-							    .pNext = NULL,
-							    .flags = 0,
-							    .stageCount = 2,
-							    .pStages = shaderStages,
-							    .pVertexInputState = &vertexInputInfo,
-							    .pInputAssemblyState = &inputAssembly,
-							    .pViewportState = &viewportState,
-							    .pRasterizationState = &rasterizer,
-							    .pMultisampleState = &multisampling,
-							    .pDepthStencilState = &depthStencilStateCreateInfo,
-							    .pColorBlendState = &colorBlending,
-							    .pDynamicState = &dynamicStateCreateInfo,
-							    .layout = vulkanPipelineLayout,
-							    .renderPass = vulkanRenderPass,
-							    .subpass = 0,
-							    .basePipelineHandle = NULL,
-							    .basePipelineIndex = -1 };
-
-	VkResult pipelineResult =
-		vkCreateGraphicsPipelines(vulkanDevice, NULL, 1, &pipelineCreateInfo, NULL, &vulkanGraphicsPipeline);
-	if (pipelineResult != VK_SUCCESS)
-	{
-		printf("Could not create graphics pipeline\n");
+	VkComputePipelineCreateInfo pipelineInfo = { .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+						     .pNext = NULL,
+						     .flags = 0,
+						     .stage = stageInfo,
+						     .layout = cullPipelineLayout,
+						     .basePipelineHandle = VK_NULL_HANDLE,
+						     .basePipelineIndex = -1 };
+
+	result = vkCreateComputePipelines(vulkanDevice, PipelineCache_Get(), 1, &pipelineInfo, NULL, &cullPipeline);
+	vkDestroyShaderModule(vulkanDevice, module, NULL);
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not create culling pipeline\n");
 		abort();
 	}
 
-	vkDestroyShaderModule(vulkanDevice, vertShaderModule, NULL);
-	vkDestroyShaderModule(vulkanDevice, fragShaderModule, NULL);
+	printf("Created culling pipeline\n");
+}
 
-	free(attributeDescription);
+static void CreatePipelineLibrary()
+{
+	const VkVertexInputAttributeDescription *attributeDescriptions = GetAttributeDescriptions();
+	struct PipelineVertexLayout vertexLayout = { .binding = GetVertexBindingDescription(),
+						     .attributes = attributeDescriptions,
+						     .attributeCount = 3 };
+
+	struct PipelinePassFormats passFormats = { .colorFormat = swapChainImageFormat,
+						   .depthFormat = FindDepthFormat(),
+						   .samples = VK_SAMPLE_COUNT_1_BIT };
+
+	PipelineLibrary_Init(vulkanDevice, vulkanPipelineLayout, vulkanRenderPass, &passFormats, &vertexLayout, 1,
+			     extendedDynamicStateSupported, PIPELINE_LIST_FILE);
+	free(attributeDescriptions);
+
+	memset(&opaquePipeline, 0, sizeof opaquePipeline);
+	strcpy(opaquePipeline.vertexShader, VERTEX_SHADER_PATH);
+	strcpy(opaquePipeline.fragmentShader, FRAGMENT_SHADER_PATH);
+	opaquePipeline.vertexLayout = 0;
+	opaquePipeline.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	opaquePipeline.polygonMode = VK_POLYGON_MODE_FILL;
+	opaquePipeline.blendMode = PIPELINE_BLEND_OPAQUE;
+	opaquePipeline.colorFormat = passFormats.colorFormat;
+	opaquePipeline.depthFormat = passFormats.depthFormat;
+	opaquePipeline.samples = passFormats.samples;
+	opaquePipeline.cullMode = VK_CULL_MODE_BACK_BIT;
+	opaquePipeline.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	opaquePipeline.depthTest = VK_TRUE;
+	opaquePipeline.depthWrite = VK_TRUE;
+	opaquePipeline.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	PipelineLibrary_Wait(&opaquePipeline);
 
 	printf("Created a graphics pipeline\n");
 }
@@ -980,7 +1241,8 @@ static void CreateRenderPass()
 						    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 						    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 						    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-						    .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+						    .finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+									    : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
 
 	VkAttachmentReference colorAttachmentRef = { .attachment = 0,
 						     .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
@@ -1098,23 +1360,70 @@ static void CreateCommandPool()
 	printf("Created a command pool\n");
 }
 
-static void CreateCommandBuffers()
+static void CreateCommandCache()
 {
-	vulkanCommandBuffers = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkCommandBuffer));
+	if (!commandCaching)
+	{
+		return;
+	}
+
+	struct QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(vulkanPhysicalDevice);
+
+	VkCommandPoolCreateInfo commandPoolCreateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+							  .pNext = NULL,
+							  .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+							  .queueFamilyIndex = queueFamilyIndices.graphicsFamily };
+
+	if (vkCreateCommandPool(vulkanDevice, &commandPoolCreateInfo, NULL, &commandCachePool) != VK_SUCCESS)
+	{
+		printf("Could not create command cache pool\n");
+		abort();
+	}
+
+	uint32_t count = MAX_FRAMES_IN_FLIGHT * swapChainImageCount;
+	VkCommandBuffer *commandBuffers = malloc(count * sizeof(VkCommandBuffer));
+	commandCache = calloc(count, sizeof(struct CachedCommandBuffer));
+	if (commandBuffers == NULL || commandCache == NULL)
+	{
+		printf("Could not allocate the command cache\n");
+		abort();
+	}
+
 	VkCommandBufferAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 						     .pNext = NULL,
-						     .commandPool = vulkanCommandPool,
+						     .commandPool = commandCachePool,
 						     .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-						     .commandBufferCount = MAX_FRAMES_IN_FLIGHT };
+						     .commandBufferCount = count };
 
-	VkResult result = vkAllocateCommandBuffers(vulkanDevice, &allocateInfo, vulkanCommandBuffers);
-	if (result != VK_SUCCESS)
+	if (vkAllocateCommandBuffers(vulkanDevice, &allocateInfo, commandBuffers) != VK_SUCCESS)
 	{
-		printf("Could not create command buffer\n");
+		printf("Could not allocate cached command buffers\n");
 		abort();
 	}
 
-	printf("Created a command buffer\n");
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		commandCache[i].commandBuffer = commandBuffers[i];
+	}
+
+	free(commandBuffers);
+
+	printf("Created %u cached command buffers\n", count);
+}
+
+static void DestroyCommandCache()
+{
+	if (commandCachePool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// destroying the pool frees its command buffers
+	vkDestroyCommandPool(vulkanDevice, commandCachePool, NULL);
+	commandCachePool = VK_NULL_HANDLE;
+
+	free(commandCache);
+	commandCache = NULL;
 }
 
 static void CreateSyncObjects()
@@ -1160,36 +1469,35 @@ static void CreateSyncObjects()
 	printf("Created sync objects\n");
 }
 
-static void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
-{
-	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-					       .pNext = NULL,
-					       .flags = 0,
-					       .pInheritanceInfo = NULL };
+// what every slice of the batch list is recorded with, read from the recording threads
+struct DrawRecordContext {
+	VkBuffer drawCommands;
+	VkDescriptorSet frameSet;
+	VkDescriptorSet textureSet;
+	uint32_t uniformOffset;
+	bool *fallbackBound; // set when a pipeline still compiling is drawn with its fallback, NULL if not tracked
+};
 
-	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-	if (result != VK_SUCCESS)
+// the draw commands of batches [first, first + count), which share their binds
+static void RecordIndirectDraws(VkCommandBuffer commandBuffer, VkBuffer drawCommands, uint32_t first, uint32_t count)
+{
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (multiDrawIndirectSupported)
 	{
-		printf("Could not begin command buffer\n");
-		abort();
+		vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, (VkDeviceSize)first * stride, count, stride);
 	}
+	else
+	{
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, (VkDeviceSize)i * stride, 1, stride);
+		}
+	}
+}
 
-	VkClearValue clearValues[] = {
-		{ .color = { 0.9f, 0.25f, 0.6f, 1.0f } },
-		{ 1.0f, 0.0f }
-	};
-
-	VkRenderPassBeginInfo renderPassBeginInfo = { .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-						      .pNext = NULL,
-						      .renderPass = vulkanRenderPass,
-						      .framebuffer = swapChainFramebuffers[imageIndex],
-						      .renderArea = { .extent = swapChainExtent,
-								      .offset = { .x = 0, .y = 0 } },
-						      .clearValueCount = 2,
-						      .pClearValues = clearValues };
-
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanGraphicsPipeline);
+static void RecordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, void *userData)
+{
+	const struct DrawRecordContext *context = userData;
 
 	VkBuffer vertexBuffers[] = { vertexBuffer };
 	VkDeviceSize offsets[] = { 0 };
@@ -1208,24 +1516,174 @@ static void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageInd
 	VkRect2D scissor = { .offset = { .x = 0, .y = 0 }, .extent = swapChainExtent };
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 1,
-				&descriptorSets[currentFrame], 0, NULL);
+	// every texture is in the one set, the instance data says which one a draw samples
+	VkDescriptorSet descriptorSets[] = { context->frameSet, context->textureSet };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanPipelineLayout, 0, 2,
+				descriptorSets, 1, &context->uniformOffset);
 
-	vkCmdDrawIndexed(commandBuffer, 12, 1, 0, 0, 0);
-	vkCmdEndRenderPass(commandBuffer);
-	VkResult endCommandBufferResult = vkEndCommandBuffer(commandBuffer);
-	if (endCommandBufferResult != VK_SUCCESS)
-	{
-		printf("Failed to endcommandbuffer\n");
+	/*
+	 * The batches are sorted by pipeline, so each is bound only where the sort key's pipeline bits change, and the
+	 * runs of batches between binds are one indirect draw whatever their materials. The culling pass has counted
+	 * the visible instances into the draw commands, so nothing recorded depends on what is visible or on the batch
+	 * contents.
+	 */
+	uint32_t boundPipeline = UINT32_MAX;
+	uint32_t runStart = first;
+	for (uint32_t batch = first; batch < first + count; ++batch)
+	{
+		uint32_t pipeline = DrawList_KeyPipeline(drawBatchKeys[batch]);
+		if (pipeline == boundPipeline)
+		{
+			continue;
+		}
+
+		if (batch > runStart)
+		{
+			RecordIndirectDraws(commandBuffer, context->drawCommands, runStart, batch - runStart);
+			runStart = batch;
+		}
+
+		if (!PipelineLibrary_Bind(commandBuffer, drawPipelines[pipeline], &opaquePipeline) &&
+		    context->fallbackBound != NULL)
+		{
+			*context->fallbackBound = true;
+		}
+		boundPipeline = pipeline;
+	}
+
+	if (first + count > runStart)
+	{
+		RecordIndirectDraws(commandBuffer, context->drawCommands, runStart, first + count - runStart);
+	}
+}
+
+// outside the render pass, the draw commands and visible lists are written before the pass reads them
+static void RecordCulling(VkCommandBuffer commandBuffer, uint32_t uniformOffset)
+{
+	GpuProfiler_BeginScope(commandBuffer, "Culling");
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1,
+				&frameDescriptorSet, 1, &uniformOffset);
+	vkCmdDispatch(commandBuffer, (drawObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier barrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				    .pNext = NULL,
+				    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				    .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier,
+			     0, NULL, 0, NULL);
+
+	GpuProfiler_EndScope(commandBuffer);
+}
+
+/**
+ * @param parallel record the draws into secondaries on the recorder threads, otherwise inline into a command buffer
+ * that may be submitted again
+ * @return false if a pipeline still compiling was recorded with its fallback, only tracked when recorded inline
+ */
+static bool RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t uniformOffset,
+				bool parallel)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					       .pNext = NULL,
+					       .flags = parallel ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0,
+					       .pInheritanceInfo = NULL };
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not begin command buffer\n");
+		abort();
+	}
+
+	VkClearValue clearValues[] = {
+		{ .color = { 0.9f, 0.25f, 0.6f, 1.0f } },
+		{ 1.0f, 0.0f }
+	};
+
+	VkRenderPassBeginInfo renderPassBeginInfo = { .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+						      .pNext = NULL,
+						      .renderPass = vulkanRenderPass,
+						      .framebuffer = swapChainFramebuffers[imageIndex],
+						      .renderArea = { .extent = swapChainExtent,
+								      .offset = { .x = 0, .y = 0 } },
+						      .clearValueCount = 2,
+						      .pClearValues = clearValues };
+
+	GpuProfiler_BeginFrame(commandBuffer, currentFrame);
+	GpuProfiler_BeginScope(commandBuffer, "Frame");
+	RecordCulling(commandBuffer, uniformOffset);
+
+	// secondaries may only be executed inside the statistics query when they inherit it
+	bool statistics = !parallel || inheritedQueriesSupported;
+	if (statistics)
+	{
+		GpuProfiler_BeginStatistics(commandBuffer);
+	}
+
+	// the recorder threads would all write the flag, secondaries are recorded every frame anyway
+	bool fallbackBound = false;
+	struct DrawRecordContext context = { .drawCommands = drawCommandBuffers[currentFrame],
+					     .frameSet = frameDescriptorSet,
+					     .textureSet = textureDescriptorSet,
+					     .uniformOffset = uniformOffset,
+					     .fallbackBound = parallel ? NULL : &fallbackBound };
+
+	// the pass either executes secondaries or is recorded inline, no scope is timed inside it either way
+	GpuProfiler_BeginScope(commandBuffer, "MainPass");
+	if (!parallel)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		RecordDraws(commandBuffer, 0, drawBatchCount, &context);
+	}
+	else
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+				     VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			.pNext = NULL,
+			.renderPass = vulkanRenderPass,
+			.subpass = 0,
+			.framebuffer = swapChainFramebuffers[imageIndex],
+			.occlusionQueryEnable = VK_FALSE,
+			.queryFlags = 0,
+			.pipelineStatistics = statistics ? GpuProfiler_StatisticsFlags() : 0
+		};
+		CommandRecorder_RecordParallel(commandBuffer, &inheritanceInfo, drawBatchCount, RecordDraws,
+					       &context);
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+	GpuProfiler_EndScope(commandBuffer);
+
+	if (statistics)
+	{
+		GpuProfiler_EndStatistics(commandBuffer);
+	}
+	GpuProfiler_EndScope(commandBuffer);
+
+	VkResult endCommandBufferResult = vkEndCommandBuffer(commandBuffer);
+	if (endCommandBufferResult != VK_SUCCESS)
+	{
+		printf("Failed to endcommandbuffer\n");
 		abort();
 	}
+
+	PROFILE_END();
+	return !fallbackBound;
 }
 
 static void CleanupSwapChain()
 {
 	vkDestroyImageView(vulkanDevice, depthImageView, NULL);
 	vkDestroyImage(vulkanDevice, depthImage, NULL);
-	vkFreeMemory(vulkanDevice, depthImageMemory, NULL);
+	GpuAllocator_Free(&depthImageMemory);
 
 	for (uint32_t i = 0; i < swapChainImageCount; ++i)
 	{
@@ -1236,94 +1694,293 @@ static void CleanupSwapChain()
 		vkDestroyImageView(vulkanDevice, swapChainImageView, NULL);
 	}
 
-	vkDestroySwapchainKHR(vulkanDevice, vulkanSwapChain, NULL);
+	if (headless)
+	{
+		for (uint32_t i = 0; i < swapChainImageCount; ++i)
+		{
+			vkDestroyImage(vulkanDevice, swapChainImages[i], NULL);
+			GpuAllocator_Free(&offscreenImageMemory[i]);
+		}
+
+		free(offscreenImageMemory);
+		offscreenImageMemory = NULL;
+	}
+	else
+	{
+		vkDestroySwapchainKHR(vulkanDevice, vulkanSwapChain, NULL);
+	}
 }
 
-static void UpdateUniformBuffer(uint32_t currentImage)
+static void DeferDestruction(struct DeferredDestruction destruction)
 {
-	double currentTime = Timer_Now();
+	if (deferredDestructionCount == deferredDestructionCapacity)
+	{
+		uint32_t capacity = deferredDestructionCapacity == 0 ? 16 : deferredDestructionCapacity * 2;
+		struct DeferredDestruction *grown =
+			realloc(deferredDestructions, capacity * sizeof(struct DeferredDestruction));
+		if (grown == NULL)
+		{
+			printf("Could not grow the deferred destruction queue\n");
+			abort();
+		}
 
-	struct UniformBufferObject ubo;
-	glm_mat4_identity(ubo.model);
-	glm_mat4_identity(ubo.view);
-	glm_mat4_identity(ubo.proj);
+		deferredDestructions = grown;
+		deferredDestructionCapacity = capacity;
+	}
 
-	vec3 axis = { 0.0f, 0.0f, 1.0f };
-	glm_rotate(ubo.model, (float)currentTime * glm_rad(90.0f), axis);
+	destruction.frame = frameNumber;
+	deferredDestructions[deferredDestructionCount++] = destruction;
+}
 
-	vec3 eye = { 0.0f, 2.0f, 2.0f };
-	vec3 center = { 0.0f, 0.0f, 0.0f };
-	vec3 up = { 0.0f, 1.0f, 0.0f };
-	glm_lookat_rh_zo(eye, center, up, ubo.view);
+/*
+ * Called after waiting for the current frame's fence. Anything queued MAX_FRAMES_IN_FLIGHT
+ * frames ago can no longer be referenced by a pending command buffer.
+ */
+static void FlushDeferredDestructions(bool force)
+{
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < deferredDestructionCount; ++i)
+	{
+		struct DeferredDestruction destruction = deferredDestructions[i];
+		if (!force && frameNumber < destruction.frame + MAX_FRAMES_IN_FLIGHT)
+		{
+			deferredDestructions[kept++] = destruction;
+			continue;
+		}
 
-	glm_perspective_rh_zo(glm_rad(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f,
-			      100.0f, ubo.proj);
+		vkDestroySampler(vulkanDevice, destruction.sampler, NULL);
+		vkDestroyImageView(vulkanDevice, destruction.imageView, NULL);
+		vkDestroyImage(vulkanDevice, destruction.image, NULL);
+		vkDestroyBuffer(vulkanDevice, destruction.buffer, NULL);
+		GpuAllocator_Free(&destruction.memory);
+		if (destruction.textureSlot != 0)
+		{
+			freeTextureSlots[freeTextureSlotCount++] = destruction.textureSlot;
+		}
+	}
 
-	void *data;
-	vkMapMemory(vulkanDevice, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(vulkanDevice, uniformBuffersMemory[currentImage]);
+	deferredDestructionCount = kept;
 }
 
-void DrawFrame()
+// the buffers never change, so a persistent set is written once and the dynamic offset selects the frame's uniforms
+static void WriteFrameDescriptorSet(VkDescriptorSet set, uint32_t frame)
 {
-	vkWaitForFences(vulkanDevice, 1, &inFlightFence[currentFrame], VK_TRUE, UINT64_MAX);
+	VkDescriptorBufferInfo bufferInfos[] = {
+		{ .buffer = uniformRings[frame].buffer, .offset = 0, .range = sizeof(struct FrameUniforms) },
+		{ .buffer = instanceBuffers[frame], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = visibleBuffers[frame], .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = drawCommandBuffers[frame], .offset = 0, .range = VK_WHOLE_SIZE }
+	};
+
+	vkUpdateDescriptorSetWithTemplate(vulkanDevice, set, frameSetTemplate, bufferInfos);
+}
+
+/**
+ * Nothing needs recording again, the set is update after bind and the slot is not used by any pending frame
+ * @param slot see AcquireTextureSlot
+ */
+static void WriteTextureDescriptor(uint32_t slot, VkImageView imageView)
+{
+	VkDescriptorImageInfo imageInfo = { .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					    .imageView = imageView,
+					    .sampler = VK_NULL_HANDLE };
+
+	VkWriteDescriptorSet descriptorWrite = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+						 .pNext = NULL,
+						 .dstSet = textureDescriptorSet,
+						 .dstBinding = 1,
+						 .dstArrayElement = slot,
+						 .descriptorCount = 1,
+						 .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+						 .pImageInfo = &imageInfo,
+						 .pBufferInfo = NULL,
+						 .pTexelBufferView = NULL };
+
+	vkUpdateDescriptorSets(vulkanDevice, 1, &descriptorWrite, 0, NULL);
+}
 
-	uint32_t imageIndex;
-	VkResult acquireResult = vkAcquireNextImageKHR(vulkanDevice, vulkanSwapChain, UINT64_MAX,
-						       imageAvailableSemaphore[currentFrame], NULL, &imageIndex);
+static void WriteTextureSamplerDescriptor()
+{
+	VkDescriptorImageInfo imageInfo = { .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					    .imageView = VK_NULL_HANDLE,
+					    .sampler = textureSampler };
 
-	if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR || acquireResult == VK_SUBOPTIMAL_KHR)
+	VkWriteDescriptorSet descriptorWrite = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+						 .pNext = NULL,
+						 .dstSet = textureDescriptorSet,
+						 .dstBinding = 0,
+						 .dstArrayElement = 0,
+						 .descriptorCount = 1,
+						 .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+						 .pImageInfo = &imageInfo,
+						 .pBufferInfo = NULL,
+						 .pTexelBufferView = NULL };
+
+	vkUpdateDescriptorSets(vulkanDevice, 1, &descriptorWrite, 0, NULL);
+}
+
+/**
+ * Bump allocates from the current frame's uniform ring, which is reset once its fence has signalled
+ * @param dynamicOffset receives the offset to bind the set with
+ * @return mapped memory to write the uniforms into
+ */
+static void *AllocateUniforms(VkDeviceSize size, uint32_t *dynamicOffset)
+{
+	VkDeviceSize offset;
+	void *data = GpuLinearPool_Allocate(&uniformRings[currentFrame], size, uniformAlignment, &offset);
+	if (data == NULL)
 	{
-		RecreateSwapChain();
-		return;
+		printf("Uniform ring of %u bytes is full\n", UNIFORM_RING_SIZE);
+		abort();
 	}
-	else if (acquireResult != VK_SUCCESS)
+
+	*dynamicOffset = (uint32_t)offset;
+	return data;
+}
+
+/**
+ * @return dynamic offset of the frame's uniforms
+ */
+static uint32_t UpdateUniformBuffer(const struct FramePacket *packet)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	// the projection follows the swapchain, which only the render thread knows
+	mat4 projection;
+	glm_perspective_rh_zo(glm_rad(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height,
+			      PROJECTION_NEAR, PROJECTION_FAR, projection);
+
+	// multiplied once here instead of for every vertex
+	struct FrameUniforms uniforms;
+	glm_mat4_mul(projection, (vec4 *)packet->view, uniforms.viewProj);
+
+	// the near plane is extracted for a -1 to 1 depth range, which only makes it more conservative
+	glm_frustum_planes(uniforms.viewProj, uniforms.frustumPlanes);
+	uniforms.objectCount = drawObjectCount;
+
+	uint32_t dynamicOffset;
+	memcpy(AllocateUniforms(sizeof(uniforms), &dynamicOffset), &uniforms, sizeof(uniforms));
+
+	PROFILE_END();
+	return dynamicOffset;
+}
+
+/**
+ * Sorts the packet's draws by a key of pass, pipeline, material, mesh and depth and writes their instance data
+ * into the frame's instance buffer in that order. Every run of draws with the same state bits becomes a batch,
+ * with a draw command for the culling pass to count its visible instances into.
+ * Within a batch the instances are nearest first, which the culling pass roughly keeps for early depth rejection.
+ */
+static void BuildDrawBatches(const struct FramePacket *packet)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	// the view's z row gives a draw's distance from its position alone
+	const vec4 *view = (const vec4 *)packet->view;
+	for (uint32_t i = 0; i < packet->drawCount; ++i)
 	{
-		printf("Could not queue presentqueue\n");
-		abort();
+		const struct Draw *draw = &packet->draws[i];
+		assert(draw->mesh < MESH_COUNT && draw->material < MATERIAL_COUNT);
+
+		const float *position = draw->model[3];
+		float distance = -(view[0][2] * position[0] + view[1][2] * position[1] + view[2][2] * position[2] +
+				   view[3][2]);
+		uint32_t depth = DrawList_QuantizeDepth(distance, PROJECTION_NEAR, PROJECTION_FAR);
+		drawListEntries[i].key = DrawList_MakeKey(DRAW_PASS_MAIN, materialPipelines[draw->material],
+							  draw->material, draw->mesh, depth);
+		drawListEntries[i].draw = i;
 	}
 
-	vkResetFences(vulkanDevice, 1, &inFlightFence[currentFrame]);
+	const struct DrawListEntry *sorted = DrawList_Sort(drawListEntries, drawListScratch, packet->drawCount);
 
-	vkResetCommandBuffer(vulkanCommandBuffers[currentFrame], 0);
-	RecordCommandBuffer(vulkanCommandBuffers[currentFrame], imageIndex);
+	VkDrawIndexedIndirectCommand *commands = drawCommandMemory[currentFrame].mapped;
+	struct InstanceData *instances = instanceBufferMemory[currentFrame].mapped;
+	uint64_t batchStates[MAX_DRAW_BATCHES];
+	drawBatchCount = 0;
+	for (uint32_t i = 0; i < packet->drawCount; ++i)
+	{
+		uint64_t key = sorted[i].key;
+		if (i == 0 || DRAW_KEY_STATE(key) != DRAW_KEY_STATE(sorted[i - 1].key))
+		{
+			assert(drawBatchCount < MAX_DRAW_BATCHES);
+
+			const struct MeshInfo *mesh = &meshes[DrawList_KeyMesh(key)];
+			commands[drawBatchCount] = (VkDrawIndexedIndirectCommand){ .indexCount = mesh->indexCount,
+										   .instanceCount = 0,
+										   .firstIndex = mesh->firstIndex,
+										   .vertexOffset = mesh->vertexOffset,
+										   .firstInstance = i };
+			drawBatchKeys[drawBatchCount] = key;
+			batchStates[drawBatchCount] = DRAW_KEY_STATE(key);
+			++drawBatchCount;
+		}
 
-	UpdateUniformBuffer(currentFrame);
+		const struct Draw *draw = &packet->draws[sorted[i].draw];
+		struct InstanceData *instance = &instances[i];
+		glm_mat4_copy((vec4 *)draw->model, instance->model);
+		glm_vec4_copy((float *)draw->color, instance->color);
+		glm_vec4_copy((float *)meshes[draw->mesh].boundingSphere, instance->boundingSphere);
+		instance->batch = drawBatchCount - 1;
+		instance->textureSlot = materialTextureSlots[draw->material];
+	}
+	drawObjectCount = packet->drawCount;
+	drawBatchStateHash = HashFnv1a64(batchStates, drawBatchCount * sizeof(uint64_t));
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore[currentFrame] };
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	PROFILE_END();
+}
 
-	VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-				    .pNext = NULL,
-				    .waitSemaphoreCount = 1,
-				    .pWaitSemaphores = waitSemaphores,
-				    .pWaitDstStageMask = waitStages,
-				    .commandBufferCount = 1,
-				    .pCommandBuffers = &vulkanCommandBuffers[currentFrame],
-				    .signalSemaphoreCount = 1,
-				    .pSignalSemaphores = signalSemaphores };
+/**
+ * Returns the command buffer of the frame slot for the image, recording it again only when something it records
+ * has changed since it was last submitted
+ */
+static VkCommandBuffer GetCachedCommandBuffer(uint32_t imageIndex, uint32_t uniformOffset)
+{
+	struct CachedCommandBuffer *cached = &commandCache[currentFrame * swapChainImageCount + imageIndex];
 
-	VkResult result = vkQueueSubmit(vulkanGraphicsQueue, 1, &submitInfo, inFlightFence[currentFrame]);
-	if (result != VK_SUCCESS)
+	// only the number of batches and objects and the binds between batches are recorded, what is in them reaches
+	// the GPU through buffers
+	if (cached->generation == commandCacheGeneration && cached->batchCount == drawBatchCount &&
+	    cached->batchStateHash == drawBatchStateHash && cached->objectCount == drawObjectCount &&
+	    cached->uniformOffset == uniformOffset && !cached->fallbackBound)
 	{
-		printf("Could not submit command buffer to queue\n");
-		abort();
+		GpuProfiler_ReplayFrame(currentFrame);
+		return cached->commandBuffer;
 	}
 
+	PROFILE_BEGIN("RecordCachedCommandBuffer");
+
+	// only ever submitted from this frame slot, whose fence has signalled
+	vkResetCommandBuffer(cached->commandBuffer, 0);
+	cached->fallbackBound = !RecordCommandBuffer(cached->commandBuffer, imageIndex, uniformOffset, false);
+
+	cached->generation = commandCacheGeneration;
+	cached->batchCount = drawBatchCount;
+	cached->batchStateHash = drawBatchStateHash;
+	cached->objectCount = drawObjectCount;
+	cached->uniformOffset = uniformOffset;
+
+	PROFILE_END();
+	return cached->commandBuffer;
+}
+
+static void PresentImage(uint32_t imageIndex, VkSemaphore *waitSemaphores)
+{
 	VkSwapchainKHR swapChains[] = { vulkanSwapChain };
 
 	VkPresentInfoKHR presentInfoKhr = { .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 					    .pNext = NULL,
 					    .waitSemaphoreCount = 1,
-					    .pWaitSemaphores = signalSemaphores,
+					    .pWaitSemaphores = waitSemaphores,
 					    .swapchainCount = 1,
 					    .pSwapchains = swapChains,
 					    .pImageIndices = &imageIndex,
 					    .pResults = NULL };
 
+	PROFILE_BEGIN("QueuePresent");
+	uint64_t waitStart = Timer_Ticks();
 	VkResult presentResult = vkQueuePresentKHR(vulkanPresentQueue, &presentInfoKhr);
+	FrameStats_AddWait(FRAME_STATS_WAIT_PRESENT, Timer_Ticks() - waitStart);
+	PROFILE_END();
 
 	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR || framebufferResized)
 	{
@@ -1335,8 +1992,142 @@ void DrawFrame()
 		printf("Could not queue presentqueue\n");
 		abort();
 	}
+}
+
+void DrawFrame(const struct FramePacket *packet)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	if (packet->reloadAssetFile != NULL && ReloadTextures(packet->reloadAssetFile) > 0)
+	{
+		ReloadChangedTextures();
+	}
+
+	// packs replaced by a reload are unmapped once no view or lookup of the compiler threads uses them
+	Vfs_ReleaseRetiredPacks();
+
+	if (packet->recreateSwapChain)
+	{
+		RecreateSwapChain();
+	}
+
+	PROFILE_BEGIN("WaitForFrameFence");
+	uint64_t waitStart = Timer_Ticks();
+	vkWaitForFences(vulkanDevice, 1, &inFlightFence[currentFrame], VK_TRUE, UINT64_MAX);
+	FrameStats_AddWait(FRAME_STATS_WAIT_FENCE, Timer_Ticks() - waitStart);
+	PROFILE_END();
+
+	// headless frames render into the offscreen image of their frame slot, which the fence has just freed
+	uint32_t imageIndex = currentFrame;
+	if (!headless)
+	{
+		PROFILE_BEGIN("AcquireNextImage");
+		waitStart = Timer_Ticks();
+		VkResult acquireResult = vkAcquireNextImageKHR(vulkanDevice, vulkanSwapChain, UINT64_MAX,
+							       imageAvailableSemaphore[currentFrame], NULL,
+							       &imageIndex);
+		FrameStats_AddWait(FRAME_STATS_WAIT_ACQUIRE, Timer_Ticks() - waitStart);
+		PROFILE_END();
+
+		if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR || acquireResult == VK_SUBOPTIMAL_KHR)
+		{
+			RecreateSwapChain();
+			PROFILE_END();
+			return;
+		}
+		else if (acquireResult != VK_SUCCESS)
+		{
+			printf("Could not queue presentqueue\n");
+			abort();
+		}
+	}
+
+	vkResetFences(vulkanDevice, 1, &inFlightFence[currentFrame]);
+
+	FlushDeferredDestructions(false);
+	GpuLinearPool_Reset(&uniformRings[currentFrame]);
+	DescriptorAllocator_BeginFrame(currentFrame);
+	Upload_Collect();
+
+	// a command buffer recorded every frame takes its set from the frame slot's pools, which were just reset
+	if (commandCaching)
+	{
+		frameDescriptorSet = cachedFrameSets[currentFrame];
+	}
+	else
+	{
+		frameDescriptorSet = DescriptorAllocator_Allocate(frameSetLayout);
+		WriteFrameDescriptorSet(frameDescriptorSet, currentFrame);
+	}
+
+	if (packet->drawListChanged)
+	{
+		++commandCacheGeneration;
+	}
+
+	BuildDrawBatches(packet);
+	uint32_t uniformOffset = UpdateUniformBuffer(packet);
+
+	VkCommandBuffer commandBuffer;
+	if (commandCaching)
+	{
+		commandBuffer = GetCachedCommandBuffer(imageIndex, uniformOffset);
+	}
+	else
+	{
+		commandBuffer = CommandRecorder_BeginFrame(currentFrame);
+		RecordCommandBuffer(commandBuffer, imageIndex, uniformOffset, true);
+	}
+
+	// uploads recorded since the last frame run on the transfer queue while the GPU catches up, only the
+	// stages reading them wait
+	uint64_t uploadValue = Upload_Flush();
+
+	// the value of the binary acquire semaphore is ignored, headless frames only wait for uploads
+	uint32_t firstWait = headless ? 1 : 0;
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore[currentFrame], Upload_Semaphore() };
+	uint64_t waitValues[] = { 0, uploadValue };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, UPLOAD_CONSUMER_STAGES };
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore[currentFrame] };
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = { .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+						       .pNext = NULL,
+						       .waitSemaphoreValueCount = 2 - firstWait,
+						       .pWaitSemaphoreValues = &waitValues[firstWait],
+						       .signalSemaphoreValueCount = 0,
+						       .pSignalSemaphoreValues = NULL };
+
+	VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				    .pNext = &timelineInfo,
+				    .waitSemaphoreCount = 2 - firstWait,
+				    .pWaitSemaphores = &waitSemaphores[firstWait],
+				    .pWaitDstStageMask = &waitStages[firstWait],
+				    .commandBufferCount = 1,
+				    .pCommandBuffers = &commandBuffer,
+				    .signalSemaphoreCount = headless ? 0 : 1,
+				    .pSignalSemaphores = signalSemaphores };
+
+	PROFILE_BEGIN("QueueSubmit");
+	VkResult result = vkQueueSubmit(vulkanGraphicsQueue, 1, &submitInfo, inFlightFence[currentFrame]);
+	PROFILE_END();
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not submit command buffer to queue\n");
+		abort();
+	}
+
+	if (!headless)
+	{
+		PresentImage(imageIndex, signalSemaphores);
+	}
 
 	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	++frameNumber;
+
+	// a frame abandoned for a swapchain recreation folds into this one, as it does on screen
+	FrameStats_EndFrame();
+
+	PROFILE_END();
 }
 
 static VkCommandBuffer BeginSingleTimeCommands()
@@ -1384,26 +2175,8 @@ static void EndSingleTimeCommands(VkCommandBuffer commandBuffer)
 	vkFreeCommandBuffers(vulkanDevice, vulkanCommandPool, 1, &commandBuffer);
 }
 
-static uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-	VkPhysicalDeviceMemoryProperties memoryProperties;
-	vkGetPhysicalDeviceMemoryProperties(vulkanPhysicalDevice, &memoryProperties);
-
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-	{
-		if ((typeFilter & (1 << i)) &&
-		    (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
-		{
-			return i;
-		}
-	}
-
-	printf("Could not find a suitable memory type!\n");
-	abort();
-}
-
 static void CreateBuffer(VkDeviceSize deviceSize, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags,
-			 VkBuffer *buffer, VkDeviceMemory *deviceMemory)
+			 VkBuffer *buffer, struct GpuAllocation *deviceMemory)
 {
 	VkBufferCreateInfo bufferCreateInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 						.pNext = NULL,
@@ -1414,6 +2187,14 @@ static void CreateBuffer(VkDeviceSize deviceSize, VkBufferUsageFlags usageFlags,
 						.queueFamilyIndexCount = 0,
 						.pQueueFamilyIndices = NULL };
 
+	// filled on the transfer queue and read on the graphics queue, concurrent saves an ownership transfer
+	if ((usageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && separateTransferFamily)
+	{
+		bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferCreateInfo.queueFamilyIndexCount = 2;
+		bufferCreateInfo.pQueueFamilyIndices = transferQueueFamilies;
+	}
+
 	VkResult result = vkCreateBuffer(vulkanDevice, &bufferCreateInfo, NULL, buffer);
 	if (result != VK_SUCCESS)
 	{
@@ -1423,233 +2204,242 @@ static void CreateBuffer(VkDeviceSize deviceSize, VkBufferUsageFlags usageFlags,
 
 	printf("Created vertex buffer\n");
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetBufferMemoryRequirements(vulkanDevice, *buffer, &memoryRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-					      .pNext = NULL,
-					      .allocationSize = memoryRequirements.size,
-					      .memoryTypeIndex = FindMemoryType(memoryRequirements.memoryTypeBits,
-										propertyFlags) };
-
-	VkResult allocateMemoryResult = vkAllocateMemory(vulkanDevice, &allocateInfo, NULL, deviceMemory);
-	if (allocateMemoryResult != VK_SUCCESS)
-	{
-		printf("Could not allocate memory\n");
-		abort();
-	}
-
-	vkBindBufferMemory(vulkanDevice, *buffer, *deviceMemory, 0);
+	GpuAllocator_AllocateBuffer(*buffer, propertyFlags, deviceMemory);
 }
 
-static void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+// recorded into the upload batch, frames submitted after it wait for it on the GPU
+static void CopyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize size)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-	VkBufferCopy copyRegion = { .srcOffset = 0, .dstOffset = 0, .size = size };
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-	EndSingleTimeCommands(commandBuffer);
+	VkBufferCopy copyRegion = { .srcOffset = srcOffset, .dstOffset = 0, .size = size };
+	vkCmdCopyBuffer(Upload_CommandBuffer(), srcBuffer, dstBuffer, 1, &copyRegion);
 }
 
-static void CreateDescriptorSetLayout()
+/**
+ * @param bindingFlags one per binding, NULL for none
+ */
+static VkDescriptorSetLayout CreateSetLayout(const VkDescriptorSetLayoutBinding *bindings,
+					     const VkDescriptorBindingFlags *bindingFlags, uint32_t bindingCount)
 {
-	VkDescriptorSetLayoutBinding uboLayoutBinding = { .binding = 0,
-							  .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-							  .descriptorCount = 1,
-							  .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-							  .pImmutableSamplers = NULL };
-
-	VkDescriptorSetLayoutBinding samplerLayoutBinding = { .binding = 1,
-							      .descriptorCount = 1,
-							      .descriptorType =
-								      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-							      .pImmutableSamplers = NULL,
-							      .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT };
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		.pNext = NULL,
+		.bindingCount = bindingCount,
+		.pBindingFlags = bindingFlags
+	};
 
-	VkDescriptorSetLayoutBinding *bindings = malloc(2 * sizeof(VkDescriptorSetLayoutBinding));
-	bindings[0] = uboLayoutBinding;
-	bindings[1] = samplerLayoutBinding;
+	bool updateAfterBind = false;
+	for (uint32_t i = 0; bindingFlags != NULL && i < bindingCount; ++i)
+	{
+		updateAfterBind |= (bindingFlags[i] & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) != 0;
+	}
 
 	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.bindingCount = 2,
+		.pNext = bindingFlags != NULL ? &bindingFlagsCreateInfo : NULL,
+		.flags = updateAfterBind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0,
+		.bindingCount = bindingCount,
 		.pBindings = bindings
 	};
 
-	VkResult layoutCreateResult =
-		vkCreateDescriptorSetLayout(vulkanDevice, &layoutCreateInfo, NULL, &descriptorSetLayout);
+	VkDescriptorSetLayout layout;
+	VkResult layoutCreateResult = vkCreateDescriptorSetLayout(vulkanDevice, &layoutCreateInfo, NULL, &layout);
 	if (layoutCreateResult != VK_SUCCESS)
 	{
 		printf("Could not create descriptor set layout\n");
 		abort();
 	}
 
-	printf("Created descriptor set layout\n");
+	return layout;
+}
 
-	free(bindings);
+static void CreateDescriptorSetLayouts()
+{
+	// shared by the culling pass and the vertex shader, the draw commands are only written by culling
+	VkDescriptorSetLayoutBinding frameLayoutBindings[] = {
+		{ .binding = 0,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		  .descriptorCount = 1,
+		  .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+		  .pImmutableSamplers = NULL },
+		{ .binding = 1,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		  .descriptorCount = 1,
+		  .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+		  .pImmutableSamplers = NULL },
+		{ .binding = 2,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		  .descriptorCount = 1,
+		  .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+		  .pImmutableSamplers = NULL },
+		{ .binding = 3,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		  .descriptorCount = 1,
+		  .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		  .pImmutableSamplers = NULL }
+	};
+
+	// one sampler and every texture, indexed by the slot in the instance data. Only slots of live textures are
+	// written, and they are written while frames that bind the set are still in flight.
+	VkDescriptorSetLayoutBinding textureLayoutBindings[] = {
+		{ .binding = 0,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+		  .descriptorCount = 1,
+		  .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		  .pImmutableSamplers = NULL },
+		{ .binding = 1,
+		  .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		  .descriptorCount = TEXTURE_SLOT_COUNT,
+		  .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+		  .pImmutableSamplers = NULL }
+	};
+
+	VkDescriptorBindingFlags textureBindingFlags[] = {
+		0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+	};
+
+	frameSetLayout = CreateSetLayout(frameLayoutBindings, NULL, 4);
+	textureSetLayout = CreateSetLayout(textureLayoutBindings, textureBindingFlags, 2);
+
+	VkDescriptorUpdateTemplateEntry frameTemplateEntries[4];
+	for (uint32_t binding = 0; binding < 4; ++binding)
+	{
+		frameTemplateEntries[binding] = (VkDescriptorUpdateTemplateEntry){
+			.dstBinding = binding,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = frameLayoutBindings[binding].descriptorType,
+			.offset = binding * sizeof(VkDescriptorBufferInfo),
+			.stride = sizeof(VkDescriptorBufferInfo)
+		};
+	}
+
+	frameSetTemplate = DescriptorAllocator_CreateTemplate(frameSetLayout, frameTemplateEntries, 4);
+
+	printf("Created descriptor set layouts\n");
 }
 
 static void CreateIndexBuffer()
 {
 	VkDeviceSize bufferSize = sizeof(indices[0]) * 12;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer,
-		     &stagingBufferMemory);
-
-	void *data;
-	vkMapMemory(vulkanDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices, (size_t)bufferSize);
-	vkUnmapMemory(vulkanDevice, stagingBufferMemory);
+	struct UploadStaging staging = Upload_AllocateStaging(bufferSize);
+	memcpy(staging.data, indices, (size_t)bufferSize);
 
 	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 		     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
 
-	CopyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-	vkDestroyBuffer(vulkanDevice, stagingBuffer, NULL);
-	vkFreeMemory(vulkanDevice, stagingBufferMemory, NULL);
+	CopyBuffer(staging.buffer, staging.offset, indexBuffer, bufferSize);
 }
 
 static void CreateVertexBuffer()
 {
 	VkDeviceSize bufferSize = sizeof(vertices[0]) * 8;
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer,
-		     &stagingBufferMemory);
-
-	void *data;
-	vkMapMemory(vulkanDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices, (size_t)bufferSize);
-	vkUnmapMemory(vulkanDevice, stagingBufferMemory);
+	struct UploadStaging staging = Upload_AllocateStaging(bufferSize);
+	memcpy(staging.data, vertices, (size_t)bufferSize);
 
 	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
 
-	CopyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-	vkDestroyBuffer(vulkanDevice, stagingBuffer, NULL);
-	vkFreeMemory(vulkanDevice, stagingBufferMemory, NULL);
+	CopyBuffer(staging.buffer, staging.offset, vertexBuffer, bufferSize);
 }
 
 static void CreateUniformBuffers()
 {
-	VkDeviceSize bufferSize = sizeof(struct UniformBufferObject);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vulkanPhysicalDevice, &properties);
+	uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		GpuLinearPool_Create(&uniformRings[i], UNIFORM_RING_SIZE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	printf("Created uniform rings\n");
+}
 
-	uniformBuffers = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkBuffer));
-	uniformBuffersMemory = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkDeviceMemory));
+static void CreateInstanceBuffers()
+{
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		CreateBuffer(FRAME_PACKET_MAX_DRAWS * sizeof(struct InstanceData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			     &instanceBuffers[i], &instanceBufferMemory[i]);
+	}
+
+	printf("Created instance buffers\n");
+}
 
+static void CreateCullingBuffers()
+{
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		CreateBuffer(FRAME_PACKET_MAX_DRAWS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &visibleBuffers[i], &visibleBufferMemory[i]);
+
+		// rewritten by the host every frame before culling counts into them
+		CreateBuffer(MAX_DRAW_BATCHES * sizeof(VkDrawIndexedIndirectCommand),
+			     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
 			     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			     &uniformBuffers[i], &uniformBuffersMemory[i]);
+			     &drawCommandBuffers[i], &drawCommandMemory[i]);
 	}
+
+	printf("Created culling buffers\n");
 }
 
-static void CreateDescriptorPool()
+// an update after bind layout can only be allocated from a pool created for it, so the texture set has its own
+static void CreateTextureDescriptorPool()
 {
-	VkDescriptorPoolSize *poolSizes = malloc(2 * sizeof(VkDescriptorPoolSize));
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+	VkDescriptorPoolSize poolSizes[] = { { .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = 1 },
+					     { .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+					       .descriptorCount = TEXTURE_SLOT_COUNT } };
 
 	VkDescriptorPoolCreateInfo poolInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 		.pNext = NULL,
-		.flags = 0,
-		.maxSets = MAX_FRAMES_IN_FLIGHT,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+		.maxSets = 1,
 		.poolSizeCount = 2,
 		.pPoolSizes = poolSizes,
 	};
 
-	VkResult result = vkCreateDescriptorPool(vulkanDevice, &poolInfo, NULL, &descriptorPool);
+	VkResult result = vkCreateDescriptorPool(vulkanDevice, &poolInfo, NULL, &textureDescriptorPool);
 	if (result != VK_SUCCESS)
 	{
-		printf("Could not create descriptor pool\n");
+		printf("Could not create texture descriptor pool\n");
 		abort();
 	}
 
-	printf("Created descriptor pool\n");
-
-	free(poolSizes);
+	printf("Created texture descriptor pool\n");
 }
 
 static void CreateDescriptorSets()
 {
-	VkDescriptorSetLayout *layouts = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkDescriptorSetLayout));
-	layouts[0] = descriptorSetLayout;
-	layouts[1] = descriptorSetLayout;
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		cachedFrameSets[i] = DescriptorAllocator_AllocatePersistent(frameSetLayout);
+		WriteFrameDescriptorSet(cachedFrameSets[i], i);
+	}
+
+	// one for every frame, a texture is added to it without waiting for the frames using it
 	VkDescriptorSetAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 						     .pNext = NULL,
-						     .descriptorPool = descriptorPool,
-						     .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
-						     .pSetLayouts = layouts };
+						     .descriptorPool = textureDescriptorPool,
+						     .descriptorSetCount = 1,
+						     .pSetLayouts = &textureSetLayout };
 
-	descriptorSets = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkDescriptorSet));
-	VkResult result = vkAllocateDescriptorSets(vulkanDevice, &allocateInfo, descriptorSets);
+	VkResult result = vkAllocateDescriptorSets(vulkanDevice, &allocateInfo, &textureDescriptorSet);
 	if (result != VK_SUCCESS)
 	{
-		printf("Could not allocate descriptor sets\n");
+		printf("Could not allocate the texture descriptor set\n");
 		abort();
 	}
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		VkDescriptorBufferInfo bufferInfo = { .buffer = uniformBuffers[i],
-						      .offset = 0,
-						      .range = sizeof(struct UniformBufferObject) };
-
-		VkDescriptorImageInfo imageInfo = { .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-						    .imageView = textureImageView,
-						    .sampler = textureSampler };
-
-		VkWriteDescriptorSet *descriptorSetWrites = malloc(2 * sizeof(VkWriteDescriptorSet));
-		descriptorSetWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorSetWrites[0].pNext = NULL;
-		descriptorSetWrites[0].pTexelBufferView = NULL;
-		descriptorSetWrites[0].dstSet = descriptorSets[i];
-		descriptorSetWrites[0].dstBinding = 0;
-		descriptorSetWrites[0].dstArrayElement = 0;
-		descriptorSetWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorSetWrites[0].descriptorCount = 1;
-		descriptorSetWrites[0].pBufferInfo = &bufferInfo;
-
-		descriptorSetWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorSetWrites[1].pNext = NULL;
-		descriptorSetWrites[1].pTexelBufferView = NULL;
-		descriptorSetWrites[1].dstSet = descriptorSets[i];
-		descriptorSetWrites[1].dstBinding = 1;
-		descriptorSetWrites[1].dstArrayElement = 0;
-		descriptorSetWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorSetWrites[1].descriptorCount = 1;
-		descriptorSetWrites[1].pImageInfo = &imageInfo;
-
-		/*VkWriteDescriptorSet descriptorWrite = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-							 .dstSet = descriptorSets[i],
-							 .dstBinding = 0,
-							 .dstArrayElement = 0,
-							 .descriptorCount = 1,
-							 .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-							 .pImageInfo = NULL,
-							 .pBufferInfo = &bufferInfo,
-							 .pTexelBufferView = NULL };*/
-
-		vkUpdateDescriptorSets(vulkanDevice, 2, descriptorSetWrites, 0, NULL);
-
-		free(descriptorSetWrites);
-	}
-
-	free(layouts);
+	WriteTextureSamplerDescriptor();
+	WriteTextureDescriptor(textureSlot, textureImageView);
 }
 
 static void GenerateMipmaps(VkImage image, VkFormat imageFormat, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevel)
@@ -1780,10 +2570,9 @@ static void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, ui
 	EndSingleTimeCommands(commandBuffer);
 }
 
-static void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevel)
+static void TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout,
+				  VkImageLayout newLayout, uint32_t mipLevel)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
 	VkImageMemoryBarrier memoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 					       .pNext = NULL,
 					       .srcAccessMask = 0, //TODO
@@ -1813,11 +2602,13 @@ static void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout
 	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
 		 newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 	{
+		// may run on a transfer queue without shader stages, the semaphore the frame waits on
+		// for the upload makes the writes visible to the fragment shader
 		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		memoryBarrier.dstAccessMask = 0;
 
 		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 	}
 	else
 	{
@@ -1826,12 +2617,10 @@ static void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout
 	}
 
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, NULL, 0, NULL, 1, &memoryBarrier);
-
-	EndSingleTimeCommands(commandBuffer);
 }
 
 static void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevel, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-			VkMemoryPropertyFlags properties, VkImage *image, VkDeviceMemory *imageMemory)
+			VkMemoryPropertyFlags properties, VkImage *image, struct GpuAllocation *imageMemory)
 {
 	VkImageCreateInfo imageCreateInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 					      .pNext = NULL,
@@ -1849,54 +2638,39 @@ static void CreateImage(uint32_t width, uint32_t height, uint32_t mipLevel, VkFo
 					      .pQueueFamilyIndices = NULL,
 					      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED };
 
-	VkResult imageCreateResult = vkCreateImage(vulkanDevice, &imageCreateInfo, NULL, image);
-	if (imageCreateResult != VK_SUCCESS)
+	if ((usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && separateTransferFamily)
 	{
-		printf("Could not create VkImage for texture\n");
-		abort();
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageCreateInfo.queueFamilyIndexCount = 2;
+		imageCreateInfo.pQueueFamilyIndices = transferQueueFamilies;
 	}
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(vulkanDevice, *image, &memoryRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-					      .pNext = NULL,
-					      .allocationSize = memoryRequirements.size,
-					      .memoryTypeIndex =
-						      FindMemoryType(memoryRequirements.memoryTypeBits, properties) };
-
-	VkResult allocateTextureMemoryResult = vkAllocateMemory(vulkanDevice, &allocateInfo, NULL, imageMemory);
-	if (allocateTextureMemoryResult != VK_SUCCESS)
+	VkResult imageCreateResult = vkCreateImage(vulkanDevice, &imageCreateInfo, NULL, image);
+	if (imageCreateResult != VK_SUCCESS)
 	{
-		printf("Could not allocate memory for textureImageMemory\n");
+		printf("Could not create VkImage for texture\n");
 		abort();
 	}
 
-	vkBindImageMemory(vulkanDevice, *image, *imageMemory, 0);
+	GpuAllocator_AllocateImage(*image, tiling, properties, imageMemory);
 }
 
-static void CreateTextureImage()
+/**
+ * @return false if the payload could not be read, nothing is created then
+ */
+static bool CreateTextureImage(struct AssetTexture *texture, VkImage *image, struct GpuAllocation *imageMemory)
 {
-	struct AssetTexture *texture = GetTexture("texture1");
-	if (texture == NULL)
+	PROFILE_FUNCTION_BEGIN();
+
+	// the payload goes from the asset file straight into mapped staging memory, no intermediate copy
+	struct UploadStaging staging = Upload_AllocateStaging(texture->bufferSize);
+	if (!ReadTexturePayload(texture, staging.data, staging.size))
 	{
-		printf("Could not find image\n");
-		abort();
+		printf("Could not read the pixels of texture %s\n", texture->name);
+		PROFILE_END();
+		return false;
 	}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	CreateBuffer(texture->bufferSize,
-		     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		     &stagingBuffer,
-		     &stagingBufferMemory);
-
-	void *data;
-	vkMapMemory(vulkanDevice, stagingBufferMemory, 0, texture->bufferSize, 0, &data);
-	memcpy(data, texture->buffer, texture->bufferSize);
-	vkUnmapMemory(vulkanDevice, stagingBufferMemory);
-
 	CreateImage(texture->width,
 		    texture->height,
 		    texture->mipmapCount,
@@ -1904,22 +2678,23 @@ static void CreateTextureImage()
 		    VK_IMAGE_TILING_OPTIMAL,
 		    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 		    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		    &textureImage,
-		    &textureImageMemory);
+		    image,
+		    imageMemory);
 
-	TransitionImageLayout(textureImage,
+	VkCommandBuffer commandBuffer = Upload_CommandBuffer();
+
+	TransitionImageLayout(commandBuffer,
+			      *image,
 			      VK_FORMAT_R8G8B8A8_SRGB,
 			      VK_IMAGE_LAYOUT_UNDEFINED,
 			      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			      texture->mipmapCount);
 
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
 	uint32_t regionCount = texture->mipmapCount + 1;
 	VkBufferImageCopy *regions = malloc(regionCount * sizeof(VkBufferImageCopy));
 	int w = texture->width;
 	int h = texture->height;
-	int offset = 0;
+	VkDeviceSize offset = staging.offset;
 	for (uint32_t mipLevel = 0; mipLevel < regionCount; ++mipLevel)
 	{
 		VkBufferImageCopy region = {
@@ -1945,35 +2720,33 @@ static void CreateTextureImage()
 	}
 
 	vkCmdCopyBufferToImage(commandBuffer,
-			       stagingBuffer,
-			       textureImage,
+			       staging.buffer,
+			       *image,
 			       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			       regionCount,
 			       regions);
 
-	EndSingleTimeCommands(commandBuffer);
-
 	mipLevels = texture->mipmapCount;
 
 	//CopyBufferToImage(stagingBuffer, textureImage, texture->width, texture->height);
 
 	//GenerateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
 
-	TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	TransitionImageLayout(commandBuffer, *image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
 
-	vkDestroyBuffer(vulkanDevice, stagingBuffer, NULL);
-	vkFreeMemory(vulkanDevice, stagingBufferMemory, NULL);
-
 	free(regions);
+
+	PROFILE_END();
+	return true;
 }
 
-static void CreateTextureImageView()
+static void CreateTextureImageView(VkImage image, VkImageView *imageView)
 {
 	VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
 					   .pNext = NULL,
 					   .flags = 0,
-					   .image = textureImage,
+					   .image = image,
 					   .viewType = VK_IMAGE_VIEW_TYPE_2D,
 					   .format = VK_FORMAT_R8G8B8A8_SRGB,
 					   .components = { .r = VK_COMPONENT_SWIZZLE_IDENTITY,
@@ -1986,7 +2759,7 @@ static void CreateTextureImageView()
 								 .baseArrayLayer = 0,
 								 .layerCount = 1 } };
 
-	VkResult createImageViewResult = vkCreateImageView(vulkanDevice, &viewInfo, NULL, &textureImageView);
+	VkResult createImageViewResult = vkCreateImageView(vulkanDevice, &viewInfo, NULL, imageView);
 	if (createImageViewResult != VK_SUCCESS)
 	{
 		printf("Could not create texture image view\n");
@@ -1994,10 +2767,11 @@ static void CreateTextureImageView()
 	}
 }
 
-static void CreateTextureSampler()
+static void CreateTextureSampler(VkSampler *sampler)
 {
 	VkPhysicalDeviceProperties properties;
 	vkGetPhysicalDeviceProperties(vulkanPhysicalDevice, &properties);
+	float maxAnisotropy = samplerAnisotropySupported ? properties.limits.maxSamplerAnisotropy : 1.0f;
 
 	VkSamplerCreateInfo samplerInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
 					    .pNext = NULL,
@@ -2008,16 +2782,17 @@ static void CreateTextureSampler()
 					    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
 					    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
 					    .mipLodBias = 0.0f,
-					    .anisotropyEnable = VK_TRUE,
-					    .maxAnisotropy = properties.limits.maxSamplerAnisotropy,
+					    .anisotropyEnable = samplerAnisotropySupported ? VK_TRUE : VK_FALSE,
+					    .maxAnisotropy = maxAnisotropy,
 					    .compareEnable = VK_FALSE,
 					    .compareOp = VK_COMPARE_OP_ALWAYS,
 					    .minLod = 0.0f,
-					    .maxLod = (float)mipLevels,
+					    // shared by textures with any number of mip levels
+					    .maxLod = VK_LOD_CLAMP_NONE,
 					    .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 					    .unnormalizedCoordinates = VK_FALSE };
 
-	VkResult createSamplerResult = vkCreateSampler(vulkanDevice, &samplerInfo, NULL, &textureSampler);
+	VkResult createSamplerResult = vkCreateSampler(vulkanDevice, &samplerInfo, NULL, sampler);
 	if (createSamplerResult != VK_SUCCESS)
 	{
 		printf("Failed to create texture sampler\n");
@@ -2025,6 +2800,89 @@ static void CreateTextureSampler()
 	}
 }
 
+static uint32_t AcquireTextureSlot()
+{
+	if (freeTextureSlotCount > 0)
+	{
+		return freeTextureSlots[--freeTextureSlotCount];
+	}
+
+	if (nextTextureSlot == TEXTURE_SLOT_COUNT)
+	{
+		printf("All %u texture slots are in use\n", TEXTURE_SLOT_COUNT);
+		abort();
+	}
+
+	return nextTextureSlot++;
+}
+
+// the descriptor is written once the set exists, see CreateDescriptorSets
+static void CreateTexture()
+{
+	boundTexture = GetTexture("texture1");
+	if (boundTexture == NULL)
+	{
+		printf("Could not find image\n");
+		abort();
+	}
+
+	boundTextureGeneration = boundTexture->generation;
+
+	if (!CreateTextureImage(boundTexture, &textureImage, &textureImageMemory))
+	{
+		abort();
+	}
+	CreateTextureImageView(textureImage, &textureImageView);
+	CreateTextureSampler(&textureSampler);
+	textureSlot = AcquireTextureSlot();
+	materialTextureSlots[MATERIAL_TEXTURED] = textureSlot;
+}
+
+void ReloadChangedTextures()
+{
+	// only the bound texture has an image to replace, the other textures are never uploaded
+	if (boundTexture == NULL || boundTexture->generation == boundTextureGeneration)
+	{
+		return;
+	}
+
+	struct DeferredDestruction previous = { .image = textureImage,
+						.imageView = textureImageView,
+						.sampler = VK_NULL_HANDLE,
+						.buffer = VK_NULL_HANDLE,
+						.memory = textureImageMemory,
+						.textureSlot = textureSlot };
+
+	/*
+	 * A pack replaced while it is read may be cut short. The previous image stays bound, and without a hash the
+	 * texture compares as changed on the next reload, which tries again.
+	 */
+	if (!CreateTextureImage(boundTexture, &textureImage, &textureImageMemory))
+	{
+		printf("Keeping the previous image of texture %s\n", boundTexture->name);
+		boundTexture->hash = 0;
+		return;
+	}
+	CreateTextureImageView(textureImage, &textureImageView);
+	textureSlot = AcquireTextureSlot();
+	WriteTextureDescriptor(textureSlot, textureImageView);
+
+	DeferDestruction(previous);
+
+	// frames in flight keep sampling the old slot, from the next frame on the instance data points at the new one
+	for (uint32_t i = 0; i < MATERIAL_COUNT; ++i)
+	{
+		if (materialTextureSlots[i] == previous.textureSlot)
+		{
+			materialTextureSlots[i] = textureSlot;
+		}
+	}
+
+	boundTextureGeneration = boundTexture->generation;
+
+	printf("Reloaded texture %s\n", boundTexture->name);
+}
+
 static bool HasStencilComponent(VkFormat format)
 {
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
@@ -2066,93 +2924,319 @@ static void CreateDepthResources()
 	}
 }
 
+// one target per frame in flight, so a frame only ever waits on its own fence before reusing one
+static void CreateOffscreenTargets()
+{
+	swapChainImageFormat = HEADLESS_FORMAT;
+	swapChainImageCount = MAX_FRAMES_IN_FLIGHT;
+	swapChainImages = malloc(swapChainImageCount * sizeof(VkImage));
+	offscreenImageMemory = malloc(swapChainImageCount * sizeof(struct GpuAllocation));
+	if (swapChainImages == NULL || offscreenImageMemory == NULL)
+	{
+		abort();
+	}
+
+	for (uint32_t i = 0; i < swapChainImageCount; ++i)
+	{
+		CreateImage(swapChainExtent.width, swapChainExtent.height, 1, swapChainImageFormat,
+			    VK_IMAGE_TILING_OPTIMAL,
+			    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &swapChainImages[i], &offscreenImageMemory[i]);
+	}
+
+	printf("Created %u offscreen render targets\n", swapChainImageCount);
+}
+
+static void CreateRenderTargets()
+{
+	if (headless)
+	{
+		CreateOffscreenTargets();
+	}
+	else
+	{
+		CreateSwapChain();
+	}
+}
+
+// cglm aligns mat4 to 32 bytes with AVX, more than malloc guarantees
+#define FRAME_PACKET_ALIGNMENT 32
+
+void CreateFramePacket(struct FramePacket *packet)
+{
+	memset(packet, 0, sizeof(struct FramePacket));
+
+	size_t size = FRAME_PACKET_MAX_DRAWS * sizeof(struct Draw);
+#ifdef _WIN32
+	packet->draws = _aligned_malloc(size, FRAME_PACKET_ALIGNMENT);
+#else
+	if (posix_memalign((void **)&packet->draws, FRAME_PACKET_ALIGNMENT, size) != 0)
+	{
+		packet->draws = NULL;
+	}
+#endif
+	if (packet->draws == NULL)
+	{
+		printf("Could not allocate the draw list of a frame packet\n");
+		abort();
+	}
+}
+
+void DestroyFramePacket(struct FramePacket *packet)
+{
+#ifdef _WIN32
+	_aligned_free(packet->draws);
+#else
+	free(packet->draws);
+#endif
+	packet->draws = NULL;
+}
+
 void RecreateSwapChain()
 {
+	if (!headless)
+	{
+		// a minimized window has a zero extent, which no swapchain can have, restoring it requests a new one
+		int width, height;
+		GetFramebufferSize(&width, &height);
+		if (width == 0 || height == 0)
+		{
+			return;
+		}
+	}
+
 	vkDeviceWaitIdle(vulkanDevice);
 
 	CleanupSwapChain();
 
-	CreateSwapChain();
+	CreateRenderTargets();
 	CreateImageViews();
 	CreateDepthResources();
 	CreateFramebuffers();
+
+	// the cached command buffers record the old framebuffers, and the image count may have changed
+	DestroyCommandCache();
+	CreateCommandCache();
 }
 
-void CreateVulkanInstance(struct Window *window)
+static void CreateVulkan(const char *applicationName)
 {
-	assert(window != NULL);
-
 	VkApplicationInfo applicationInfo = { .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
 					      .pNext = NULL,
-					      .pApplicationName = window->title,
+					      .pApplicationName = applicationName,
 					      .applicationVersion = 0,
 					      .pEngineName = ENGINE_NAME,
 					      .engineVersion = 0,
-					      .apiVersion = VK_API_VERSION_1_0 };
+					      .apiVersion = VK_API_VERSION_1_2 };
 
-	if (!CheckValidationLayerSupport())
+	validationLayersEnabled = enableValidationLayers;
+	if (validationLayersEnabled && !CheckValidationLayerSupport())
 	{
-		printf("validation layers requested, but not available!\n");
-		abort();
+		if (!headless)
+		{
+			printf("validation layers requested, but not available!\n");
+			abort();
+		}
+
+		printf("Validation layers are not available, running headless without them\n");
+		validationLayersEnabled = false;
 	}
 
 	CreateInstanceCreateInfo(&applicationInfo);
-	SetupDebugMessenger();
-	CreateSurface();
+	if (validationLayersEnabled)
+	{
+		SetupDebugMessenger();
+	}
+	if (!headless)
+	{
+		CreateSurface();
+	}
 	PickPhysicalDevice();
 	CreateLogicalDevice();
-	CreateSwapChain();
+	GpuAllocator_Init(vulkanPhysicalDevice, vulkanDevice);
+	DescriptorAllocator_Init(vulkanDevice, MAX_FRAMES_IN_FLIGHT);
+	PipelineCache_Init(vulkanPhysicalDevice, vulkanDevice, PIPELINE_CACHE_FILE);
+	CreateRenderTargets();
 	CreateImageViews();
 	CreateRenderPass();
-	CreateDescriptorSetLayout();
-	CreateGraphicsPipeline();
+	CreateDescriptorSetLayouts();
+	CreatePipelineLayout();
+	CreatePipelineLibrary();
+	CreateCullPipeline();
 	CreateDepthResources();
 	CreateFramebuffers();
 	CreateCommandPool();
-	CreateTextureImage();
-	CreateTextureImageView();
-	CreateTextureSampler();
+	CreateCommandCache();
+	CommandRecorder_Init(vulkanDevice, FindQueueFamilies(vulkanPhysicalDevice).graphicsFamily,
+			     MAX_FRAMES_IN_FLIGHT);
+	GpuProfiler_Init(validationLayersEnabled ? vulkanInstance : VK_NULL_HANDLE, vulkanPhysicalDevice, vulkanDevice,
+			 vulkanGraphicsQueue, FindQueueFamilies(vulkanPhysicalDevice).graphicsFamily,
+			 MAX_FRAMES_IN_FLIGHT, pipelineStatisticsSupported);
+	Upload_Init(vulkanDevice, vulkanTransferQueue, transferQueueFamilies[1]);
+	CreateTexture();
 	CreateVertexBuffer();
 	CreateIndexBuffer();
 	CreateUniformBuffers();
-	CreateDescriptorPool();
+	CreateInstanceBuffers();
+	CreateCullingBuffers();
+	CreateTextureDescriptorPool();
 	CreateDescriptorSets();
-	CreateCommandBuffers();
 	CreateSyncObjects();
 
+	GpuAllocator_PrintStats();
+
+	// every startup pipeline exists now, save so a crash later in the session does not lose them
+	PipelineCache_Save();
+
 	printf("------\n");
 	printf("Created a vulkan instance and every necessary object required for drawing\n");
 	printf("------\n");
 }
 
+void SetCommandCaching(bool enabled)
+{
+	commandCaching = enabled;
+}
+
+void CreateVulkanInstance(struct Window *window)
+{
+	assert(window != NULL);
+
+	headless = false;
+	CreateVulkan(window->title);
+}
+
+void CreateVulkanHeadless(const char *applicationName, uint32_t width, uint32_t height)
+{
+	assert(width > 0 && height > 0);
+
+	headless = true;
+	swapChainExtent.width = width;
+	swapChainExtent.height = height;
+	CreateVulkan(applicationName);
+}
+
+bool SaveLastFrame(const char *fileName)
+{
+	assert(headless);
+
+	if (frameNumber == 0)
+	{
+		printf("No frame has been rendered to save to %s\n", fileName);
+		return false;
+	}
+
+	vkDeviceWaitIdle(vulkanDevice);
+
+	uint32_t lastImage = (currentFrame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+	uint32_t width = swapChainExtent.width;
+	uint32_t height = swapChainExtent.height;
+	VkDeviceSize size = (VkDeviceSize)width * height * 4;
+
+	VkBuffer readbackBuffer;
+	struct GpuAllocation readbackMemory;
+	CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer,
+		     &readbackMemory);
+
+	VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+
+	// the render pass leaves the image in transfer layout, but its writes still have to be made visible
+	VkImageMemoryBarrier imageBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					      .pNext = NULL,
+					      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+					      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+					      .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					      .image = swapChainImages[lastImage],
+					      .subresourceRange = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+								    .baseMipLevel = 0,
+								    .levelCount = 1,
+								    .baseArrayLayer = 0,
+								    .layerCount = 1 } };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &imageBarrier);
+
+	VkBufferImageCopy region = { .bufferOffset = 0,
+				     .bufferRowLength = 0,
+				     .bufferImageHeight = 0,
+				     .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+							   .mipLevel = 0,
+							   .baseArrayLayer = 0,
+							   .layerCount = 1 },
+				     .imageOffset = { 0, 0, 0 },
+				     .imageExtent = { width, height, 1 } };
+	vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[lastImage], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			       readbackBuffer, 1, &region);
+
+	VkBufferMemoryBarrier bufferBarrier = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+						.pNext = NULL,
+						.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+						.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.buffer = readbackBuffer,
+						.offset = 0,
+						.size = VK_WHOLE_SIZE };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+			     &bufferBarrier, 0, NULL);
+
+	EndSingleTimeCommands(commandBuffer);
+
+	bool success =
+		stbi_write_png(fileName, (int)width, (int)height, 4, readbackMemory.mapped, (int)width * 4) != 0;
+
+	vkDestroyBuffer(vulkanDevice, readbackBuffer, NULL);
+	GpuAllocator_Free(&readbackMemory);
+
+	if (!success)
+	{
+		printf("Could not write frame to %s\n", fileName);
+	}
+
+	return success;
+}
+
 void DestroyVulkan()
 {
 	vkDeviceWaitIdle(vulkanDevice);
 
 	CleanupSwapChain();
 
+	FlushDeferredDestructions(true);
+	free(deferredDestructions);
+
 	vkDestroySampler(vulkanDevice, textureSampler, NULL);
 	vkDestroyImageView(vulkanDevice, textureImageView, NULL);
 	vkDestroyImage(vulkanDevice, textureImage, NULL);
-	vkFreeMemory(vulkanDevice, textureImageMemory, NULL);
+	GpuAllocator_Free(&textureImageMemory);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		vkDestroyBuffer(vulkanDevice, uniformBuffers[i], NULL);
-		vkFreeMemory(vulkanDevice, uniformBuffersMemory[i], NULL);
+		GpuLinearPool_Destroy(&uniformRings[i]);
+		vkDestroyBuffer(vulkanDevice, instanceBuffers[i], NULL);
+		GpuAllocator_Free(&instanceBufferMemory[i]);
+		vkDestroyBuffer(vulkanDevice, visibleBuffers[i], NULL);
+		GpuAllocator_Free(&visibleBufferMemory[i]);
+		vkDestroyBuffer(vulkanDevice, drawCommandBuffers[i], NULL);
+		GpuAllocator_Free(&drawCommandMemory[i]);
 	}
 
-	free(uniformBuffers);
-	free(uniformBuffersMemory);
-
-	vkDestroyDescriptorPool(vulkanDevice, descriptorPool, NULL);
-	vkDestroyDescriptorSetLayout(vulkanDevice, descriptorSetLayout, NULL);
+	DescriptorAllocator_Destroy();
+	vkDestroyDescriptorUpdateTemplate(vulkanDevice, frameSetTemplate, NULL);
+	vkDestroyDescriptorPool(vulkanDevice, textureDescriptorPool, NULL);
+	vkDestroyDescriptorSetLayout(vulkanDevice, frameSetLayout, NULL);
+	vkDestroyDescriptorSetLayout(vulkanDevice, textureSetLayout, NULL);
 
 	vkDestroyBuffer(vulkanDevice, vertexBuffer, NULL);
-	vkFreeMemory(vulkanDevice, vertexBufferMemory, NULL);
+	GpuAllocator_Free(&vertexBufferMemory);
 
 	vkDestroyBuffer(vulkanDevice, indexBuffer, NULL);
-	vkFreeMemory(vulkanDevice, indexBufferMemory, NULL);
+	GpuAllocator_Free(&indexBufferMemory);
+
+	Upload_Destroy();
 
 	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 	{
@@ -2162,27 +3246,38 @@ void DestroyVulkan()
 		vkDestroySemaphore(vulkanDevice, renderFinishedSemaphore[i], NULL);
 	}
 
+	CommandRecorder_Destroy();
+	DestroyCommandCache();
 	vkDestroyCommandPool(vulkanDevice, vulkanCommandPool, NULL);
 
-	vkDestroyPipeline(vulkanDevice, vulkanGraphicsPipeline, NULL);
+	GpuProfiler_Destroy();
+
+	PipelineLibrary_Destroy();
 	vkDestroyRenderPass(vulkanDevice, vulkanRenderPass, NULL);
 	vkDestroyPipelineLayout(vulkanDevice, vulkanPipelineLayout, NULL);
+	vkDestroyPipeline(vulkanDevice, cullPipeline, NULL);
+	vkDestroyPipelineLayout(vulkanDevice, cullPipelineLayout, NULL);
+
+	PipelineCache_Destroy();
+	GpuAllocator_Destroy();
 
 	vkDestroyDevice(vulkanDevice, NULL);
 
-	if (enableValidationLayers)
+	if (validationLayersEnabled)
 	{
 		DestroyDebugUtilsMessengerEXT(vulkanInstance, debugMessenger, NULL);
 	}
 
-	vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, NULL);
+	if (!headless)
+	{
+		vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, NULL);
+	}
 	vkDestroyInstance(vulkanInstance, NULL);
 
 	free(swapChainImageViews);
 	free(swapChainImages);
 	free(swapChainFramebuffers);
 
-	free(vulkanCommandBuffers);
 	free(inFlightFence);
 	free(imageAvailableSemaphore);
 	free(renderFinishedSemaphore);
@@ -1,8 +1,89 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "external/cglm/types.h"
+
 struct Window;
 
+// draws a packet has room for
+#define FRAME_PACKET_MAX_DRAWS 65536
+
+// meshes in the renderer's vertex and index buffers
+enum Mesh {
+	MESH_QUAD,
+	MESH_QUAD_PAIR, // a second quad behind the first
+	MESH_COUNT
+};
+
+// materials the renderer has descriptor sets for
+enum Material {
+	MATERIAL_TEXTURED,
+	MATERIAL_COUNT
+};
+
+// one object, draws sharing a mesh and material are drawn as the instances of one draw call
+struct Draw {
+	mat4 model;
+	vec4 color; // multiplies the texture
+	uint32_t mesh; // enum Mesh
+	uint32_t material; // enum Material
+};
+
+/**
+ * Everything the simulation hands the renderer for one frame, filled in without touching Vulkan
+ */
+struct FramePacket {
+	struct Draw *draws; // FRAME_PACKET_MAX_DRAWS, see CreateFramePacket
+	uint32_t drawCount;
+	mat4 view;
+	// asset file to reload textures from before drawing, NULL if nothing changed on disk
+	const char *reloadAssetFile;
+	// more than the instance data differs from the packet before, cached command buffers are recorded again
+	bool drawListChanged;
+	bool recreateSwapChain;
+	bool quit; // used by the render thread to stop
+	// Timer_Ticks the main thread slept in the frame limiter before filling the packet, the render thread was idle
+	uint64_t limiterTicks;
+};
+
+/**
+ * Allocates the draw list of a packet
+ */
+void CreateFramePacket(struct FramePacket *packet);
+void DestroyFramePacket(struct FramePacket *packet);
+
 void RecreateSwapChain();
+
+/**
+ * Call before creating Vulkan. Cached command buffers are recorded on one thread and submitted again every frame
+ * until the draw list, swapchain or pipelines change, instead of recording every frame in parallel.
+ */
+void SetCommandCaching(bool enabled);
+
 void CreateVulkanInstance(struct Window* window);
-void DrawFrame();
-void DestroyVulkan();
\ No newline at end of file
+
+/**
+ * Renders into offscreen images instead of a swapchain, without SDL or a surface.
+ * Accepts any device with a graphics queue, including CPU implementations like lavapipe.
+ */
+void CreateVulkanHeadless(const char *applicationName, uint32_t width, uint32_t height);
+
+/**
+ * Applies the packet's reload and swapchain requests, then records and submits the frame
+ */
+void DrawFrame(const struct FramePacket *packet);
+
+/**
+ * Headless only, waits for the GPU and writes the most recently drawn frame as a PNG
+ * @return false if nothing was drawn yet or the file could not be written
+ */
+bool SaveLastFrame(const char *fileName);
+
+/**
+ * Uploads texture1 again if a reload changed it. It is the only texture the renderer puts on the GPU, changes to
+ * the others only update their entries in the asset manager.
+ */
+void ReloadChangedTextures();
+void DestroyVulkan();
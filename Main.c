@@ -1,56 +1,469 @@
 #include <SDL.h>
+#include <argtable3.h>
+#include <stdio.h>
 #include "Window.h"
 #include "InternalVulkan.h"
 #include "File.h"
 #include "Timer.h"
 #include "AssetManager.h"
+#include "AssetWatcher.h"
+#include "Vfs.h"
+#include "Profiler.h"
+#include "FrameStats.h"
+#include "RenderThread.h"
+#include "Transform.h"
+#include "external/cglm/mat4.h"
+#include "external/cglm/affine.h"
+#include "external/cglm/quat.h"
+#include "external/cglm/clipspace/view_rh_zo.h"
 
-int main(int argc, char *argv[])
+#define ASSET_FILE "test.ass"
+#define MANIFEST_FILE "assets/manifest.json"
+#define ASSET_QUEUE_DEPTH 32
+// packed data overlays the working directory, ship without the loose files to skip their open/stat calls
+#define DATA_PACK "data.pak"
+// F9 starts a capture, pressing it again writes the trace
+#define PROFILER_TOGGLE_KEY SDLK_F9
+#define PROFILER_TRACE_FILE "profile.json"
+// seconds between frame time reports in the log
+#define FRAME_STATS_REPORT_SECONDS 5.0
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+// numbered frames written by --dump-every
+#define FRAME_DUMP_PATTERN "frame_%06u.png"
+#define FRAME_DUMP_PATH_SIZE 64
+// headless frames animate at a fixed step so dumps are identical between runs
+#define HEADLESS_FRAME_RATE 60.0
+// frame cap while the window is visible but not focused, waiting in the event queue in between
+#define BACKGROUND_FRAME_RATE 10.0
+// how often a minimized or hidden window wakes up without events, to keep polling the asset watcher
+#define IDLE_WAIT_MILLISECONDS 250
+
+struct WindowState {
+	bool quit;
+	bool minimized;
+	bool hidden;
+	bool focused;
+	// requests collected while no packet is being filled, e.g. while idle
+	bool recreateSwapChain;
+	bool reloadAssets;
+};
+
+static void DumpFrame(uint32_t frame)
 {
-	//mat4 rot;
-	//glm_mat4_identity(rot);
-	//glm_mat4_print(rot, stdout);
+	char fileName[FRAME_DUMP_PATH_SIZE];
+	snprintf(fileName, sizeof fileName, FRAME_DUMP_PATTERN, frame);
+	SaveLastFrame(fileName);
+}
 
-	Timer_Start();
+// more than one draw is laid out in a grid filling the area of the single one
+static uint32_t GridSize(uint32_t drawCount)
+{
+	uint32_t gridSize = 1;
+	while (gridSize * gridSize < drawCount)
+	{
+		++gridSize;
+	}
+
+	return gridSize;
+}
+
+// a cell node placing each draw in the grid with a spinning child the draw follows, added depth first
+static void BuildScene(uint32_t drawCount, struct TransformHierarchy *transforms)
+{
+	uint32_t gridSize = GridSize(drawCount);
+	float spacing = 1.0f / (float)gridSize;
+	vec3 scale = { spacing, spacing, spacing };
+	for (uint32_t i = 0; i < drawCount; ++i)
+	{
+		float x = ((float)(i % gridSize) + 0.5f) * spacing - 0.5f;
+		float y = ((float)(i / gridSize) + 0.5f) * spacing - 0.5f;
+		vec3 offset = { x, y, 0.0f };
+
+		uint32_t cell = Transform_AddNode(transforms, TRANSFORM_ROOT);
+		Transform_SetPosition(transforms, cell, offset);
+		Transform_SetScale(transforms, cell, scale);
+		Transform_AddNode(transforms, cell);
+	}
+}
+
+// runs on the main thread, overlapping the render thread drawing the previous packet
+static void Simulate(double time, uint32_t drawCount, struct TransformHierarchy *transforms, struct FramePacket *packet)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	versor rotation;
+	vec3 axis = { 0.0f, 0.0f, 1.0f };
+	glm_quatv(rotation, (float)time * glm_rad(90.0f), axis);
+
+	// only the spinners change, the cells keep their local matrices
+	for (uint32_t i = 0; i < drawCount; ++i)
+	{
+		Transform_SetRotation(transforms, 2 * i + 1, rotation);
+	}
+	Transform_Update(transforms);
+
+	uint32_t gridSize = GridSize(drawCount);
+	for (uint32_t i = 0; i < drawCount; ++i)
+	{
+		// every model is copied, the packet was last filled two frames ago
+		struct Draw *draw = &packet->draws[i];
+		glm_mat4_copy(transforms->worlds[2 * i + 1], draw->model);
+		glm_vec4_one(draw->color);
+
+		// a checkerboard of the two meshes, one instanced draw each
+		draw->mesh = (i % gridSize + i / gridSize) % 2 == 0 ? MESH_QUAD_PAIR : MESH_QUAD;
+		draw->material = MATERIAL_TEXTURED;
+	}
+
+	// only the instance data changes from frame to frame, the renderer keeps its commands until the count does
+	packet->drawListChanged = packet->drawCount != drawCount;
+	packet->drawCount = drawCount;
+
+	vec3 eye = { 0.0f, 2.0f, 2.0f };
+	vec3 center = { 0.0f, 0.0f, 0.0f };
+	vec3 up = { 0.0f, 1.0f, 0.0f };
+	glm_lookat_rh_zo(eye, center, up, packet->view);
+
+	PROFILE_END();
+}
+
+// fixed frame count with no window or input, for benchmarks and regression tests on GPU-less hosts
+// single threaded, the frames are drawn as they are simulated
+static void RunHeadless(uint32_t frameCount, uint32_t dumpEvery, uint32_t drawCount)
+{
+	struct FramePacket packet;
+	CreateFramePacket(&packet);
+
+	struct TransformHierarchy transforms;
+	Transform_CreateHierarchy(&transforms, 2 * drawCount);
+	BuildScene(drawCount, &transforms);
+
+	for (uint32_t frame = 1; frame <= frameCount; ++frame)
+	{
+		Simulate((double)(frame - 1) / HEADLESS_FRAME_RATE, drawCount, &transforms, &packet);
+		DrawFrame(&packet);
+
+		if (dumpEvery > 0 && frame % dumpEvery == 0)
+		{
+			DumpFrame(frame);
+		}
+	}
+
+	Transform_DestroyHierarchy(&transforms);
+	DestroyFramePacket(&packet);
+}
+
+static void HandleEvent(const SDL_Event *e, struct WindowState *state)
+{
+	if (e->type == SDL_QUIT)
+	{
+		state->quit = true;
+	}
+	else if (e->type == SDL_KEYDOWN && e->key.keysym.sym == PROFILER_TOGGLE_KEY && e->key.repeat == 0)
+	{
+		bool capturing = !Profiler_IsEnabled();
+		Profiler_SetEnabled(capturing);
+		if (!capturing)
+		{
+			Profiler_WriteChromeTrace(PROFILER_TRACE_FILE);
+		}
+	}
+	else if (e->type == SDL_WINDOWEVENT)
+	{
+		switch (e->window.event)
+		{
+		// the swapchain is left alone while minimized, its extent would be zero
+		case SDL_WINDOWEVENT_MINIMIZED:
+			state->minimized = true;
+			break;
+		case SDL_WINDOWEVENT_RESTORED:
+		case SDL_WINDOWEVENT_MAXIMIZED:
+			state->minimized = false;
+			state->recreateSwapChain = true;
+			break;
+		case SDL_WINDOWEVENT_SIZE_CHANGED:
+			state->recreateSwapChain = true;
+			break;
+		case SDL_WINDOWEVENT_HIDDEN:
+			state->hidden = true;
+			break;
+		case SDL_WINDOWEVENT_SHOWN:
+		case SDL_WINDOWEVENT_EXPOSED:
+			state->hidden = false;
+			break;
+		case SDL_WINDOWEVENT_FOCUS_GAINED:
+			state->focused = true;
+			break;
+		case SDL_WINDOWEVENT_FOCUS_LOST:
+			state->focused = false;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * Waits out the rest of the frame period. Focused windows sleep and spin for an even cadence,
+ * background windows wait in the event queue so input still wakes them immediately.
+ * @return start of the next frame period
+ */
+static uint64_t PaceFrame(uint64_t frameStartTicks, double frameRate, bool waitForEvents, struct WindowState *state)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	uint64_t nextFrameTicks = frameStartTicks + Timer_SecondsToTicks(1.0 / frameRate);
+	uint64_t now = Timer_Ticks();
 
-	struct CreateWindowParams params = { .dimensions = { 1920, 1080 }, .title = "Hello, World!" };
+	// a late frame starts the next period now rather than bursting to catch up
+	if (now >= nextFrameTicks)
+	{
+		PROFILE_END();
+		return now;
+	}
+
+	if (waitForEvents)
+	{
+		SDL_Event e;
+		int milliseconds = (int)(Timer_TicksToSeconds(nextFrameTicks - now) * 1000.0);
+		if (milliseconds > 0 && SDL_WaitEventTimeout(&e, milliseconds) != 0)
+		{
+			HandleEvent(&e, state);
+		}
+	}
+	else
+	{
+		Timer_SleepUntil(nextFrameTicks);
+	}
 
-	struct Window *window = CreateWindow(&params);
+	PROFILE_END();
 
-	FILE *f = fopen("test.ass", "rb");
-	LoadTextures(f);
+	return nextFrameTicks;
+}
 
-	CreateVulkanInstance(window);
+static void RunWindowed(uint32_t frameCount, double frameCap, uint32_t drawCount)
+{
+	// the watcher needs host paths, which for packed files is the pack itself
+	struct VfsLocation watchedLocations[2];
+	const char *watchedFiles[2];
+	uint32_t watchedFileCount = 0;
+	if (Vfs_Locate(ASSET_FILE, &watchedLocations[watchedFileCount]))
+	{
+		watchedFiles[watchedFileCount] = watchedLocations[watchedFileCount].hostPath;
+		++watchedFileCount;
+	}
+	if (Vfs_Locate(MANIFEST_FILE, &watchedLocations[watchedFileCount]))
+	{
+		watchedFiles[watchedFileCount] = watchedLocations[watchedFileCount].hostPath;
+		++watchedFileCount;
+	}
+	AssetWatcher_Start(watchedFiles, watchedFileCount);
 
+	RenderThread_Start();
+
+	struct TransformHierarchy transforms;
+	Transform_CreateHierarchy(&transforms, 2 * drawCount);
+	BuildScene(drawCount, &transforms);
+
+	struct WindowState state = { .quit = false,
+				     .minimized = false,
+				     .hidden = false,
+				     .focused = true,
+				     .recreateSwapChain = false,
+				     .reloadAssets = false };
 	SDL_Event e;
-	int quit = 0;
+	uint32_t frame = 0;
+	uint64_t nextFrameTicks = Timer_Ticks();
+	uint64_t limiterTicks = 0;
 
-	while (!quit)
+	while (!state.quit)
 	{
-		while (SDL_PollEvent(&e) != 0)
+		// nothing to show, so block in the event queue instead of drawing
+		if (state.minimized || state.hidden)
 		{
-			if (e.type == SDL_QUIT)
+			if (SDL_WaitEventTimeout(&e, IDLE_WAIT_MILLISECONDS) != 0)
 			{
-				quit = 1;
-				break;
-			}
-			if (e.window.event == SDL_WINDOWEVENT_MINIMIZED)
-			{
-				RecreateSwapChain();
-				break;
+				HandleEvent(&e, &state);
 			}
 		}
 
-		DrawFrame();
+		while (SDL_PollEvent(&e) != 0)
+		{
+			HandleEvent(&e, &state);
+		}
+
+		if (AssetWatcher_Poll() != 0)
+		{
+			state.reloadAssets = true;
+		}
+
+		if (state.quit || state.minimized || state.hidden)
+		{
+			nextFrameTicks = Timer_Ticks();
+			continue;
+		}
+
+		// blocks while the render thread is a whole packet behind
+		struct FramePacket *packet = RenderThread_AcquirePacket();
+		packet->reloadAssetFile = state.reloadAssets ? ASSET_FILE : NULL;
+		packet->recreateSwapChain = state.recreateSwapChain;
+		packet->limiterTicks = limiterTicks;
+		limiterTicks = 0;
+		state.reloadAssets = false;
+		state.recreateSwapChain = false;
+
+		Simulate(Timer_Now(), drawCount, &transforms, packet);
+		RenderThread_Submit();
+
+		if (frameCount > 0 && ++frame >= frameCount)
+		{
+			state.quit = true;
+		}
+
+		double frameRate = state.focused ? frameCap : BACKGROUND_FRAME_RATE;
+		if (frameCap > 0.0 && frameCap < frameRate)
+		{
+			frameRate = frameCap;
+		}
+		if (frameRate > 0.0)
+		{
+			uint64_t paceStart = Timer_Ticks();
+			nextFrameTicks = PaceFrame(nextFrameTicks, frameRate, !state.focused, &state);
+			limiterTicks = Timer_Ticks() - paceStart;
+		}
+	}
+
+	RenderThread_Stop();
+	AssetWatcher_Stop();
+	Transform_DestroyHierarchy(&transforms);
+}
+
+int main(int argc, char *argv[])
+{
+	//mat4 rot;
+	//glm_mat4_identity(rot);
+	//glm_mat4_print(rot, stdout);
+
+	struct arg_lit *headlessArg = arg_lit0(NULL, "headless", "render offscreen without a window, on any Vulkan device");
+	struct arg_int *framesArg = arg_int0("n", "frames", "<n>", "frames to render before exiting, required when headless");
+	struct arg_int *widthArg = arg_int0(NULL, "width", "<pixels>", "headless render width");
+	struct arg_int *heightArg = arg_int0(NULL, "height", "<pixels>", "headless render height");
+	struct arg_int *dumpArg = arg_int0(NULL, "dump-every", "<n>", "headless, save every n-th frame as " FRAME_DUMP_PATTERN);
+	struct arg_file *timingsArg = arg_file0(NULL, "timings", "<file>", "write frame time statistics as JSON on exit");
+	struct arg_dbl *frameCapArg = arg_dbl0(NULL, "fps-cap", "<hz>", "windowed frame rate limit, 0 for none");
+	struct arg_int *drawsArg = arg_int0(NULL, "draws", "<n>", "objects drawn per frame, laid out in a grid");
+	struct arg_lit *cacheArg = arg_lit0(NULL, "cache-commands", "record command buffers once and reuse them");
+	struct arg_lit *help = arg_lit0(NULL, "help", "print this help and exit");
+	struct arg_end *end = arg_end(20);
+	void *argtable[] = { headlessArg, framesArg, widthArg, heightArg, dumpArg, timingsArg, frameCapArg, drawsArg,
+			     cacheArg, help, end };
+	const char *progname = "OhNoNo";
+
+	if (arg_nullcheck(argtable) != 0)
+	{
+		printf("%s: insufficient memory\n", progname);
+		return 1;
+	}
+
+	widthArg->ival[0] = DEFAULT_WIDTH;
+	heightArg->ival[0] = DEFAULT_HEIGHT;
+	framesArg->ival[0] = 0;
+	dumpArg->ival[0] = 0;
+	frameCapArg->dval[0] = 0.0;
+	drawsArg->ival[0] = 1;
+
+	int nerrors = arg_parse(argc, argv, argtable);
+	bool headless = headlessArg->count > 0;
+	if (nerrors == 0 && (framesArg->ival[0] < 0 || widthArg->ival[0] <= 0 || heightArg->ival[0] <= 0 ||
+			     dumpArg->ival[0] < 0 || frameCapArg->dval[0] < 0.0 || drawsArg->ival[0] < 0 ||
+			     drawsArg->ival[0] > FRAME_PACKET_MAX_DRAWS || (headless && framesArg->ival[0] == 0)))
+	{
+		printf("%s: invalid frame count, size, dump interval, frame cap or draw count\n", progname);
+		nerrors = 1;
+	}
+	if (help->count > 0 || nerrors > 0)
+	{
+		if (nerrors > 0)
+		{
+			arg_print_errors(stdout, end, progname);
+		}
+		printf("Usage: %s", progname);
+		arg_print_syntax(stdout, argtable, "\n");
+		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+		arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+		return nerrors > 0;
+	}
+
+	Timer_Start();
+	Profiler_Init(false);
+
+	struct Window *window = NULL;
+	if (!headless)
+	{
+		struct CreateWindowParams params = { .dimensions = { DEFAULT_WIDTH, DEFAULT_HEIGHT },
+						     .title = "Hello, World!" };
+
+		window = CreateWindow(&params);
+	}
+
+	Vfs_MountDirectory(".", "");
+	if (Vfs_Exists(DATA_PACK))
+	{
+		Vfs_MountPack(DATA_PACK, "");
+	}
+
+	SetAssetLoadOptions(ASSET_QUEUE_DEPTH, false);
+	LoadTextures(ASSET_FILE);
+
+	SetCommandCaching(cacheArg->count > 0);
+	if (headless)
+	{
+		CreateVulkanHeadless(progname, (uint32_t)widthArg->ival[0], (uint32_t)heightArg->ival[0]);
+	}
+	else
+	{
+		CreateVulkanInstance(window);
+	}
+
+	FrameStats_Init(FRAME_STATS_REPORT_SECONDS);
+
+	if (headless)
+	{
+		RunHeadless((uint32_t)framesArg->ival[0], (uint32_t)dumpArg->ival[0], (uint32_t)drawsArg->ival[0]);
+	}
+	else
+	{
+		RunWindowed((uint32_t)framesArg->ival[0], frameCapArg->dval[0], (uint32_t)drawsArg->ival[0]);
+	}
+
+	if (timingsArg->count > 0)
+	{
+		FrameStats_WriteSummary(timingsArg->filename[0]);
+	}
+
+	if (Profiler_IsEnabled())
+	{
+		Profiler_WriteChromeTrace(PROFILER_TRACE_FILE);
 	}
 
 	DestroyVulkan();
-	DestroyWindow();
+	if (!headless)
+	{
+		DestroyWindow();
+	}
 	DestroyTextures();
+	Vfs_UnmountAll();
+	Profiler_Shutdown();
 
 	printf("Exiting....\n");
 
-	SDL_Quit();
+	if (!headless)
+	{
+		SDL_Quit();
+	}
+
+	arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,224 @@
+/*
+ * Writes the given files into a pack for Vfs_MountPack.
+ * Files are stored under the relative path they are given with, e.g.
+ * PackCreator -o data.pak shaders/quad.glsl.vert.spv shaders/quad.glsl.frag.spv shaders/cull.glsl.comp.spv test.ass
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <argtable3.h>
+
+#include "File.h"
+#include "Utilities.h"
+#include "Vfs.h"
+
+#define PACK_ENTRY_SIZE (3 * sizeof(uint64_t) + sizeof(uint32_t))
+
+struct PackFile {
+	const char *hostPath;
+	char path[VFS_MAX_PATH];
+	uint32_t pathLength;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool ToPackPath(const char *hostPath, char *path)
+{
+	while (hostPath[0] == '.' && (hostPath[1] == '/' || hostPath[1] == '\\'))
+	{
+		hostPath += 2;
+	}
+
+	if (hostPath[0] == '/' || hostPath[0] == '\\' || (hostPath[0] != '\0' && hostPath[1] == ':'))
+	{
+		return false;
+	}
+
+	size_t length = strlen(hostPath);
+	if (length >= VFS_MAX_PATH)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i <= length; ++i)
+	{
+		path[i] = hostPath[i] == '\\' ? '/' : hostPath[i];
+	}
+
+	return true;
+}
+
+static bool PadTo(FILE *pack, uint64_t offset)
+{
+	static const unsigned char zeros[VFS_PACK_ALIGNMENT] = { 0 };
+
+	uint64_t position = (uint64_t)ftell(pack);
+	while (position < offset)
+	{
+		uint64_t count = offset - position < sizeof zeros ? offset - position : sizeof zeros;
+		if (fwrite(zeros, 1, count, pack) != count)
+		{
+			return false;
+		}
+		position += count;
+	}
+
+	return true;
+}
+
+static bool CopyInto(FILE *pack, const struct PackFile *packFile)
+{
+	FILE *file = fopen(packFile->hostPath, "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	unsigned char buffer[64 * 1024];
+	uint64_t copied = 0;
+	size_t bytesRead;
+	while ((bytesRead = fread(buffer, 1, sizeof buffer, file)) > 0)
+	{
+		fwrite(buffer, 1, bytesRead, pack);
+		copied += bytesRead;
+	}
+
+	fclose(file);
+
+	return copied == packFile->size;
+}
+
+static bool WritePack(const char *fileName, struct PackFile *files, uint32_t count)
+{
+	uint64_t cursor = 4 * sizeof(uint32_t);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		cursor += PACK_ENTRY_SIZE + files[i].pathLength;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		files[i].offset = AlignUp(cursor, VFS_PACK_ALIGNMENT);
+		cursor = files[i].offset + files[i].size;
+	}
+
+	// written beside the pack and renamed over it, a running game may have the old one mapped
+	char tempFileName[TEMP_FILE_PATH_SIZE];
+	FILE *pack = BeginAtomicWrite(fileName, tempFileName);
+	if (pack == NULL)
+	{
+		printf("Could not create %s\n", fileName);
+		return false;
+	}
+
+	uint32_t header[4] = { VFS_PACK_MAGIC, VFS_PACK_VERSION, count, VFS_PACK_ALIGNMENT };
+	fwrite(header, sizeof(uint32_t), 4, pack);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint64_t hash = HashFnv1a64(files[i].path, files[i].pathLength);
+		fwrite(&hash, sizeof(uint64_t), 1, pack);
+		fwrite(&files[i].offset, sizeof(uint64_t), 1, pack);
+		fwrite(&files[i].size, sizeof(uint64_t), 1, pack);
+		fwrite(&files[i].pathLength, sizeof(uint32_t), 1, pack);
+		fwrite(files[i].path, 1, files[i].pathLength, pack);
+	}
+
+	bool success = true;
+	for (uint32_t i = 0; i < count && success; ++i)
+	{
+		success = PadTo(pack, files[i].offset) && CopyInto(pack, &files[i]);
+		if (!success)
+		{
+			printf("Could not copy %s into the pack\n", files[i].hostPath);
+		}
+	}
+
+	return FinishAtomicWrite(pack, tempFileName, fileName, success && ferror(pack) == 0);
+}
+
+int main(int argc, char **argv)
+{
+	struct arg_file *output = arg_file1("o", "output", "<pack>", "pack file to write");
+	struct arg_file *inputs = arg_filen(NULL, NULL, "<file>", 1, 4096, "files to pack, stored under the given relative path");
+	struct arg_lit *help = arg_lit0(NULL, "help", "print this help and exit");
+	struct arg_end *end = arg_end(20);
+	void *argtable[] = { output, inputs, help, end };
+	const char *progname = "PackCreator";
+	int exitcode = 0;
+	struct PackFile *files = NULL;
+
+	if (arg_nullcheck(argtable) != 0)
+	{
+		printf("%s: insufficient memory\n", progname);
+		exitcode = 1;
+		goto exit;
+	}
+
+	int nerrors = arg_parse(argc, argv, argtable);
+	if (help->count > 0 || nerrors > 0)
+	{
+		if (nerrors > 0)
+		{
+			arg_print_errors(stdout, end, progname);
+		}
+		printf("Usage: %s", progname);
+		arg_print_syntax(stdout, argtable, "\n");
+		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+		exitcode = nerrors > 0;
+		goto exit;
+	}
+
+	uint32_t count = (uint32_t)inputs->count;
+	files = malloc(count * sizeof(struct PackFile));
+	if (files == NULL)
+	{
+		printf("%s: insufficient memory\n", progname);
+		exitcode = 1;
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		struct PackFile *packFile = &files[i];
+		packFile->hostPath = inputs->filename[i];
+
+		if (!ToPackPath(packFile->hostPath, packFile->path))
+		{
+			printf("%s must be a relative path\n", packFile->hostPath);
+			exitcode = 1;
+			goto exit;
+		}
+		packFile->pathLength = (uint32_t)strlen(packFile->path);
+
+		FILE *file = fopen(packFile->hostPath, "rb");
+		if (file == NULL)
+		{
+			printf("Could not open %s\n", packFile->hostPath);
+			exitcode = 1;
+			goto exit;
+		}
+		fseek(file, 0, SEEK_END);
+		packFile->size = (uint64_t)ftell(file);
+		fclose(file);
+	}
+
+	if (!WritePack(output->filename[0], files, count))
+	{
+		exitcode = 1;
+		goto exit;
+	}
+
+	printf("Packed %u files into %s\n", count, output->filename[0]);
+
+exit:
+	free(files);
+	arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+	return exitcode;
+}
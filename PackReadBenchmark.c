@@ -0,0 +1,259 @@
+/*
+ * Compares the ways of reading an asset pack into memory: fread, a memory mapping and AsyncIO
+ * (io_uring when available) with and without O_DIRECT.
+ * For device throughput rather than page cache throughput, drop the caches between runs,
+ * e.g. sync; echo 3 > /proc/sys/vm/drop_caches
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <argtable3.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "AsyncIO.h"
+#include "Timer.h"
+
+#define CHUNK_SIZE (1024 * 1024)
+
+static uint64_t ReadWithFread(const char *fileName, unsigned char *buffer, uint64_t size)
+{
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	uint64_t total = 0;
+	while (total < size)
+	{
+		uint64_t chunk = size - total < CHUNK_SIZE ? size - total : CHUNK_SIZE;
+		size_t bytesRead = fread(buffer + total, 1, chunk, file);
+		if (bytesRead == 0)
+		{
+			break;
+		}
+		total += bytesRead;
+	}
+
+	fclose(file);
+
+	return total;
+}
+
+static uint64_t ReadWithMap(const char *fileName, unsigned char *buffer, uint64_t size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return 0;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void *view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (view == NULL)
+	{
+		if (mapping != NULL)
+		{
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return 0;
+	}
+
+	memcpy(buffer, view, size);
+
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	void *view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		close(fd);
+		return 0;
+	}
+
+	madvise(view, size, MADV_SEQUENTIAL);
+	memcpy(buffer, view, size);
+
+	munmap(view, size);
+	close(fd);
+#endif
+
+	return size;
+}
+
+static uint64_t ReadWithAsyncIO(const char *fileName, unsigned char *buffer, uint64_t size, bool direct,
+				uint32_t queueDepth)
+{
+	struct AsyncIOFile *file = AsyncIO_Open(fileName, direct, queueDepth);
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	uint32_t requestCount = (uint32_t)((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	struct AsyncIORequest *requests = malloc(requestCount * sizeof(struct AsyncIORequest));
+	for (uint32_t i = 0; i < requestCount; ++i)
+	{
+		uint64_t offset = (uint64_t)i * CHUNK_SIZE;
+		uint64_t chunk = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+		// the buffer is padded, so the final chunk can be rounded up to stay O_DIRECT eligible
+		chunk = (chunk + ASYNC_IO_ALIGNMENT - 1) / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT;
+		requests[i] = (struct AsyncIORequest){ .offset = offset, .size = chunk, .buffer = buffer + offset };
+	}
+
+	// the rounded up final chunk stops short at the end of the file, so the batch result is not enough
+	AsyncIO_ReadBatch(file, requests, requestCount);
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < requestCount; ++i)
+	{
+		uint64_t offset = (uint64_t)i * CHUNK_SIZE;
+		uint64_t required = size - offset < CHUNK_SIZE ? size - offset : CHUNK_SIZE;
+		if (requests[i].result != 0 || requests[i].bytesRead < required)
+		{
+			total = 0;
+			break;
+		}
+
+		total += requests[i].bytesRead;
+	}
+
+	free(requests);
+	AsyncIO_Close(file);
+
+	return total;
+}
+
+static void Report(const char *method, double *seconds, uint32_t runs, uint64_t size)
+{
+	double best = seconds[0];
+	double sum = 0.0;
+	for (uint32_t i = 0; i < runs; ++i)
+	{
+		best = seconds[i] < best ? seconds[i] : best;
+		sum += seconds[i];
+	}
+
+	double megabytes = (double)size / (1024.0 * 1024.0);
+	printf("%-22s best %8.2f MB/s  average %8.2f MB/s\n", method, megabytes / best, megabytes / (sum / runs));
+}
+
+int main(int argc, char **argv)
+{
+	struct arg_file *pack = arg_file1(NULL, NULL, "<pack>", "asset pack to read");
+	struct arg_int *runs = arg_int0("r", "runs", "<n>", "runs per method (default 5)");
+	struct arg_int *queueDepth = arg_int0("q", "queue-depth", "<n>", "AsyncIO queue depth (default 32)");
+	struct arg_lit *help = arg_lit0(NULL, "help", "print this help and exit");
+	struct arg_end *end = arg_end(20);
+	void *argtable[] = { pack, runs, queueDepth, help, end };
+	const char *progname = "PackReadBenchmark";
+	int exitcode = 0;
+
+	if (arg_nullcheck(argtable) != 0)
+	{
+		printf("%s: insufficient memory\n", progname);
+		exitcode = 1;
+		goto exit;
+	}
+
+	int nerrors = arg_parse(argc, argv, argtable);
+	if (help->count > 0 || nerrors > 0)
+	{
+		if (nerrors > 0)
+		{
+			arg_print_errors(stdout, end, progname);
+		}
+		printf("Usage: %s", progname);
+		arg_print_syntax(stdout, argtable, "\n");
+		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+		exitcode = nerrors > 0;
+		goto exit;
+	}
+
+	const char *fileName = pack->filename[0];
+	uint32_t runCount = runs->count > 0 && runs->ival[0] > 0 ? runs->ival[0] : 5;
+	uint32_t depth = queueDepth->count > 0 && queueDepth->ival[0] > 0 ? queueDepth->ival[0] : 32;
+
+	struct AsyncIOFile *probe = AsyncIO_Open(fileName, false, 1);
+	if (probe == NULL)
+	{
+		printf("Could not open %s\n", fileName);
+		exitcode = 1;
+		goto exit;
+	}
+	uint64_t size = AsyncIO_GetSize(probe);
+	printf("%s: %llu bytes, AsyncIO backend %s, queue depth %u\n", fileName, (unsigned long long)size,
+	       AsyncIO_BackendName(probe), depth);
+	AsyncIO_Close(probe);
+
+	unsigned char *buffer = AsyncIO_AllocAligned(size + ASYNC_IO_ALIGNMENT);
+	double *seconds = malloc(runCount * sizeof(double));
+	if (buffer == NULL || seconds == NULL)
+	{
+		printf("Could not allocate %llu bytes\n", (unsigned long long)size);
+		exitcode = 1;
+		goto exit;
+	}
+
+	Timer_Start();
+
+	const char *methods[] = { "fread", "mmap", "AsyncIO", "AsyncIO O_DIRECT" };
+	for (uint32_t method = 0; method < 4; ++method)
+	{
+		for (uint32_t run = 0; run < runCount; ++run)
+		{
+			double begin = Timer_Now();
+
+			uint64_t bytesRead = 0;
+			switch (method)
+			{
+			case 0:
+				bytesRead = ReadWithFread(fileName, buffer, size);
+				break;
+			case 1:
+				bytesRead = ReadWithMap(fileName, buffer, size);
+				break;
+			case 2:
+				bytesRead = ReadWithAsyncIO(fileName, buffer, size, false, depth);
+				break;
+			default:
+				bytesRead = ReadWithAsyncIO(fileName, buffer, size, true, depth);
+				break;
+			}
+
+			seconds[run] = Timer_Now() - begin;
+
+			if (bytesRead < size)
+			{
+				printf("%s read %llu of %llu bytes\n", methods[method], (unsigned long long)bytesRead,
+				       (unsigned long long)size);
+			}
+		}
+
+		Report(methods[method], seconds, runCount, size);
+	}
+
+	free(seconds);
+	AsyncIO_FreeAligned(buffer);
+
+exit:
+	arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+	return exitcode;
+}
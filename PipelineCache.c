@@ -0,0 +1,203 @@
+#include "PipelineCache.h"
+#include "File.h"
+#include "Profiler.h"
+#include "Utilities.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// vkGetPipelineCacheData starts with this header, described by VkPipelineCacheHeaderVersionOne
+#define PIPELINE_CACHE_VULKAN_HEADER_SIZE (16 + VK_UUID_SIZE)
+
+#define PIPELINE_CACHE_PATH_SIZE 1024
+
+struct PipelineCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static VkPipelineCache s_Cache = VK_NULL_HANDLE;
+static VkPhysicalDeviceProperties s_Properties;
+static char s_FileName[PIPELINE_CACHE_PATH_SIZE];
+static size_t s_SavedSize = 0;
+
+static uint32_t ReadU32(const unsigned char *bytes)
+{
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static bool IsVulkanHeaderValid(const unsigned char *data, uint64_t size)
+{
+	if (size < PIPELINE_CACHE_VULKAN_HEADER_SIZE)
+	{
+		return false;
+	}
+
+	uint32_t headerSize = ReadU32(data);
+	uint32_t headerVersion = ReadU32(data + 4);
+
+	return headerSize >= PIPELINE_CACHE_VULKAN_HEADER_SIZE && headerSize <= size &&
+	       headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && ReadU32(data + 8) == s_Properties.vendorID &&
+	       ReadU32(data + 12) == s_Properties.deviceID &&
+	       memcmp(data + 16, s_Properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * @return malloced cache data when the file matches this device and driver, NULL otherwise
+ */
+static void *LoadCacheData(const char *fileName, size_t *dataSize)
+{
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		printf("No pipeline cache at %s, pipelines are built from scratch\n", fileName);
+		return NULL;
+	}
+
+	struct PipelineCacheHeader header;
+	if (fread(&header, sizeof header, 1, file) != 1)
+	{
+		printf("Pipeline cache %s is truncated, ignoring it\n", fileName);
+		fclose(file);
+		return NULL;
+	}
+
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION)
+	{
+		printf("Pipeline cache %s has an unknown format, ignoring it\n", fileName);
+		fclose(file);
+		return NULL;
+	}
+
+	// a driver update may change how pipelines compile, even when it keeps the UUID
+	if (header.vendorID != s_Properties.vendorID || header.deviceID != s_Properties.deviceID ||
+	    header.driverVersion != s_Properties.driverVersion ||
+	    memcmp(header.pipelineCacheUUID, s_Properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		printf("Pipeline cache %s was written by another device or driver, ignoring it\n", fileName);
+		fclose(file);
+		return NULL;
+	}
+
+	unsigned char *data = malloc(header.dataSize);
+	if (data == NULL || fread(data, 1, header.dataSize, file) != header.dataSize ||
+	    HashFnv1a64(data, header.dataSize) != header.dataHash || !IsVulkanHeaderValid(data, header.dataSize))
+	{
+		printf("Pipeline cache %s is corrupt, ignoring it\n", fileName);
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+
+	*dataSize = header.dataSize;
+	return data;
+}
+
+void PipelineCache_Init(VkPhysicalDevice physicalDevice, VkDevice device, const char *fileName)
+{
+	assert(s_Device == VK_NULL_HANDLE);
+	assert(strlen(fileName) < PIPELINE_CACHE_PATH_SIZE);
+
+	s_Device = device;
+	strcpy(s_FileName, fileName);
+	vkGetPhysicalDeviceProperties(physicalDevice, &s_Properties);
+
+	size_t dataSize = 0;
+	void *data = LoadCacheData(fileName, &dataSize);
+
+	VkPipelineCacheCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+						 .pNext = NULL,
+						 .flags = 0,
+						 .initialDataSize = dataSize,
+						 .pInitialData = data };
+
+	if (vkCreatePipelineCache(s_Device, &createInfo, NULL, &s_Cache) != VK_SUCCESS)
+	{
+		printf("Could not create pipeline cache\n");
+		abort();
+	}
+
+	free(data);
+
+	// nothing new to write until a pipeline missed the cache
+	s_SavedSize = dataSize;
+
+	printf("Created pipeline cache from %zu bytes\n", dataSize);
+}
+
+void PipelineCache_Destroy()
+{
+	PipelineCache_Save();
+
+	vkDestroyPipelineCache(s_Device, s_Cache, NULL);
+	s_Cache = VK_NULL_HANDLE;
+	s_Device = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache_Get()
+{
+	return s_Cache;
+}
+
+bool PipelineCache_Save()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(s_Device, s_Cache, &dataSize, NULL) != VK_SUCCESS)
+	{
+		printf("Could not query the pipeline cache size\n");
+		return false;
+	}
+
+	// entries are only ever added, so an unchanged size means nothing new was compiled
+	if (dataSize == s_SavedSize)
+	{
+		return true;
+	}
+
+	PROFILE_FUNCTION_BEGIN();
+
+	void *data = malloc(dataSize);
+	if (data == NULL || vkGetPipelineCacheData(s_Device, s_Cache, &dataSize, data) != VK_SUCCESS)
+	{
+		printf("Could not read the pipeline cache data\n");
+		free(data);
+		PROFILE_END();
+		return false;
+	}
+
+	struct PipelineCacheHeader header = { .magic = PIPELINE_CACHE_MAGIC,
+					      .version = PIPELINE_CACHE_VERSION,
+					      .vendorID = s_Properties.vendorID,
+					      .deviceID = s_Properties.deviceID,
+					      .driverVersion = s_Properties.driverVersion,
+					      .dataSize = dataSize,
+					      .dataHash = HashFnv1a64(data, dataSize) };
+	memcpy(header.pipelineCacheUUID, s_Properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	bool written = WriteBytesAtomic(s_FileName, &header, sizeof header, data, dataSize);
+	free(data);
+
+	if (!written)
+	{
+		printf("Could not write the pipeline cache to %s\n", s_FileName);
+		PROFILE_END();
+		return false;
+	}
+
+	printf("Saved %zu bytes of pipeline cache to %s\n", dataSize, s_FileName);
+	s_SavedSize = dataSize;
+
+	PROFILE_END();
+	return true;
+}
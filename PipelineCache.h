@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+ * File layout: magic, version, vendor ID, device ID, driver version, pipeline cache UUID, data size and the
+ * FNV-1a hash of the data, then the data as returned by vkGetPipelineCacheData
+ */
+#define PIPELINE_CACHE_MAGIC 0x43504E4Fu // "ONPC"
+#define PIPELINE_CACHE_VERSION 1
+
+/**
+ * Creates the pipeline cache, seeded from fileName when it was written by the same device and driver.
+ * A missing, stale or corrupt file starts an empty cache.
+ * @param fileName host path, also where PipelineCache_Save writes to
+ */
+void PipelineCache_Init(VkPhysicalDevice physicalDevice, VkDevice device, const char *fileName);
+
+/**
+ * Saves one last time and destroys the cache
+ */
+void PipelineCache_Destroy();
+
+/**
+ * @return cache to pass to every vkCreate*Pipelines call
+ */
+VkPipelineCache PipelineCache_Get();
+
+/**
+ * Writes the cache to a temporary file and renames it over the previous one, so a crash never leaves a
+ * truncated cache behind. Skipped when the cache has not grown since the last save.
+ * @return false if the file could not be written
+ */
+bool PipelineCache_Save();
@@ -0,0 +1,765 @@
+#include "PipelineLibrary.h"
+#include "File.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "Utilities.h"
+#include "Vfs.h"
+
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_LIBRARY_INITIAL_CAPACITY 64
+#define PIPELINE_LIBRARY_MAX_SHADERS 64
+#define PIPELINE_LIST_PATH_SIZE 1024
+
+enum PipelineStatus {
+	PIPELINE_QUEUED,
+	PIPELINE_COMPILING,
+	PIPELINE_READY,
+	PIPELINE_FAILED
+};
+
+struct PipelineEntry {
+	struct PipelineDescription key; // the dynamic state is cleared when the device sets it dynamically
+	struct PipelineDescription description; // as first requested, for the prewarm list
+	uint64_t hash;
+	VkPipeline pipeline;
+	enum PipelineStatus status;
+};
+
+struct PipelineShader {
+	char path[PIPELINE_SHADER_PATH_SIZE];
+	VkShaderModule module;
+};
+
+struct PipelineListHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t descriptionSize;
+	uint32_t count;
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static VkPipelineLayout s_PipelineLayout = VK_NULL_HANDLE;
+static VkRenderPass s_RenderPass = VK_NULL_HANDLE;
+static struct PipelinePassFormats s_PassFormats;
+static struct PipelineVertexLayout *s_VertexLayouts = NULL;
+static uint32_t s_VertexLayoutCount = 0;
+static bool s_ExtendedDynamicState = false;
+static char s_ListFileName[PIPELINE_LIST_PATH_SIZE];
+
+static PFN_vkCmdSetCullModeEXT s_CmdSetCullMode = NULL;
+static PFN_vkCmdSetFrontFaceEXT s_CmdSetFrontFace = NULL;
+static PFN_vkCmdSetDepthTestEnableEXT s_CmdSetDepthTestEnable = NULL;
+static PFN_vkCmdSetDepthWriteEnableEXT s_CmdSetDepthWriteEnable = NULL;
+static PFN_vkCmdSetDepthCompareOpEXT s_CmdSetDepthCompareOp = NULL;
+
+/*
+ * Entries only ever get appended, so their indices stay valid while the array grows. The slots are an open
+ * addressing table of entry index + 1, 0 for empty. All of it, including the shaders, is guarded by s_Mutex.
+ */
+static SDL_mutex *s_Mutex = NULL;
+static SDL_cond *s_WorkAvailable = NULL;
+static SDL_cond *s_WorkDone = NULL;
+static struct PipelineEntry *s_Entries = NULL;
+static uint32_t s_EntryCount = 0;
+static uint32_t s_EntryCapacity = 0;
+static uint32_t *s_Slots = NULL;
+static uint32_t s_SlotCapacity = 0;
+
+// FIFO of entry indices waiting for a worker
+static uint32_t *s_Queue = NULL;
+static uint32_t s_QueueHead = 0;
+static uint32_t s_QueueCount = 0;
+static uint32_t s_PendingCount = 0; // queued or compiling
+
+static struct PipelineShader s_Shaders[PIPELINE_LIBRARY_MAX_SHADERS];
+static uint32_t s_ShaderCount = 0;
+
+static SDL_Thread *s_Workers[PIPELINE_LIBRARY_MAX_WORKERS];
+static uint32_t s_WorkerCount = 0;
+static bool s_Quit = false;
+
+static void MakeKey(const struct PipelineDescription *description, struct PipelineDescription *key)
+{
+	*key = *description;
+
+	if (s_ExtendedDynamicState)
+	{
+		key->cullMode = 0;
+		key->frontFace = 0;
+		key->depthTest = VK_FALSE;
+		key->depthWrite = VK_FALSE;
+		key->depthCompareOp = 0;
+	}
+}
+
+static void InsertSlot(uint32_t entryIndex)
+{
+	uint32_t mask = s_SlotCapacity - 1;
+	uint32_t slot = (uint32_t)s_Entries[entryIndex].hash & mask;
+	while (s_Slots[slot] != 0)
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	s_Slots[slot] = entryIndex + 1;
+}
+
+static struct PipelineEntry *FindEntry(const struct PipelineDescription *key, uint64_t hash)
+{
+	uint32_t mask = s_SlotCapacity - 1;
+	for (uint32_t slot = (uint32_t)hash & mask; s_Slots[slot] != 0; slot = (slot + 1) & mask)
+	{
+		struct PipelineEntry *entry = &s_Entries[s_Slots[slot] - 1];
+		if (entry->hash == hash && memcmp(&entry->key, key, sizeof(struct PipelineDescription)) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Call with s_Mutex held
+ */
+static struct PipelineEntry *AddEntry(const struct PipelineDescription *description,
+				      const struct PipelineDescription *key, uint64_t hash)
+{
+	if (s_EntryCount == s_EntryCapacity)
+	{
+		// every entry is queued once at most, so the queue never holds more than the entries
+		uint32_t *queue = malloc(s_EntryCapacity * 2 * sizeof(uint32_t));
+		s_Entries = realloc(s_Entries, s_EntryCapacity * 2 * sizeof(struct PipelineEntry));
+		if (s_Entries == NULL || queue == NULL)
+		{
+			printf("Could not grow the pipeline library\n");
+			abort();
+		}
+
+		for (uint32_t i = 0; i < s_QueueCount; ++i)
+		{
+			queue[i] = s_Queue[(s_QueueHead + i) % s_EntryCapacity];
+		}
+
+		free(s_Queue);
+		s_Queue = queue;
+		s_QueueHead = 0;
+		s_EntryCapacity *= 2;
+	}
+
+	// keep the table at most half full
+	if (s_EntryCount * 2 >= s_SlotCapacity)
+	{
+		free(s_Slots);
+		s_SlotCapacity *= 2;
+		s_Slots = calloc(s_SlotCapacity, sizeof(uint32_t));
+		if (s_Slots == NULL)
+		{
+			printf("Could not grow the pipeline library\n");
+			abort();
+		}
+
+		for (uint32_t i = 0; i < s_EntryCount; ++i)
+		{
+			InsertSlot(i);
+		}
+	}
+
+	uint32_t entryIndex = s_EntryCount++;
+	struct PipelineEntry *entry = &s_Entries[entryIndex];
+	entry->key = *key;
+	entry->description = *description;
+	entry->hash = hash;
+	entry->pipeline = VK_NULL_HANDLE;
+	entry->status = PIPELINE_QUEUED;
+	InsertSlot(entryIndex);
+
+	s_Queue[(s_QueueHead + s_QueueCount) % s_EntryCapacity] = entryIndex;
+	s_QueueCount++;
+	s_PendingCount++;
+	SDL_CondSignal(s_WorkAvailable);
+
+	return entry;
+}
+
+static bool MatchesPass(const struct PipelineDescription *description)
+{
+	return description->colorFormat == s_PassFormats.colorFormat &&
+	       description->depthFormat == s_PassFormats.depthFormat && description->samples == s_PassFormats.samples;
+}
+
+/**
+ * Finds the entry of the description, queueing a compile for new ones. Call with s_Mutex held.
+ */
+static struct PipelineEntry *Request(const struct PipelineDescription *description)
+{
+	assert(MatchesPass(description));
+
+	struct PipelineDescription key;
+	MakeKey(description, &key);
+	uint64_t hash = HashFnv1a64(&key, sizeof key);
+
+	struct PipelineEntry *entry = FindEntry(&key, hash);
+	if (entry == NULL)
+	{
+		entry = AddEntry(description, &key, hash);
+	}
+
+	return entry;
+}
+
+/**
+ * Modules are kept until PipelineLibrary_Destroy, every material sharing a shader reuses them.
+ * Call with s_Mutex held, loading a shader is cheap next to the compile itself.
+ * @return VK_NULL_HANDLE if the shader could not be loaded
+ */
+static VkShaderModule GetShaderModule(const char *path)
+{
+	for (uint32_t i = 0; i < s_ShaderCount; ++i)
+	{
+		if (strcmp(s_Shaders[i].path, path) == 0)
+		{
+			return s_Shaders[i].module;
+		}
+	}
+
+	if (s_ShaderCount == PIPELINE_LIBRARY_MAX_SHADERS)
+	{
+		printf("Too many shaders in the pipeline library\n");
+		return VK_NULL_HANDLE;
+	}
+
+	struct VfsView code;
+	if (!Vfs_Open(path, &code))
+	{
+		printf("Could not open %s\n", path);
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModuleCreateInfo createInfo = { .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+						.pNext = NULL,
+						.flags = 0,
+						.codeSize = code.size,
+						.pCode = code.data };
+
+	VkShaderModule module;
+	VkResult result = vkCreateShaderModule(s_Device, &createInfo, NULL, &module);
+	Vfs_Close(&code);
+	if (result != VK_SUCCESS)
+	{
+		printf("Could not create shadermodule for %s\n", path);
+		return VK_NULL_HANDLE;
+	}
+
+	struct PipelineShader *shader = &s_Shaders[s_ShaderCount++];
+	strcpy(shader->path, path);
+	shader->module = module;
+
+	return module;
+}
+
+static VkPipeline CompilePipeline(const struct PipelineDescription *key, VkShaderModule vertexShader,
+				  VkShaderModule fragmentShader)
+{
+	VkPipelineShaderStageCreateInfo shaderStages[2] = {
+		{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		  .pNext = NULL,
+		  .flags = 0,
+		  .stage = VK_SHADER_STAGE_VERTEX_BIT,
+		  .module = vertexShader,
+		  .pName = "main",
+		  .pSpecializationInfo = NULL },
+		{ .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		  .pNext = NULL,
+		  .flags = 0,
+		  .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		  .module = fragmentShader,
+		  .pName = "main",
+		  .pSpecializationInfo = NULL }
+	};
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT,
+					   VK_DYNAMIC_STATE_SCISSOR,
+					   VK_DYNAMIC_STATE_CULL_MODE_EXT,
+					   VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+					   VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+					   VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+					   VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT };
+
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.dynamicStateCount = s_ExtendedDynamicState ? sizeof dynamicStates / sizeof dynamicStates[0] : 2,
+		.pDynamicStates = dynamicStates
+	};
+
+	const struct PipelineVertexLayout *vertexLayout = &s_VertexLayouts[key->vertexLayout];
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &vertexLayout->binding,
+		.vertexAttributeDescriptionCount = vertexLayout->attributeCount,
+		.pVertexAttributeDescriptions = vertexLayout->attributes
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.topology = key->topology,
+		.primitiveRestartEnable = VK_FALSE
+	};
+
+	VkPipelineViewportStateCreateInfo viewportState = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.viewportCount = 1,
+		.pViewports = NULL,
+		.scissorCount = 1,
+		.pScissors = NULL
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.depthClampEnable = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode = key->polygonMode,
+		.lineWidth = 1.0f,
+		.cullMode = key->cullMode,
+		.frontFace = key->frontFace,
+		.depthBiasEnable = VK_FALSE,
+		.depthBiasConstantFactor = 0.0f,
+		.depthBiasClamp = 0.0f,
+		.depthBiasSlopeFactor = 0.0f
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.rasterizationSamples = key->samples,
+		.sampleShadingEnable = VK_FALSE,
+		.minSampleShading = 1.0f,
+		.pSampleMask = NULL,
+		.alphaToCoverageEnable = VK_FALSE,
+		.alphaToOneEnable = VK_FALSE
+	};
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+		.blendEnable = key->blendMode != PIPELINE_BLEND_OPAQUE,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor =
+			key->blendMode == PIPELINE_BLEND_ADDITIVE ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
+				  VK_COLOR_COMPONENT_A_BIT
+	};
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.logicOpEnable = VK_FALSE,
+		.logicOp = VK_LOGIC_OP_COPY,
+		.attachmentCount = 1,
+		.pAttachments = &colorBlendAttachment,
+		.blendConstants = { 0.0f, 0.0f, 0.0f, 0.0f }
+	};
+
+	VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.depthTestEnable = key->depthTest,
+		.depthWriteEnable = key->depthWrite,
+		.depthCompareOp = key->depthCompareOp,
+		.depthBoundsTestEnable = VK_FALSE,
+		.minDepthBounds = 0.0f,
+		.maxDepthBounds = 1.0f,
+		.stencilTestEnable = VK_FALSE
+	};
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+							    .pNext = NULL,
+							    .flags = 0,
+							    .stageCount = 2,
+							    .pStages = shaderStages,
+							    .pVertexInputState = &vertexInputInfo,
+							    .pInputAssemblyState = &inputAssembly,
+							    .pViewportState = &viewportState,
+							    .pRasterizationState = &rasterizer,
+							    .pMultisampleState = &multisampling,
+							    .pDepthStencilState = &depthStencilStateCreateInfo,
+							    .pColorBlendState = &colorBlending,
+							    .pDynamicState = &dynamicStateCreateInfo,
+							    .layout = s_PipelineLayout,
+							    .renderPass = s_RenderPass,
+							    .subpass = 0,
+							    .basePipelineHandle = VK_NULL_HANDLE,
+							    .basePipelineIndex = -1 };
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	if (vkCreateGraphicsPipelines(s_Device, PipelineCache_Get(), 1, &pipelineCreateInfo, NULL, &pipeline) !=
+	    VK_SUCCESS)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	return pipeline;
+}
+
+static int WorkerMain(void *data)
+{
+	Profiler_SetThreadName("PipelineCompiler");
+
+	SDL_LockMutex(s_Mutex);
+	for (;;)
+	{
+		while (s_QueueCount == 0 && !s_Quit)
+		{
+			SDL_CondWait(s_WorkAvailable, s_Mutex);
+		}
+
+		// queued compiles are abandoned, they are still saved to the prewarm list
+		if (s_Quit)
+		{
+			break;
+		}
+
+		uint32_t entryIndex = s_Queue[s_QueueHead];
+		s_QueueHead = (s_QueueHead + 1) % s_EntryCapacity;
+		s_QueueCount--;
+
+		s_Entries[entryIndex].status = PIPELINE_COMPILING;
+		struct PipelineDescription key = s_Entries[entryIndex].key;
+
+		VkShaderModule vertexShader = GetShaderModule(key.vertexShader);
+		VkShaderModule fragmentShader = GetShaderModule(key.fragmentShader);
+
+		SDL_UnlockMutex(s_Mutex);
+
+		PROFILE_BEGIN("CompilePipeline");
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vertexShader != VK_NULL_HANDLE && fragmentShader != VK_NULL_HANDLE)
+		{
+			pipeline = CompilePipeline(&key, vertexShader, fragmentShader);
+		}
+		PROFILE_END();
+
+		if (pipeline == VK_NULL_HANDLE)
+		{
+			printf("Could not compile the pipeline for %s and %s\n", key.vertexShader, key.fragmentShader);
+		}
+
+		SDL_LockMutex(s_Mutex);
+
+		// the array may have grown while unlocked, so the entry is looked up again
+		s_Entries[entryIndex].pipeline = pipeline;
+		s_Entries[entryIndex].status = pipeline != VK_NULL_HANDLE ? PIPELINE_READY : PIPELINE_FAILED;
+		s_PendingCount--;
+		SDL_CondBroadcast(s_WorkDone);
+	}
+	SDL_UnlockMutex(s_Mutex);
+
+	Profiler_ReleaseThread();
+	return 0;
+}
+
+static void LoadPrewarmList(const char *fileName)
+{
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return;
+	}
+
+	struct PipelineListHeader header;
+	if (fread(&header, sizeof header, 1, file) != 1 || header.magic != PIPELINE_LIST_MAGIC ||
+	    header.version != PIPELINE_LIST_VERSION || header.descriptionSize != sizeof(struct PipelineDescription))
+	{
+		printf("Pipeline list %s is outdated, ignoring it\n", fileName);
+		fclose(file);
+		return;
+	}
+
+	uint32_t queued = 0;
+	struct PipelineDescription description;
+	for (uint32_t i = 0; i < header.count && fread(&description, sizeof description, 1, file) == 1; ++i)
+	{
+		// the shader paths have to be terminated and layouts may have been removed since. Entries saved for
+		// other attachments would not be compatible with s_RenderPass, skipping them drops them from the list.
+		if (memchr(description.vertexShader, '\0', PIPELINE_SHADER_PATH_SIZE) == NULL ||
+		    memchr(description.fragmentShader, '\0', PIPELINE_SHADER_PATH_SIZE) == NULL ||
+		    description.vertexLayout >= s_VertexLayoutCount || !MatchesPass(&description))
+		{
+			continue;
+		}
+
+		Request(&description);
+		queued++;
+	}
+
+	fclose(file);
+
+	printf("Prewarming %u pipelines from %s\n", queued, fileName);
+}
+
+static void SavePrewarmList()
+{
+	if (s_EntryCount == 0)
+	{
+		return;
+	}
+
+	struct PipelineDescription *descriptions = malloc(s_EntryCount * sizeof(struct PipelineDescription));
+	if (descriptions == NULL)
+	{
+		return;
+	}
+
+	// failed pipelines are left out, so a removed shader drops out of the list
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < s_EntryCount; ++i)
+	{
+		if (s_Entries[i].status != PIPELINE_FAILED)
+		{
+			descriptions[count++] = s_Entries[i].description;
+		}
+	}
+
+	struct PipelineListHeader header = { .magic = PIPELINE_LIST_MAGIC,
+					     .version = PIPELINE_LIST_VERSION,
+					     .descriptionSize = sizeof(struct PipelineDescription),
+					     .count = count };
+
+	if (WriteBytesAtomic(s_ListFileName, &header, sizeof header, descriptions,
+			     count * sizeof(struct PipelineDescription)))
+	{
+		printf("Saved %u pipelines to prewarm to %s\n", count, s_ListFileName);
+	}
+
+	free(descriptions);
+}
+
+void PipelineLibrary_Init(VkDevice device, VkPipelineLayout pipelineLayout, VkRenderPass renderPass,
+			  const struct PipelinePassFormats *passFormats,
+			  const struct PipelineVertexLayout *vertexLayouts, uint32_t vertexLayoutCount,
+			  bool extendedDynamicState, const char *listFileName)
+{
+	assert(s_Device == VK_NULL_HANDLE);
+	assert(vertexLayoutCount > 0);
+	assert(strlen(listFileName) < PIPELINE_LIST_PATH_SIZE);
+
+	s_Device = device;
+	s_PipelineLayout = pipelineLayout;
+	s_RenderPass = renderPass;
+	s_PassFormats = *passFormats;
+	s_ExtendedDynamicState = extendedDynamicState;
+	strcpy(s_ListFileName, listFileName);
+
+	// copied, the caller's attribute arrays may be freed once Init returns
+	s_VertexLayoutCount = vertexLayoutCount;
+	s_VertexLayouts = malloc(vertexLayoutCount * sizeof(struct PipelineVertexLayout));
+	for (uint32_t i = 0; i < vertexLayoutCount; ++i)
+	{
+		s_VertexLayouts[i] = vertexLayouts[i];
+		VkVertexInputAttributeDescription *attributes =
+			malloc(vertexLayouts[i].attributeCount * sizeof(VkVertexInputAttributeDescription));
+		memcpy(attributes, vertexLayouts[i].attributes,
+		       vertexLayouts[i].attributeCount * sizeof(VkVertexInputAttributeDescription));
+		s_VertexLayouts[i].attributes = attributes;
+	}
+
+	if (s_ExtendedDynamicState)
+	{
+		s_CmdSetCullMode = (PFN_vkCmdSetCullModeEXT)vkGetDeviceProcAddr(device, "vkCmdSetCullModeEXT");
+		s_CmdSetFrontFace = (PFN_vkCmdSetFrontFaceEXT)vkGetDeviceProcAddr(device, "vkCmdSetFrontFaceEXT");
+		s_CmdSetDepthTestEnable =
+			(PFN_vkCmdSetDepthTestEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthTestEnableEXT");
+		s_CmdSetDepthWriteEnable =
+			(PFN_vkCmdSetDepthWriteEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthWriteEnableEXT");
+		s_CmdSetDepthCompareOp =
+			(PFN_vkCmdSetDepthCompareOpEXT)vkGetDeviceProcAddr(device, "vkCmdSetDepthCompareOpEXT");
+	}
+
+	s_EntryCapacity = PIPELINE_LIBRARY_INITIAL_CAPACITY;
+	s_EntryCount = 0;
+	s_Entries = malloc(s_EntryCapacity * sizeof(struct PipelineEntry));
+	s_Queue = malloc(s_EntryCapacity * sizeof(uint32_t));
+	s_SlotCapacity = PIPELINE_LIBRARY_INITIAL_CAPACITY * 2;
+	s_Slots = calloc(s_SlotCapacity, sizeof(uint32_t));
+	s_QueueHead = 0;
+	s_QueueCount = 0;
+	s_PendingCount = 0;
+	s_ShaderCount = 0;
+	s_Quit = false;
+
+	s_Mutex = SDL_CreateMutex();
+	s_WorkAvailable = SDL_CreateCond();
+	s_WorkDone = SDL_CreateCond();
+	if (s_Entries == NULL || s_Queue == NULL || s_Slots == NULL || s_Mutex == NULL || s_WorkAvailable == NULL ||
+	    s_WorkDone == NULL)
+	{
+		printf("Could not create the pipeline library: %s\n", SDL_GetError());
+		abort();
+	}
+
+	// leave a core each for the main and render threads
+	int cpuCount = SDL_GetCPUCount();
+	s_WorkerCount = cpuCount > 3 ? (uint32_t)cpuCount - 2 : 1;
+	if (s_WorkerCount > PIPELINE_LIBRARY_MAX_WORKERS)
+	{
+		s_WorkerCount = PIPELINE_LIBRARY_MAX_WORKERS;
+	}
+
+	SDL_LockMutex(s_Mutex);
+	LoadPrewarmList(listFileName);
+	SDL_UnlockMutex(s_Mutex);
+
+	for (uint32_t i = 0; i < s_WorkerCount; ++i)
+	{
+		s_Workers[i] = SDL_CreateThread(WorkerMain, "PipelineCompiler", NULL);
+		if (s_Workers[i] == NULL)
+		{
+			printf("Could not create pipeline compiler thread: %s\n", SDL_GetError());
+			abort();
+		}
+	}
+
+	printf("Created pipeline library with %u compiler threads%s\n", s_WorkerCount,
+	       s_ExtendedDynamicState ? ", cull and depth state are dynamic" : "");
+}
+
+void PipelineLibrary_Destroy()
+{
+	SDL_LockMutex(s_Mutex);
+	s_Quit = true;
+	SDL_CondBroadcast(s_WorkAvailable);
+	SDL_UnlockMutex(s_Mutex);
+
+	for (uint32_t i = 0; i < s_WorkerCount; ++i)
+	{
+		SDL_WaitThread(s_Workers[i], NULL);
+	}
+
+	SavePrewarmList();
+
+	for (uint32_t i = 0; i < s_EntryCount; ++i)
+	{
+		vkDestroyPipeline(s_Device, s_Entries[i].pipeline, NULL);
+	}
+
+	for (uint32_t i = 0; i < s_ShaderCount; ++i)
+	{
+		vkDestroyShaderModule(s_Device, s_Shaders[i].module, NULL);
+	}
+
+	for (uint32_t i = 0; i < s_VertexLayoutCount; ++i)
+	{
+		free((void *)s_VertexLayouts[i].attributes);
+	}
+
+	free(s_VertexLayouts);
+	free(s_Entries);
+	free(s_Queue);
+	free(s_Slots);
+	s_VertexLayouts = NULL;
+	s_Entries = NULL;
+	s_Queue = NULL;
+	s_Slots = NULL;
+
+	SDL_DestroyCond(s_WorkAvailable);
+	SDL_DestroyCond(s_WorkDone);
+	SDL_DestroyMutex(s_Mutex);
+
+	s_Device = VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineLibrary_Get(const struct PipelineDescription *description)
+{
+	assert(description->vertexLayout < s_VertexLayoutCount);
+
+	SDL_LockMutex(s_Mutex);
+	VkPipeline pipeline = Request(description)->pipeline;
+	SDL_UnlockMutex(s_Mutex);
+
+	return pipeline;
+}
+
+VkPipeline PipelineLibrary_Wait(const struct PipelineDescription *description)
+{
+	assert(description->vertexLayout < s_VertexLayoutCount);
+
+	PROFILE_FUNCTION_BEGIN();
+	SDL_LockMutex(s_Mutex);
+
+	// the entry is found again after every wake up, the array may have moved
+	struct PipelineEntry *entry = Request(description);
+	while (entry->status == PIPELINE_QUEUED || entry->status == PIPELINE_COMPILING)
+	{
+		SDL_CondWait(s_WorkDone, s_Mutex);
+		entry = Request(description);
+	}
+
+	VkPipeline pipeline = entry->pipeline;
+
+	SDL_UnlockMutex(s_Mutex);
+	PROFILE_END();
+
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		printf("Could not create graphics pipeline\n");
+		abort();
+	}
+
+	return pipeline;
+}
+
+bool PipelineLibrary_Bind(VkCommandBuffer commandBuffer, const struct PipelineDescription *description,
+			  const struct PipelineDescription *fallback)
+{
+	VkPipeline pipeline = PipelineLibrary_Get(description);
+	bool ready = pipeline != VK_NULL_HANDLE;
+	if (!ready)
+	{
+		pipeline = PipelineLibrary_Get(fallback);
+		assert(pipeline != VK_NULL_HANDLE);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+	if (s_ExtendedDynamicState)
+	{
+		s_CmdSetCullMode(commandBuffer, description->cullMode);
+		s_CmdSetFrontFace(commandBuffer, description->frontFace);
+		s_CmdSetDepthTestEnable(commandBuffer, description->depthTest);
+		s_CmdSetDepthWriteEnable(commandBuffer, description->depthWrite);
+		s_CmdSetDepthCompareOp(commandBuffer, description->depthCompareOp);
+	}
+
+	return ready;
+}
+
+uint32_t PipelineLibrary_PendingCount()
+{
+	SDL_LockMutex(s_Mutex);
+	uint32_t pendingCount = s_PendingCount;
+	SDL_UnlockMutex(s_Mutex);
+
+	return pendingCount;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#define PIPELINE_SHADER_PATH_SIZE 64
+#define PIPELINE_LIBRARY_MAX_WORKERS 4
+
+/*
+ * Prewarm list layout: magic, version, size of a description, description count, then the descriptions
+ * of every pipeline requested in earlier runs
+ */
+#define PIPELINE_LIST_MAGIC 0x4C504E4Fu // "ONPL"
+#define PIPELINE_LIST_VERSION 1
+
+enum PipelineBlendMode {
+	PIPELINE_BLEND_OPAQUE,
+	PIPELINE_BLEND_ALPHA,
+	PIPELINE_BLEND_ADDITIVE
+};
+
+struct PipelineVertexLayout {
+	VkVertexInputBindingDescription binding;
+	const VkVertexInputAttributeDescription *attributes;
+	uint32_t attributeCount;
+};
+
+// the attachments of the render pass given to PipelineLibrary_Init
+struct PipelinePassFormats {
+	VkFormat colorFormat;
+	VkFormat depthFormat;
+	VkSampleCountFlagBits samples;
+};
+
+/*
+ * Everything a graphics pipeline is built from. Hashed and compared byte for byte and written to the prewarm
+ * list, so zero it before filling it in and only use values that are stable between runs.
+ */
+struct PipelineDescription {
+	char vertexShader[PIPELINE_SHADER_PATH_SIZE]; // Vfs paths of the SPIR-V
+	char fragmentShader[PIPELINE_SHADER_PATH_SIZE];
+	uint32_t vertexLayout; // index into the layouts given to PipelineLibrary_Init
+	VkPrimitiveTopology topology;
+	VkPolygonMode polygonMode;
+	enum PipelineBlendMode blendMode;
+
+	// render pass compatibility, must match the PipelinePassFormats given to PipelineLibrary_Init
+	VkFormat colorFormat;
+	VkFormat depthFormat;
+	VkSampleCountFlagBits samples;
+
+	// set dynamically with extended dynamic state, then not part of the key
+	VkCullModeFlags cullMode;
+	VkFrontFace frontFace;
+	VkBool32 depthTest;
+	VkBool32 depthWrite;
+	VkCompareOp depthCompareOp;
+};
+
+/**
+ * Starts the compiler threads and queues every pipeline on the prewarm list.
+ * Shaders are read through the Vfs from the worker threads, so mounts must not change until PipelineLibrary_Destroy.
+ * @param pipelineLayout layout of every pipeline in the library
+ * @param renderPass pass the pipelines are used in
+ * @param passFormats attachments of the pass, prewarm list entries saved for other formats are skipped
+ * @param extendedDynamicState VK_EXT_extended_dynamic_state is enabled on the device
+ * @param listFileName host path of the prewarm list, rewritten by PipelineLibrary_Destroy
+ */
+void PipelineLibrary_Init(VkDevice device, VkPipelineLayout pipelineLayout, VkRenderPass renderPass,
+			  const struct PipelinePassFormats *passFormats,
+			  const struct PipelineVertexLayout *vertexLayouts, uint32_t vertexLayoutCount,
+			  bool extendedDynamicState, const char *listFileName);
+
+/**
+ * Waits for the compiles in progress, then saves the prewarm list and destroys every pipeline.
+ * Compiles still queued are abandoned rather than waited for, they stay on the list for the next run.
+ */
+void PipelineLibrary_Destroy();
+
+/**
+ * Never blocks on a compile. Queues the pipeline on the first request.
+ * @return the pipeline, VK_NULL_HANDLE while it is still compiling or if it failed to
+ */
+VkPipeline PipelineLibrary_Get(const struct PipelineDescription *description);
+
+/**
+ * Blocks until the pipeline is compiled, for the pipelines others fall back to. Aborts if it fails to compile.
+ */
+VkPipeline PipelineLibrary_Wait(const struct PipelineDescription *description);
+
+/**
+ * Binds the pipeline of the description, or fallback's while it compiles, and sets the state that is dynamic
+ * @param fallback description whose pipeline is compiled already, see PipelineLibrary_Wait
+ * @return false if the fallback was bound
+ */
+bool PipelineLibrary_Bind(VkCommandBuffer commandBuffer, const struct PipelineDescription *description,
+			  const struct PipelineDescription *fallback);
+
+/**
+ * @return number of pipelines queued or compiling
+ */
+uint32_t PipelineLibrary_PendingCount();
@@ -0,0 +1,435 @@
+#include "Profiler.h"
+#include "Timer.h"
+
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#define AtomicLoad(value) (*(volatile uint32_t *)(value))
+#define AtomicStore(value, newValue) (*(volatile uint32_t *)(value) = (newValue))
+#define AtomicLoadSeqCst(value) ((uint32_t)_InterlockedOr((volatile long *)(value), 0))
+#define AtomicStoreSeqCst(value, newValue) _InterlockedExchange((volatile long *)(value), (long)(newValue))
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#define AtomicLoad(value) __atomic_load_n((value), __ATOMIC_ACQUIRE)
+#define AtomicStore(value, newValue) __atomic_store_n((value), (newValue), __ATOMIC_RELEASE)
+#define AtomicLoadSeqCst(value) __atomic_load_n((value), __ATOMIC_SEQ_CST)
+#define AtomicStoreSeqCst(value, newValue) __atomic_store_n((value), (newValue), __ATOMIC_SEQ_CST)
+#endif
+
+#define PROFILER_THREAD_NAME_SIZE 32
+
+enum ProfilerEventType {
+	PROFILER_EVENT_SCOPE,
+	PROFILER_EVENT_COUNTER
+};
+
+struct ProfilerEvent {
+	const char *name;
+	uint64_t start;
+	uint64_t duration; // the sampled value for counters
+	enum ProfilerEventType type;
+};
+
+struct ProfilerThread {
+	char name[PROFILER_THREAD_NAME_SIZE];
+	struct ProfilerEvent *events; // ring of PROFILER_RING_SIZE, written only by the owning thread
+	uint32_t eventCount; // total written this capture, the ring index is this modulo the size
+	uint32_t pushing; // set by the owner while it checks s_Enabled and writes an event
+	bool released; // the owner exited, its events are exported until another thread claims the slot
+
+	const char *stackNames[PROFILER_MAX_DEPTH];
+	uint64_t stackStarts[PROFILER_MAX_DEPTH]; // 0 for scopes opened while disabled
+	uint32_t depth;
+};
+
+static struct ProfilerThread s_Threads[PROFILER_MAX_THREADS];
+static uint32_t s_ThreadCount = 0; // slots ever claimed, released ones are reused once all were
+static uint32_t s_Enabled = 0;
+static bool s_Initialized = false;
+
+// held while slots are claimed, released or renamed and while the trace is written, so no slot changes meanwhile
+static SDL_SpinLock s_SlotLock = 0;
+
+static PROFILER_THREAD_LOCAL struct ProfilerThread *t_Thread = NULL;
+static PROFILER_THREAD_LOCAL bool t_Unregistered = false;
+
+/**
+ * @param name NULL to name the slot after its index
+ */
+static struct ProfilerThread *ClaimSlot(const char *name, uint32_t *index)
+{
+	SDL_AtomicLock(&s_SlotLock);
+
+	// unused slots first, reusing a released one drops the events its previous owner recorded
+	struct ProfilerThread *thread = NULL;
+	if (s_ThreadCount < PROFILER_MAX_THREADS)
+	{
+		*index = s_ThreadCount;
+		thread = &s_Threads[*index];
+		thread->events = malloc(PROFILER_RING_SIZE * sizeof(struct ProfilerEvent));
+		if (thread->events == NULL)
+		{
+			fprintf(stderr, "Could not allocate the profiler ring\n");
+			abort();
+		}
+		AtomicStore(&s_ThreadCount, s_ThreadCount + 1);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < PROFILER_MAX_THREADS && thread == NULL; ++i)
+		{
+			if (s_Threads[i].released)
+			{
+				*index = i;
+				thread = &s_Threads[i];
+			}
+		}
+	}
+
+	if (thread != NULL)
+	{
+		thread->eventCount = 0;
+		thread->released = false;
+		thread->depth = 0;
+		if (name != NULL)
+		{
+			snprintf(thread->name, sizeof thread->name, "%s", name);
+		}
+		else
+		{
+			snprintf(thread->name, sizeof thread->name, "Thread %u", *index);
+		}
+	}
+
+	SDL_AtomicUnlock(&s_SlotLock);
+
+	return thread;
+}
+
+static void ReleaseSlot(struct ProfilerThread *thread)
+{
+	SDL_AtomicLock(&s_SlotLock);
+	thread->released = true;
+	SDL_AtomicUnlock(&s_SlotLock);
+}
+
+static struct ProfilerThread *RegisterThread()
+{
+	if (t_Thread != NULL || t_Unregistered || !s_Initialized)
+	{
+		return t_Thread;
+	}
+
+	uint32_t index;
+	struct ProfilerThread *thread = ClaimSlot(NULL, &index);
+	if (thread == NULL)
+	{
+		// remember the failure so this thread does not keep claiming slots
+		t_Unregistered = true;
+		return NULL;
+	}
+
+	t_Thread = thread;
+
+	return thread;
+}
+
+static void PushEvent(struct ProfilerThread *thread, enum ProfilerEventType type, const char *name, uint64_t start,
+		      uint64_t duration)
+{
+	// announced before recording is checked, so StopRecording either sees this write or this sees it stopped
+	AtomicStoreSeqCst(&thread->pushing, 1);
+	if (AtomicLoadSeqCst(&s_Enabled) != 0)
+	{
+		uint32_t eventCount = thread->eventCount;
+		struct ProfilerEvent *event = &thread->events[eventCount % PROFILER_RING_SIZE];
+		event->name = name;
+		event->start = start;
+		event->duration = duration;
+		event->type = type;
+
+		AtomicStore(&thread->eventCount, eventCount + 1);
+	}
+	AtomicStore(&thread->pushing, 0);
+}
+
+/**
+ * Stops recording and waits for the events being written, no ring changes until recording starts again
+ * @return whether it was recording
+ */
+static bool StopRecording()
+{
+	bool recording = AtomicLoad(&s_Enabled) != 0;
+	AtomicStoreSeqCst(&s_Enabled, 0);
+
+	uint32_t threadCount = AtomicLoad(&s_ThreadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		while (AtomicLoadSeqCst(&s_Threads[i].pushing) != 0)
+		{
+		}
+	}
+
+	return recording;
+}
+
+void Profiler_Init(bool enabled)
+{
+	memset(s_Threads, 0, sizeof s_Threads);
+	s_ThreadCount = 0;
+	s_Initialized = true;
+	s_Enabled = enabled ? 1 : 0;
+
+	Profiler_SetThreadName("Main");
+}
+
+void Profiler_Shutdown()
+{
+	StopRecording();
+	s_Initialized = false;
+
+	for (uint32_t i = 0; i < s_ThreadCount; ++i)
+	{
+		free(s_Threads[i].events);
+		s_Threads[i].events = NULL;
+	}
+
+	s_ThreadCount = 0;
+	t_Thread = NULL;
+}
+
+void Profiler_SetEnabled(bool enabled)
+{
+	if (!enabled)
+	{
+		StopRecording();
+		return;
+	}
+
+	if (AtomicLoad(&s_Enabled) != 0)
+	{
+		return;
+	}
+
+	// nothing writes the rings while stopped, so a new capture starts them over
+	SDL_AtomicLock(&s_SlotLock);
+	for (uint32_t i = 0; i < s_ThreadCount; ++i)
+	{
+		AtomicStore(&s_Threads[i].eventCount, 0);
+	}
+	SDL_AtomicUnlock(&s_SlotLock);
+
+	AtomicStoreSeqCst(&s_Enabled, 1);
+}
+
+bool Profiler_IsEnabled()
+{
+	return AtomicLoad(&s_Enabled) != 0;
+}
+
+void Profiler_SetThreadName(const char *name)
+{
+	struct ProfilerThread *thread = RegisterThread();
+	if (thread != NULL)
+	{
+		SDL_AtomicLock(&s_SlotLock);
+		snprintf(thread->name, sizeof thread->name, "%s", name);
+		SDL_AtomicUnlock(&s_SlotLock);
+	}
+}
+
+void Profiler_ReleaseThread()
+{
+	if (t_Thread != NULL)
+	{
+		ReleaseSlot(t_Thread);
+	}
+
+	t_Thread = NULL;
+	t_Unregistered = true;
+}
+
+void Profiler_Begin(const char *name)
+{
+	if (!s_Initialized)
+	{
+		return;
+	}
+
+	struct ProfilerThread *thread = t_Thread != NULL ? t_Thread : RegisterThread();
+	if (thread == NULL)
+	{
+		return;
+	}
+
+	uint32_t depth = thread->depth++;
+	if (depth < PROFILER_MAX_DEPTH)
+	{
+		thread->stackNames[depth] = name;
+		thread->stackStarts[depth] = AtomicLoad(&s_Enabled) != 0 ? Timer_Ticks() : 0;
+	}
+}
+
+void Profiler_End()
+{
+	uint64_t end = Timer_Ticks();
+
+	struct ProfilerThread *thread = t_Thread;
+	if (!s_Initialized || thread == NULL || thread->depth == 0)
+	{
+		return;
+	}
+
+	uint32_t depth = --thread->depth;
+	if (depth >= PROFILER_MAX_DEPTH || thread->stackStarts[depth] == 0 || AtomicLoad(&s_Enabled) == 0)
+	{
+		return;
+	}
+
+	PushEvent(thread, PROFILER_EVENT_SCOPE, thread->stackNames[depth], thread->stackStarts[depth],
+		  end - thread->stackStarts[depth]);
+}
+
+int32_t Profiler_RegisterTrack(const char *name)
+{
+	if (!s_Initialized)
+	{
+		return -1;
+	}
+
+	uint32_t index;
+	if (ClaimSlot(name, &index) == NULL)
+	{
+		return -1;
+	}
+
+	return (int32_t)index;
+}
+
+void Profiler_ReleaseTrack(int32_t track)
+{
+	if (s_Initialized && track >= 0)
+	{
+		ReleaseSlot(&s_Threads[track]);
+	}
+}
+
+void Profiler_AddScope(int32_t track, const char *name, uint64_t startTicks, uint64_t durationTicks)
+{
+	if (AtomicLoad(&s_Enabled) == 0 || !s_Initialized || track < 0)
+	{
+		return;
+	}
+
+	PushEvent(&s_Threads[track], PROFILER_EVENT_SCOPE, name, startTicks, durationTicks);
+}
+
+void Profiler_AddCounter(int32_t track, const char *name, uint64_t ticks, uint64_t value)
+{
+	if (AtomicLoad(&s_Enabled) == 0 || !s_Initialized || track < 0)
+	{
+		return;
+	}
+
+	PushEvent(&s_Threads[track], PROFILER_EVENT_COUNTER, name, ticks, value);
+}
+
+static void WriteJsonString(FILE *file, const char *text)
+{
+	fputc('"', file);
+	for (; *text != '\0'; ++text)
+	{
+		if (*text == '"' || *text == '\\')
+		{
+			fputc('\\', file);
+		}
+		fputc(*text, file);
+	}
+	fputc('"', file);
+}
+
+static double TicksToMicroseconds(uint64_t ticks)
+{
+	return Timer_TicksToSeconds(ticks) * 1000000.0;
+}
+
+bool Profiler_WriteChromeTrace(const char *fileName)
+{
+	FILE *file = fopen(fileName, "w");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Could not open %s for the trace\n", fileName);
+		return false;
+	}
+
+	// the rings are read while nothing writes them, recording resumes afterwards if it was on
+	bool recording = StopRecording();
+	SDL_AtomicLock(&s_SlotLock);
+
+	uint64_t startTicks = Timer_StartTicks();
+	uint32_t threadCount = s_ThreadCount;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+	uint64_t exported = 0;
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		const struct ProfilerThread *thread = &s_Threads[i];
+
+		fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", i);
+		WriteJsonString(file, thread->name);
+		fprintf(file, "}}");
+		first = false;
+
+		if (thread->events == NULL)
+		{
+			continue;
+		}
+
+		uint32_t eventCount = thread->eventCount;
+		uint32_t oldest = eventCount > PROFILER_RING_SIZE ? eventCount - PROFILER_RING_SIZE : 0;
+		for (uint32_t e = oldest; e < eventCount; ++e)
+		{
+			const struct ProfilerEvent *event = &thread->events[e % PROFILER_RING_SIZE];
+			uint64_t start = event->start > startTicks ? event->start - startTicks : 0;
+
+			if (event->type == PROFILER_EVENT_COUNTER)
+			{
+				fprintf(file, ",\n{\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":", i,
+					TicksToMicroseconds(start));
+				WriteJsonString(file, event->name);
+				fprintf(file, ",\"args\":{\"value\":%llu}}", (unsigned long long)event->duration);
+				continue;
+			}
+
+			fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", i,
+				TicksToMicroseconds(start), TicksToMicroseconds(event->duration));
+			WriteJsonString(file, event->name);
+			fputc('}', file);
+		}
+
+		exported += eventCount - oldest;
+	}
+
+	fprintf(file, "\n]}\n");
+
+	SDL_AtomicUnlock(&s_SlotLock);
+	if (recording)
+	{
+		AtomicStoreSeqCst(&s_Enabled, 1);
+	}
+
+	bool success = ferror(file) == 0;
+	success = fclose(file) == 0 && success;
+
+	printf("Wrote %llu profiler scopes to %s\n", (unsigned long long)exported, fileName);
+
+	return success;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// completed scopes kept per thread, older ones are overwritten
+#define PROFILER_RING_SIZE 16384
+// threads and tracks at once, the slots of released ones are reused
+#define PROFILER_MAX_THREADS 16
+#define PROFILER_MAX_DEPTH 64
+
+/*
+ * Scopes nest per thread and must be closed on every return path.
+ * Names must be string literals or otherwise outlive the trace export.
+ * Build with OHNONO_DISABLE_PROFILER to compile the scopes out entirely.
+ */
+#ifdef OHNONO_DISABLE_PROFILER
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#else
+#define PROFILE_BEGIN(name) Profiler_Begin(name)
+#define PROFILE_END() Profiler_End()
+#endif
+#define PROFILE_FUNCTION_BEGIN() PROFILE_BEGIN(__func__)
+
+/**
+ * Requires Timer_Start to have been called
+ * @param enabled whether scopes are recorded from the start
+ */
+void Profiler_Init(bool enabled);
+void Profiler_Shutdown();
+
+/**
+ * Toggles recording at runtime, from one thread only. Disabled scopes cost a thread-local access and a branch.
+ * Enabling starts a new capture without the scopes of the previous one,
+ * disabling returns once the scopes other threads were recording are written.
+ */
+void Profiler_SetEnabled(bool enabled);
+bool Profiler_IsEnabled();
+
+/**
+ * Names the calling thread in exported traces
+ */
+void Profiler_SetThreadName(const char *name);
+
+/**
+ * Frees the calling thread's slot for threads created later, call it before the thread exits.
+ * Its scopes are still exported until another thread takes the slot.
+ */
+void Profiler_ReleaseThread();
+
+void Profiler_Begin(const char *name);
+void Profiler_End();
+
+/**
+ * Registers a track for scopes measured outside the CPU, e.g. on the GPU.
+ * A track must only be written from one thread at a time.
+ * @return track handle, -1 if every slot is taken
+ */
+int32_t Profiler_RegisterTrack(const char *name);
+
+/**
+ * Records a scope measured elsewhere on a track from Profiler_RegisterTrack
+ * @param startTicks Timer_Ticks based start
+ * @param durationTicks Timer_Ticks based duration
+ */
+void Profiler_AddScope(int32_t track, const char *name, uint64_t startTicks, uint64_t durationTicks);
+
+/**
+ * Records a sample of a counter on a track from Profiler_RegisterTrack, shown as a graph in the trace
+ */
+void Profiler_AddCounter(int32_t track, const char *name, uint64_t ticks, uint64_t value);
+
+/**
+ * Frees the slot of a track from Profiler_RegisterTrack, nothing may write it afterwards
+ */
+void Profiler_ReleaseTrack(int32_t track);
+
+/**
+ * Writes every recorded scope in the Chrome trace event format, viewable in chrome://tracing or Perfetto.
+ * Recording pauses while the file is written, scopes ending meanwhile are lost.
+ * @return false if the file could not be written
+ */
+bool Profiler_WriteChromeTrace(const char *fileName);
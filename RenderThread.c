@@ -0,0 +1,120 @@
+#include "RenderThread.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "Timer.h"
+
+#include <SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Single producer, single consumer ring of packets. Each side owns its index and the packets between
+ * them, so the packets themselves are handed over without locks or copies. The semaphores count free
+ * and filled packets and only put a side to sleep when it runs a full packet ahead of the other.
+ */
+static struct FramePacket s_Packets[RENDER_THREAD_PACKET_COUNT];
+static uint32_t s_WriteIndex = 0; // main thread only
+static uint32_t s_ReadIndex = 0; // render thread only
+static SDL_sem *s_FreePackets = NULL;
+static SDL_sem *s_FilledPackets = NULL;
+static SDL_Thread *s_Thread = NULL;
+
+static int RenderThreadMain(void *data)
+{
+	Profiler_SetThreadName("Render");
+
+	for (;;)
+	{
+		PROFILE_BEGIN("WaitForPacket");
+		uint64_t waitStart = Timer_Ticks();
+		SDL_SemWait(s_FilledPackets);
+		uint64_t waitTicks = Timer_Ticks() - waitStart;
+		PROFILE_END();
+
+		struct FramePacket *packet = &s_Packets[s_ReadIndex];
+		s_ReadIndex = (s_ReadIndex + 1) % RENDER_THREAD_PACKET_COUNT;
+
+		if (packet->quit)
+		{
+			break;
+		}
+
+		// idle either way, the part the main thread spent in the frame limiter is told apart
+		uint64_t limiterTicks = packet->limiterTicks < waitTicks ? packet->limiterTicks : waitTicks;
+		FrameStats_AddWait(FRAME_STATS_WAIT_LIMITER, limiterTicks);
+		FrameStats_AddWait(FRAME_STATS_WAIT_PACKET, waitTicks - limiterTicks);
+
+		DrawFrame(packet);
+
+		SDL_SemPost(s_FreePackets);
+	}
+
+	Profiler_ReleaseThread();
+	return 0;
+}
+
+void RenderThread_Start()
+{
+	assert(s_Thread == NULL);
+
+	s_WriteIndex = 0;
+	s_ReadIndex = 0;
+	for (uint32_t i = 0; i < RENDER_THREAD_PACKET_COUNT; ++i)
+	{
+		CreateFramePacket(&s_Packets[i]);
+	}
+	s_FreePackets = SDL_CreateSemaphore(RENDER_THREAD_PACKET_COUNT);
+	s_FilledPackets = SDL_CreateSemaphore(0);
+	if (s_FreePackets == NULL || s_FilledPackets == NULL)
+	{
+		printf("Could not create render thread semaphores: %s\n", SDL_GetError());
+		abort();
+	}
+
+	s_Thread = SDL_CreateThread(RenderThreadMain, "Render", NULL);
+	if (s_Thread == NULL)
+	{
+		printf("Could not create render thread: %s\n", SDL_GetError());
+		abort();
+	}
+}
+
+struct FramePacket *RenderThread_AcquirePacket()
+{
+	// the render thread is busy meanwhile, so this is not a wait of the frames FrameStats measures
+	PROFILE_BEGIN("WaitForRenderThread");
+	SDL_SemWait(s_FreePackets);
+	PROFILE_END();
+
+	struct FramePacket *packet = &s_Packets[s_WriteIndex];
+	packet->quit = false;
+
+	return packet;
+}
+
+void RenderThread_Submit()
+{
+	s_WriteIndex = (s_WriteIndex + 1) % RENDER_THREAD_PACKET_COUNT;
+	SDL_SemPost(s_FilledPackets);
+}
+
+void RenderThread_Stop()
+{
+	struct FramePacket *packet = RenderThread_AcquirePacket();
+	packet->quit = true;
+	RenderThread_Submit();
+
+	SDL_WaitThread(s_Thread, NULL);
+	s_Thread = NULL;
+
+	SDL_DestroySemaphore(s_FreePackets);
+	SDL_DestroySemaphore(s_FilledPackets);
+	s_FreePackets = NULL;
+	s_FilledPackets = NULL;
+
+	for (uint32_t i = 0; i < RENDER_THREAD_PACKET_COUNT; ++i)
+	{
+		DestroyFramePacket(&s_Packets[i]);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "InternalVulkan.h"
+
+// packets in flight between the threads, one being simulated while the other is drawn
+#define RENDER_THREAD_PACKET_COUNT 2
+
+/**
+ * Starts the thread that calls DrawFrame for every submitted packet.
+ * From here on only the render thread may touch the renderer, until RenderThread_Stop returns.
+ */
+void RenderThread_Start();
+
+/**
+ * Blocks until the render thread has released a packet, which the caller then fills in place
+ * @return packet owned by the calling thread until RenderThread_Submit
+ */
+struct FramePacket *RenderThread_AcquirePacket();
+
+/**
+ * Hands the packet from RenderThread_AcquirePacket to the render thread
+ */
+void RenderThread_Submit();
+
+/**
+ * Draws every submitted packet, then joins the thread
+ */
+void RenderThread_Stop();
@@ -4,12 +4,112 @@
 
 #include "Timer.h"
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <stdbool.h>
 #include <stdint.h>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TIMER_HAS_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+// long enough for the TSC to counter ratio to be accurate to a few ppm
+#define TIMER_CALIBRATION_SECONDS 0.01
+// the tail of a Timer_SleepUntil that is spun instead of slept, covers the usual scheduler wakeup latency
+#define TIMER_SPIN_SECONDS 0.002
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
 static double freq = 0.0;
 static uint64_t start = 0;
 
+static bool useTsc = false;
+static double tickFreq = 0.0;
+static uint64_t tickStart = 0;
+
+#ifdef _WIN32
+// Sleep is only accurate to the 15.6 ms system tick, high resolution timers are not (Windows 10 1803+)
+static HANDLE sleepTimer = NULL;
+#endif
+
+static uint64_t QueryCounter()
+{
+#ifdef _WIN32
+	LARGE_INTEGER largeInteger;
+	QueryPerformanceCounter(&largeInteger);
+	return largeInteger.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+#ifdef TIMER_HAS_RDTSC
+// only an invariant TSC ticks at a constant rate across power states and cores
+static bool HasInvariantTsc()
+{
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 0x80000000);
+	if ((unsigned)registers[0] < 0x80000007u)
+	{
+		return false;
+	}
+	__cpuid(registers, 0x80000007);
+	return (registers[3] & (1 << 8)) != 0;
+#else
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid_max(0x80000000u, NULL) < 0x80000007u)
+	{
+		return false;
+	}
+	__cpuid(0x80000007u, eax, ebx, ecx, edx);
+	return (edx & (1u << 8)) != 0;
+#endif
+}
+#endif
+
+static void CalibrateTicks()
+{
+	useTsc = false;
+	tickFreq = freq;
+
+#ifdef TIMER_HAS_RDTSC
+	if (!HasInvariantTsc())
+	{
+		return;
+	}
+
+	uint64_t counterBegin = QueryCounter();
+	uint64_t tscBegin = __rdtsc();
+
+	uint64_t counterEnd;
+	do
+	{
+		counterEnd = QueryCounter();
+	} while ((double)(counterEnd - counterBegin) < TIMER_CALIBRATION_SECONDS * freq);
+
+	uint64_t tscEnd = __rdtsc();
+
+	tickFreq = (double)(tscEnd - tscBegin) * freq / (double)(counterEnd - counterBegin);
+	useTsc = true;
+#endif
+}
+
 double Timer_StartTime()
 {
 	return start;
@@ -17,19 +117,110 @@ double Timer_StartTime()
 
 double Timer_Now()
 {
-	LARGE_INTEGER largeInteger;
-	QueryPerformanceCounter(&largeInteger);
+	return (double)(QueryCounter() - start) / freq;
+}
 
-	return (double)(largeInteger.QuadPart - start) / freq;
+uint64_t Timer_Ticks()
+{
+#ifdef TIMER_HAS_RDTSC
+	if (useTsc)
+	{
+		return __rdtsc();
+	}
+#endif
+	return QueryCounter();
+}
+
+uint64_t Timer_StartTicks()
+{
+	return tickStart;
+}
+
+double Timer_TicksToSeconds(uint64_t ticks)
+{
+	return (double)ticks / tickFreq;
+}
+
+uint64_t Timer_SecondsToTicks(double seconds)
+{
+	return (uint64_t)(seconds * tickFreq);
+}
+
+static void SleepSeconds(double seconds)
+{
+#ifdef _WIN32
+	if (sleepTimer != NULL)
+	{
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)(seconds * 10000000.0); // relative, in 100 ns units
+		if (SetWaitableTimer(sleepTimer, &dueTime, 0, NULL, NULL, FALSE))
+		{
+			WaitForSingleObject(sleepTimer, INFINITE);
+			return;
+		}
+	}
+	Sleep((DWORD)(seconds * 1000.0));
+#else
+	struct timespec duration = { .tv_sec = (time_t)seconds,
+				     .tv_nsec = (long)((seconds - (double)(time_t)seconds) * 1000000000.0) };
+	nanosleep(&duration, NULL);
+#endif
+}
+
+static void SpinPause()
+{
+#ifdef TIMER_HAS_RDTSC
+	_mm_pause();
+#endif
+}
+
+void Timer_SleepUntil(uint64_t ticks)
+{
+	uint64_t spinTicks = Timer_SecondsToTicks(TIMER_SPIN_SECONDS);
+
+	// sleeps can overshoot or be cut short, so sleep in steps until only the spin is left
+	for (;;)
+	{
+		uint64_t now = Timer_Ticks();
+		if (now >= ticks)
+		{
+			return;
+		}
+
+		uint64_t remaining = ticks - now;
+		if (remaining <= spinTicks)
+		{
+			break;
+		}
+
+		SleepSeconds(Timer_TicksToSeconds(remaining - spinTicks));
+	}
+
+	while (Timer_Ticks() < ticks)
+	{
+		SpinPause();
+	}
 }
 
 void Timer_Start()
 {
+#ifdef _WIN32
 	LARGE_INTEGER largeInteger;
 	QueryPerformanceFrequency(&largeInteger);
 
 	freq = (double)largeInteger.QuadPart;
 
-	QueryPerformanceCounter(&largeInteger);
-	start = largeInteger.QuadPart;
-}
\ No newline at end of file
+	if (sleepTimer == NULL)
+	{
+		sleepTimer =
+			CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	}
+#else
+	freq = 1000000000.0;
+#endif
+
+	CalibrateTicks();
+
+	start = QueryCounter();
+	tickStart = Timer_Ticks();
+}
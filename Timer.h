@@ -4,6 +4,26 @@
 
 #pragma once
 
+#include <stdint.h>
+
+/**
+ * Starts the clock. Calibrates the TSC against the OS counter, which takes about 10 ms.
+ */
 void Timer_Start();
 double Timer_Now();
-double Timer_StartTime();
\ No newline at end of file
+double Timer_StartTime();
+
+/**
+ * Cheapest available timestamp: the invariant TSC when present, otherwise QueryPerformanceCounter
+ * or CLOCK_MONOTONIC. Only meaningful relative to other ticks, convert with Timer_TicksToSeconds.
+ */
+uint64_t Timer_Ticks();
+uint64_t Timer_StartTicks();
+double Timer_TicksToSeconds(uint64_t ticks);
+uint64_t Timer_SecondsToTicks(double seconds);
+
+/**
+ * Sleeps until Timer_Ticks reaches ticks, spinning through the last couple of milliseconds for precision.
+ * Returns immediately if the time has already passed.
+ */
+void Timer_SleepUntil(uint64_t ticks);
@@ -0,0 +1,257 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "Transform.h"
+#include "Profiler.h"
+#include "external/cglm/affine-mat.h"
+#include "external/cglm/mat4.h"
+#include "external/cglm/quat.h"
+#include "external/cglm/vec3.h"
+#include "external/cglm/vec4.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cglm loads matrices with aligned SSE and AVX loads
+#define TRANSFORM_ALIGNMENT 32
+
+static void *AllocateArray(uint32_t capacity, size_t elementSize)
+{
+	// an empty hierarchy still gets valid pointers
+	size_t size = (size_t)(capacity > 0 ? capacity : 1) * elementSize;
+	void *array = NULL;
+#ifdef _WIN32
+	array = _aligned_malloc(size, TRANSFORM_ALIGNMENT);
+#else
+	if (posix_memalign(&array, TRANSFORM_ALIGNMENT, size) != 0)
+	{
+		array = NULL;
+	}
+#endif
+	if (array == NULL)
+	{
+		printf("Could not allocate transforms for %u nodes\n", capacity);
+		abort();
+	}
+
+	return array;
+}
+
+static void FreeArray(void *array)
+{
+#ifdef _WIN32
+	_aligned_free(array);
+#else
+	free(array);
+#endif
+}
+
+// a sorted dirty list costs k log k, past this share of the hierarchy scanning the flags is cheaper
+#define TRANSFORM_SCAN_FRACTION 64
+
+static void MarkDirty(struct TransformHierarchy *hierarchy, uint32_t node)
+{
+	assert(node < hierarchy->count);
+
+	if (!hierarchy->localDirty[node])
+	{
+		hierarchy->localDirty[node] = true;
+		hierarchy->dirty[hierarchy->dirtyCount++] = node;
+	}
+}
+
+// translation * rotation * scale, written directly instead of multiplying three matrices
+static void ComposeLocal(vec3 position, versor rotation, vec3 scale, mat4 dest)
+{
+	float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+	float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+	float xy = 2.0f * x * y, yz = 2.0f * y * z, xz = 2.0f * x * z;
+	float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+
+	dest[0][0] = (1.0f - yy - zz) * scale[0];
+	dest[0][1] = (xy + wz) * scale[0];
+	dest[0][2] = (xz - wy) * scale[0];
+	dest[0][3] = 0.0f;
+
+	dest[1][0] = (xy - wz) * scale[1];
+	dest[1][1] = (1.0f - xx - zz) * scale[1];
+	dest[1][2] = (yz + wx) * scale[1];
+	dest[1][3] = 0.0f;
+
+	dest[2][0] = (xz + wy) * scale[2];
+	dest[2][1] = (yz - wx) * scale[2];
+	dest[2][2] = (1.0f - xx - yy) * scale[2];
+	dest[2][3] = 0.0f;
+
+	dest[3][0] = position[0];
+	dest[3][1] = position[1];
+	dest[3][2] = position[2];
+	dest[3][3] = 1.0f;
+}
+
+/**
+ * Rebuilds the world matrices of the subtree starting at node, which must not be inside another dirty subtree.
+ * @return end of the subtree
+ */
+static uint32_t UpdateSubtree(struct TransformHierarchy *hierarchy, uint32_t node)
+{
+	const uint32_t *parents = hierarchy->parents;
+	bool *localDirty = hierarchy->localDirty;
+	mat4 *locals = hierarchy->locals;
+	mat4 *worlds = hierarchy->worlds;
+	uint32_t *updated = hierarchy->updated + hierarchy->updatedCount;
+	uint32_t end = hierarchy->subtreeEnds[node];
+
+	// dirty nodes further down are rare, so their local matrices are rebuilt first to keep the multiply loop tight
+	for (uint32_t i = node; i < end; ++i)
+	{
+		if (localDirty[i])
+		{
+			ComposeLocal(hierarchy->positions[i], hierarchy->rotations[i], hierarchy->scales[i], locals[i]);
+			localDirty[i] = false;
+		}
+	}
+
+	if (parents[node] == TRANSFORM_ROOT)
+	{
+		glm_mat4_copy(locals[node], worlds[node]);
+	}
+	else
+	{
+		glm_mul(worlds[parents[node]], locals[node], worlds[node]);
+	}
+	updated[0] = node;
+
+	// the batch multiply, every parent is earlier in the range or is the start, so it is already final.
+	// TRS matrices are affine, cglm's affine multiply skips the bottom row with SSE2 or AVX as the build allows.
+	for (uint32_t i = node + 1; i < end; ++i)
+	{
+		glm_mul(worlds[parents[i]], locals[i], worlds[i]);
+		updated[i - node] = i;
+	}
+
+	hierarchy->updatedCount += end - node;
+	return end;
+}
+
+static int CompareNodes(const void *a, const void *b)
+{
+	uint32_t nodeA = *(const uint32_t *)a;
+	uint32_t nodeB = *(const uint32_t *)b;
+	return nodeA < nodeB ? -1 : nodeA > nodeB ? 1 : 0;
+}
+
+void Transform_CreateHierarchy(struct TransformHierarchy *hierarchy, uint32_t capacity)
+{
+	hierarchy->parents = AllocateArray(capacity, sizeof(uint32_t));
+	hierarchy->subtreeEnds = AllocateArray(capacity, sizeof(uint32_t));
+	hierarchy->positions = AllocateArray(capacity, sizeof(vec3));
+	hierarchy->rotations = AllocateArray(capacity, sizeof(versor));
+	hierarchy->scales = AllocateArray(capacity, sizeof(vec3));
+	hierarchy->locals = AllocateArray(capacity, sizeof(mat4));
+	hierarchy->worlds = AllocateArray(capacity, sizeof(mat4));
+	hierarchy->localDirty = AllocateArray(capacity, sizeof(bool));
+	hierarchy->dirty = AllocateArray(capacity, sizeof(uint32_t));
+	hierarchy->updated = AllocateArray(capacity, sizeof(uint32_t));
+	hierarchy->dirtyCount = 0;
+	hierarchy->updatedCount = 0;
+	hierarchy->count = 0;
+	hierarchy->capacity = capacity;
+}
+
+void Transform_DestroyHierarchy(struct TransformHierarchy *hierarchy)
+{
+	FreeArray(hierarchy->parents);
+	FreeArray(hierarchy->subtreeEnds);
+	FreeArray(hierarchy->positions);
+	FreeArray(hierarchy->rotations);
+	FreeArray(hierarchy->scales);
+	FreeArray(hierarchy->locals);
+	FreeArray(hierarchy->worlds);
+	FreeArray(hierarchy->localDirty);
+	FreeArray(hierarchy->dirty);
+	FreeArray(hierarchy->updated);
+	memset(hierarchy, 0, sizeof(struct TransformHierarchy));
+}
+
+uint32_t Transform_AddNode(struct TransformHierarchy *hierarchy, uint32_t parent)
+{
+	if (hierarchy->count == hierarchy->capacity)
+	{
+		printf("Transform hierarchy is full at %u nodes\n", hierarchy->capacity);
+		abort();
+	}
+	// a parent whose subtree ends before the new node would split it
+	assert(parent == TRANSFORM_ROOT ||
+	       (parent < hierarchy->count && hierarchy->subtreeEnds[parent] == hierarchy->count));
+
+	uint32_t node = hierarchy->count++;
+	hierarchy->parents[node] = parent;
+	hierarchy->subtreeEnds[node] = node + 1;
+	for (uint32_t ancestor = parent; ancestor != TRANSFORM_ROOT; ancestor = hierarchy->parents[ancestor])
+	{
+		hierarchy->subtreeEnds[ancestor] = node + 1;
+	}
+
+	glm_vec3_zero(hierarchy->positions[node]);
+	glm_quat_identity(hierarchy->rotations[node]);
+	glm_vec3_one(hierarchy->scales[node]);
+	hierarchy->localDirty[node] = false;
+	MarkDirty(hierarchy, node);
+
+	return node;
+}
+
+void Transform_SetPosition(struct TransformHierarchy *hierarchy, uint32_t node, vec3 position)
+{
+	MarkDirty(hierarchy, node);
+	glm_vec3_copy(position, hierarchy->positions[node]);
+}
+
+void Transform_SetRotation(struct TransformHierarchy *hierarchy, uint32_t node, versor rotation)
+{
+	MarkDirty(hierarchy, node);
+	glm_vec4_copy(rotation, hierarchy->rotations[node]);
+}
+
+void Transform_SetScale(struct TransformHierarchy *hierarchy, uint32_t node, vec3 scale)
+{
+	MarkDirty(hierarchy, node);
+	glm_vec3_copy(scale, hierarchy->scales[node]);
+}
+
+uint32_t Transform_Update(struct TransformHierarchy *hierarchy)
+{
+	PROFILE_FUNCTION_BEGIN();
+
+	hierarchy->updatedCount = 0;
+
+	// subtrees are visited in increasing order, dirty nodes inside one already visited are skipped
+	if (hierarchy->dirtyCount * TRANSFORM_SCAN_FRACTION > hierarchy->count)
+	{
+		uint32_t node = 0;
+		while (node < hierarchy->count)
+		{
+			node = hierarchy->localDirty[node] ? UpdateSubtree(hierarchy, node) : node + 1;
+		}
+	}
+	else
+	{
+		qsort(hierarchy->dirty, hierarchy->dirtyCount, sizeof(uint32_t), CompareNodes);
+
+		uint32_t end = 0;
+		for (uint32_t i = 0; i < hierarchy->dirtyCount; ++i)
+		{
+			uint32_t node = hierarchy->dirty[i];
+			end = node < end ? end : UpdateSubtree(hierarchy, node);
+		}
+	}
+
+	hierarchy->dirtyCount = 0;
+
+	PROFILE_END();
+	return hierarchy->updatedCount;
+}
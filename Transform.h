@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "external/cglm/types.h"
+
+// parent of nodes at the top of the hierarchy
+#define TRANSFORM_ROOT UINT32_MAX
+
+/**
+ * Local translation, rotation and scale of every node with its world matrix, one array per component.
+ * Nodes are stored depth first, so every parent comes before its children and every subtree is one contiguous
+ * range, updated in a single pass in index order. Change nodes through the setters, which mark them dirty.
+ */
+struct TransformHierarchy {
+	uint32_t *parents;
+	// one past the last node of the subtree starting at each node
+	uint32_t *subtreeEnds;
+	vec3 *positions;
+	versor *rotations;
+	vec3 *scales;
+	// cached so a node moved only by its parent skips rebuilding its own matrix
+	mat4 *locals;
+	mat4 *worlds;
+	bool *localDirty;
+	// nodes marked dirty since the last update, each once
+	uint32_t *dirty;
+	uint32_t dirtyCount;
+	// nodes whose world matrix the last update changed, in increasing order
+	uint32_t *updated;
+	uint32_t updatedCount;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+void Transform_CreateHierarchy(struct TransformHierarchy *hierarchy, uint32_t capacity);
+void Transform_DestroyHierarchy(struct TransformHierarchy *hierarchy);
+
+/**
+ * Appends a node with the identity transform. Build depth first: the parent is the last node added or one of
+ * its ancestors.
+ * @param parent an existing node or TRANSFORM_ROOT
+ * @return index of the node
+ */
+uint32_t Transform_AddNode(struct TransformHierarchy *hierarchy, uint32_t parent);
+
+void Transform_SetPosition(struct TransformHierarchy *hierarchy, uint32_t node, vec3 position);
+/**
+ * @param rotation unit quaternion
+ */
+void Transform_SetRotation(struct TransformHierarchy *hierarchy, uint32_t node, versor rotation);
+void Transform_SetScale(struct TransformHierarchy *hierarchy, uint32_t node, vec3 scale);
+
+/**
+ * Rebuilds the world matrices of the subtrees under the dirty nodes, the rest of the hierarchy is not visited.
+ * The changed nodes are listed in updated.
+ * @return number of world matrices changed
+ */
+uint32_t Transform_Update(struct TransformHierarchy *hierarchy);
@@ -0,0 +1,218 @@
+/*
+ * Times Transform_Update on a generated hierarchy: with every root moving, so every world matrix is rebuilt,
+ * and with a fraction of random nodes moving, so only their subtrees are.
+ * The result is checked against world matrices built from scratch with cglm.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <argtable3.h>
+
+#include "external/cglm/affine.h"
+#include "external/cglm/quat.h"
+
+#include "Profiler.h"
+#include "Timer.h"
+#include "Transform.h"
+
+#define MAX_DEPTH 16
+#define MAX_ERROR 1e-3f
+
+static float RandomFloat(float min, float max)
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static void RandomRotation(versor rotation)
+{
+	vec3 axis = { RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) + 2.0f };
+	glm_vec3_normalize(axis);
+	glm_quatv(rotation, RandomFloat(0.0f, GLM_PIf), axis);
+}
+
+// a random walk up and down the path to the last node added, which keeps the nodes depth first
+static void BuildHierarchy(struct TransformHierarchy *hierarchy, uint32_t nodeCount, uint32_t rootCount)
+{
+	uint32_t path[MAX_DEPTH];
+	uint32_t depth = 0;
+	uint32_t nodesPerRoot = nodeCount / rootCount;
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		uint32_t choice = (uint32_t)rand() % 4;
+		if (i % nodesPerRoot == 0 && i / nodesPerRoot < rootCount)
+		{
+			depth = 0;
+		}
+		else if (choice == 1 && depth > 2)
+		{
+			// a sibling of its parent
+			depth -= 2;
+		}
+		else if ((choice != 0 || depth == MAX_DEPTH) && depth > 1)
+		{
+			// a sibling
+			depth -= 1;
+		}
+		// otherwise a child of the last node
+
+		uint32_t parent = depth == 0 ? TRANSFORM_ROOT : path[depth - 1];
+		path[depth++] = Transform_AddNode(hierarchy, parent);
+	}
+
+	for (uint32_t node = 0; node < nodeCount; ++node)
+	{
+		vec3 position = { RandomFloat(-2.0f, 2.0f), RandomFloat(-2.0f, 2.0f), RandomFloat(-2.0f, 2.0f) };
+		vec3 scale = { RandomFloat(0.5f, 1.5f), RandomFloat(0.5f, 1.5f), RandomFloat(0.5f, 1.5f) };
+		versor rotation;
+		RandomRotation(rotation);
+		Transform_SetPosition(hierarchy, node, position);
+		Transform_SetRotation(hierarchy, node, rotation);
+		Transform_SetScale(hierarchy, node, scale);
+	}
+}
+
+static float Verify(const struct TransformHierarchy *hierarchy, mat4 *reference)
+{
+	float maxError = 0.0f;
+	for (uint32_t node = 0; node < hierarchy->count; ++node)
+	{
+		mat4 local;
+		glm_translate_make(local, hierarchy->positions[node]);
+		glm_quat_rotate(local, hierarchy->rotations[node], local);
+		glm_scale(local, hierarchy->scales[node]);
+
+		uint32_t parent = hierarchy->parents[node];
+		if (parent == TRANSFORM_ROOT)
+		{
+			glm_mat4_copy(local, reference[node]);
+		}
+		else
+		{
+			glm_mat4_mul(reference[parent], local, reference[node]);
+		}
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float error = fabsf(reference[node][i / 4][i % 4] - hierarchy->worlds[node][i / 4][i % 4]);
+			maxError = error > maxError ? error : maxError;
+		}
+	}
+
+	return maxError;
+}
+
+static void Report(const char *method, double *seconds, uint32_t runs, uint32_t updatedCount)
+{
+	double best = seconds[0];
+	double sum = 0.0;
+	for (uint32_t i = 0; i < runs; ++i)
+	{
+		best = seconds[i] < best ? seconds[i] : best;
+		sum += seconds[i];
+	}
+
+	printf("%-14s best %8.3f ms  average %8.3f ms  %u nodes updated\n", method, best * 1000.0, sum / runs * 1000.0,
+	       updatedCount);
+}
+
+int main(int argc, char **argv)
+{
+	struct arg_int *nodes = arg_int0("n", "nodes", "<n>", "nodes in the hierarchy (default 100000)");
+	struct arg_int *roots = arg_int0(NULL, "roots", "<n>", "nodes without a parent (default 100)");
+	struct arg_int *moving = arg_int0("m", "moving", "<percent>", "nodes moved for the partial update (default 5)");
+	struct arg_int *runs = arg_int0("r", "runs", "<n>", "runs per update (default 20)");
+	struct arg_lit *help = arg_lit0(NULL, "help", "print this help and exit");
+	struct arg_end *end = arg_end(20);
+	void *argtable[] = { nodes, roots, moving, runs, help, end };
+	const char *progname = "TransformBenchmark";
+	int exitcode = 0;
+
+	if (arg_nullcheck(argtable) != 0)
+	{
+		printf("%s: insufficient memory\n", progname);
+		exitcode = 1;
+		goto exit;
+	}
+
+	int nerrors = arg_parse(argc, argv, argtable);
+	if (help->count > 0 || nerrors > 0)
+	{
+		if (nerrors > 0)
+		{
+			arg_print_errors(stdout, end, progname);
+		}
+		printf("Usage: %s", progname);
+		arg_print_syntax(stdout, argtable, "\n");
+		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+		exitcode = nerrors > 0;
+		goto exit;
+	}
+
+	uint32_t nodeCount = nodes->count > 0 && nodes->ival[0] > 0 ? nodes->ival[0] : 100000;
+	uint32_t rootCount = roots->count > 0 && roots->ival[0] > 0 ? roots->ival[0] : 100;
+	uint32_t movingPercent = moving->count > 0 && moving->ival[0] >= 0 ? moving->ival[0] : 5;
+	uint32_t runCount = runs->count > 0 && runs->ival[0] > 0 ? runs->ival[0] : 20;
+	rootCount = rootCount < nodeCount ? rootCount : nodeCount;
+	uint32_t movingCount = (uint32_t)((uint64_t)nodeCount * (movingPercent < 100 ? movingPercent : 100) / 100);
+
+	Timer_Start();
+	Profiler_Init(false);
+
+	struct TransformHierarchy hierarchy;
+	Transform_CreateHierarchy(&hierarchy, nodeCount);
+	srand(1);
+	BuildHierarchy(&hierarchy, nodeCount, rootCount);
+	Transform_Update(&hierarchy);
+
+	mat4 *reference = malloc(nodeCount * sizeof(mat4));
+	double *seconds = malloc(runCount * sizeof(double));
+	if (reference == NULL || seconds == NULL)
+	{
+		printf("Could not allocate results for %u nodes\n", nodeCount);
+		exitcode = 1;
+		goto exit;
+	}
+
+	printf("%u nodes, %u roots, %u moving for the partial update\n", nodeCount, rootCount, movingCount);
+
+	const char *methods[] = { "full", "partial" };
+	for (uint32_t method = 0; method < 2; ++method)
+	{
+		uint32_t updatedCount = 0;
+		for (uint32_t run = 0; run < runCount; ++run)
+		{
+			// moving the roots dirties every node
+			uint32_t count = method == 0 ? rootCount : movingCount;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				uint32_t node = method == 0 ? i * (nodeCount / rootCount) : (uint32_t)rand() % nodeCount;
+				versor rotation;
+				RandomRotation(rotation);
+				Transform_SetRotation(&hierarchy, node, rotation);
+			}
+
+			uint64_t begin = Timer_Ticks();
+			updatedCount = Transform_Update(&hierarchy);
+			seconds[run] = Timer_TicksToSeconds(Timer_Ticks() - begin);
+		}
+
+		Report(methods[method], seconds, runCount, updatedCount);
+
+		float error = Verify(&hierarchy, reference);
+		if (error > MAX_ERROR)
+		{
+			printf("%s update is off by up to %f\n", methods[method], error);
+			exitcode = 1;
+		}
+	}
+
+	free(seconds);
+	free(reference);
+	Transform_DestroyHierarchy(&hierarchy);
+	Profiler_Shutdown();
+
+exit:
+	arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+	return exitcode;
+}
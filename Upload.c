@@ -0,0 +1,351 @@
+#include "Upload.h"
+#include "AsyncIO.h"
+#include "GpuAllocator.h"
+#include "Profiler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// block aligned so asset payloads can be read into staging memory with O_DIRECT
+#define UPLOAD_STAGING_ALIGNMENT ASYNC_IO_ALIGNMENT
+
+struct UploadDedicatedStaging {
+	VkBuffer buffer;
+	struct GpuAllocation memory;
+};
+
+struct UploadBatch {
+	VkCommandPool commandPool;
+	VkCommandBuffer commandBuffer;
+	uint64_t value; // timeline value the batch signals
+	uint64_t stagingEnd; // staging head when submitted, everything before it is free once value is reached
+	struct UploadDedicatedStaging *dedicated; // staging too large for the ring, freed with the batch
+	uint32_t dedicatedCount;
+	uint32_t dedicatedCapacity;
+};
+
+static VkDevice s_Device = VK_NULL_HANDLE;
+static VkQueue s_Queue = VK_NULL_HANDLE;
+static VkSemaphore s_Timeline = VK_NULL_HANDLE;
+static uint64_t s_SubmittedValue = 0;
+
+/*
+ * Batches are used round robin: [s_RetiredCount, s_SubmittedCount) are in flight and the one at
+ * s_SubmittedCount is recorded into next
+ */
+static struct UploadBatch s_Batches[UPLOAD_BATCH_COUNT];
+static uint64_t s_SubmittedCount = 0;
+static uint64_t s_RetiredCount = 0;
+static bool s_Recording = false;
+
+/*
+ * Staging offsets only ever grow, the ring offset is the remainder. Everything between the tail and the
+ * head may still be read by a batch, so an allocation fits while it ends within a ring size of the tail.
+ */
+static VkBuffer s_StagingBuffer = VK_NULL_HANDLE;
+static struct GpuAllocation s_StagingMemory;
+static uint64_t s_StagingHead = 0;
+static uint64_t s_StagingTail = 0;
+
+static VkBuffer CreateStagingBuffer(VkDeviceSize size, struct GpuAllocation *memory)
+{
+	VkBufferCreateInfo bufferCreateInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+						.pNext = NULL,
+						.flags = 0,
+						.size = size,
+						.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+						.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+						.queueFamilyIndexCount = 0,
+						.pQueueFamilyIndices = NULL };
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(s_Device, &bufferCreateInfo, NULL, &buffer) != VK_SUCCESS)
+	{
+		printf("Could not create staging buffer\n");
+		abort();
+	}
+
+	GpuAllocator_AllocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				    memory);
+	return buffer;
+}
+
+static void RetireOldest(bool wait)
+{
+	assert(s_RetiredCount < s_SubmittedCount);
+
+	struct UploadBatch *batch = &s_Batches[s_RetiredCount % UPLOAD_BATCH_COUNT];
+
+	if (wait)
+	{
+		PROFILE_BEGIN("WaitForUpload");
+		VkSemaphoreWaitInfo waitInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+						 .pNext = NULL,
+						 .flags = 0,
+						 .semaphoreCount = 1,
+						 .pSemaphores = &s_Timeline,
+						 .pValues = &batch->value };
+		vkWaitSemaphores(s_Device, &waitInfo, UINT64_MAX);
+		PROFILE_END();
+	}
+
+	for (uint32_t i = 0; i < batch->dedicatedCount; i++)
+	{
+		vkDestroyBuffer(s_Device, batch->dedicated[i].buffer, NULL);
+		GpuAllocator_Free(&batch->dedicated[i].memory);
+	}
+	batch->dedicatedCount = 0;
+
+	vkResetCommandPool(s_Device, batch->commandPool, 0);
+	if (batch->stagingEnd > s_StagingTail)
+	{
+		s_StagingTail = batch->stagingEnd;
+	}
+	s_RetiredCount++;
+}
+
+void Upload_Init(VkDevice device, VkQueue queue, uint32_t queueFamily)
+{
+	assert(s_Device == VK_NULL_HANDLE);
+
+	s_Device = device;
+	s_Queue = queue;
+
+	VkSemaphoreTypeCreateInfo typeCreateInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+						     .pNext = NULL,
+						     .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+						     .initialValue = 0 };
+
+	VkSemaphoreCreateInfo semaphoreCreateInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+						      .pNext = &typeCreateInfo,
+						      .flags = 0 };
+
+	if (vkCreateSemaphore(s_Device, &semaphoreCreateInfo, NULL, &s_Timeline) != VK_SUCCESS)
+	{
+		printf("Could not create the upload timeline semaphore\n");
+		abort();
+	}
+
+	// a pool per batch, so a retired batch is reset without touching the ones still in flight
+	for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++)
+	{
+		struct UploadBatch *batch = &s_Batches[i];
+		memset(batch, 0, sizeof(struct UploadBatch));
+
+		VkCommandPoolCreateInfo poolCreateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+							   .pNext = NULL,
+							   .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+							   .queueFamilyIndex = queueFamily };
+
+		if (vkCreateCommandPool(s_Device, &poolCreateInfo, NULL, &batch->commandPool) != VK_SUCCESS)
+		{
+			printf("Could not create upload command pool\n");
+			abort();
+		}
+
+		VkCommandBufferAllocateInfo allocateInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+							     .pNext = NULL,
+							     .commandPool = batch->commandPool,
+							     .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+							     .commandBufferCount = 1 };
+
+		if (vkAllocateCommandBuffers(s_Device, &allocateInfo, &batch->commandBuffer) != VK_SUCCESS)
+		{
+			printf("Could not allocate upload command buffer\n");
+			abort();
+		}
+	}
+
+	s_StagingBuffer = CreateStagingBuffer(UPLOAD_STAGING_SIZE, &s_StagingMemory);
+	s_StagingHead = 0;
+	s_StagingTail = 0;
+	s_SubmittedValue = 0;
+	s_SubmittedCount = 0;
+	s_RetiredCount = 0;
+	s_Recording = false;
+
+	printf("Created upload queue batches and staging ring\n");
+}
+
+void Upload_Destroy()
+{
+	Upload_Flush();
+	while (s_RetiredCount < s_SubmittedCount)
+	{
+		RetireOldest(true);
+	}
+
+	for (uint32_t i = 0; i < UPLOAD_BATCH_COUNT; i++)
+	{
+		vkDestroyCommandPool(s_Device, s_Batches[i].commandPool, NULL);
+		free(s_Batches[i].dedicated);
+	}
+
+	vkDestroyBuffer(s_Device, s_StagingBuffer, NULL);
+	GpuAllocator_Free(&s_StagingMemory);
+	vkDestroySemaphore(s_Device, s_Timeline, NULL);
+
+	s_Device = VK_NULL_HANDLE;
+}
+
+struct UploadStaging Upload_AllocateStaging(VkDeviceSize size)
+{
+	size = (size + UPLOAD_STAGING_ALIGNMENT - 1) / UPLOAD_STAGING_ALIGNMENT * UPLOAD_STAGING_ALIGNMENT;
+
+	// staging belongs to the batch being recorded and is freed once it completes
+	Upload_CommandBuffer();
+
+	if (size > UPLOAD_STAGING_SIZE)
+	{
+		struct UploadBatch *batch = &s_Batches[s_SubmittedCount % UPLOAD_BATCH_COUNT];
+		if (batch->dedicatedCount == batch->dedicatedCapacity)
+		{
+			batch->dedicatedCapacity = batch->dedicatedCapacity == 0 ? 4 : batch->dedicatedCapacity * 2;
+			batch->dedicated = realloc(batch->dedicated,
+						   batch->dedicatedCapacity * sizeof(struct UploadDedicatedStaging));
+		}
+
+		struct UploadDedicatedStaging *dedicated = &batch->dedicated[batch->dedicatedCount++];
+		dedicated->buffer = CreateStagingBuffer(size, &dedicated->memory);
+
+		return (struct UploadStaging){
+			.buffer = dedicated->buffer, .offset = 0, .size = size, .data = dedicated->memory.mapped
+		};
+	}
+
+	for (;;)
+	{
+		uint64_t start = s_StagingHead;
+		if (start % UPLOAD_STAGING_SIZE + size > UPLOAD_STAGING_SIZE)
+		{
+			// never split across the end of the ring, skip to the start instead
+			start += UPLOAD_STAGING_SIZE - start % UPLOAD_STAGING_SIZE;
+			if (s_StagingTail == s_StagingHead)
+			{
+				// nothing is outstanding, so the skipped space is free as well
+				s_StagingTail = start;
+			}
+		}
+
+		if (start + size - s_StagingTail <= UPLOAD_STAGING_SIZE)
+		{
+			s_StagingHead = start + size;
+
+			VkDeviceSize offset = start % UPLOAD_STAGING_SIZE;
+			return (struct UploadStaging){ .buffer = s_StagingBuffer,
+						       .offset = offset,
+						       .size = size,
+						       .data = (unsigned char *)s_StagingMemory.mapped + offset };
+		}
+
+		// only the batch being recorded holds the space, it has to go out before it can be waited for
+		if (s_RetiredCount == s_SubmittedCount)
+		{
+			Upload_Flush();
+		}
+		RetireOldest(true);
+		Upload_CommandBuffer();
+	}
+}
+
+VkCommandBuffer Upload_CommandBuffer()
+{
+	struct UploadBatch *batch = &s_Batches[s_SubmittedCount % UPLOAD_BATCH_COUNT];
+
+	if (!s_Recording)
+	{
+		if (s_SubmittedCount - s_RetiredCount == UPLOAD_BATCH_COUNT)
+		{
+			RetireOldest(true);
+		}
+
+		VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+						       .pNext = NULL,
+						       .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+						       .pInheritanceInfo = NULL };
+
+		if (vkBeginCommandBuffer(batch->commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			printf("Could not begin upload command buffer\n");
+			abort();
+		}
+
+		s_Recording = true;
+	}
+
+	return batch->commandBuffer;
+}
+
+uint64_t Upload_Flush()
+{
+	if (!s_Recording)
+	{
+		return s_SubmittedValue;
+	}
+
+	PROFILE_FUNCTION_BEGIN();
+
+	struct UploadBatch *batch = &s_Batches[s_SubmittedCount % UPLOAD_BATCH_COUNT];
+	if (vkEndCommandBuffer(batch->commandBuffer) != VK_SUCCESS)
+	{
+		printf("Could not end upload command buffer\n");
+		abort();
+	}
+
+	batch->value = s_SubmittedValue + 1;
+	batch->stagingEnd = s_StagingHead;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = { .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+						       .pNext = NULL,
+						       .waitSemaphoreValueCount = 0,
+						       .pWaitSemaphoreValues = NULL,
+						       .signalSemaphoreValueCount = 1,
+						       .pSignalSemaphoreValues = &batch->value };
+
+	VkSubmitInfo submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				    .pNext = &timelineInfo,
+				    .waitSemaphoreCount = 0,
+				    .pWaitSemaphores = NULL,
+				    .pWaitDstStageMask = NULL,
+				    .commandBufferCount = 1,
+				    .pCommandBuffers = &batch->commandBuffer,
+				    .signalSemaphoreCount = 1,
+				    .pSignalSemaphores = &s_Timeline };
+
+	if (vkQueueSubmit(s_Queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		printf("Could not submit upload batch\n");
+		abort();
+	}
+
+	s_SubmittedValue = batch->value;
+	s_SubmittedCount++;
+	s_Recording = false;
+
+	PROFILE_END();
+	return s_SubmittedValue;
+}
+
+void Upload_Collect()
+{
+	if (s_RetiredCount == s_SubmittedCount)
+	{
+		return;
+	}
+
+	uint64_t completedValue = 0;
+	vkGetSemaphoreCounterValue(s_Device, s_Timeline, &completedValue);
+
+	while (s_RetiredCount < s_SubmittedCount &&
+	       s_Batches[s_RetiredCount % UPLOAD_BATCH_COUNT].value <= completedValue)
+	{
+		RetireOldest(false);
+	}
+}
+
+VkSemaphore Upload_Semaphore()
+{
+	return s_Timeline;
+}
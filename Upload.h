@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#define UPLOAD_STAGING_SIZE (64 * 1024 * 1024)
+// batches the transfer queue may have in flight before recording waits for the oldest
+#define UPLOAD_BATCH_COUNT 4
+
+// graphics stages that read uploaded data, the frame's wait on the upload semaphore covers these
+#define UPLOAD_CONSUMER_STAGES                                                                             \
+	(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |                        \
+	 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+
+struct UploadStaging {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	VkDeviceSize size; // rounded up to ASYNC_IO_ALIGNMENT
+	void *data; // persistently mapped
+};
+
+/**
+ * Uploads are recorded into batches submitted to the queue, each signalling the next value of a timeline semaphore.
+ * Render thread only.
+ * @param queue a transfer only queue when the device has one, otherwise the graphics queue
+ */
+void Upload_Init(VkDevice device, VkQueue queue, uint32_t queueFamily);
+
+/**
+ * Waits for every upload, then frees the staging memory and the batches
+ */
+void Upload_Destroy();
+
+/**
+ * Staging memory that is reclaimed once the batch copying out of it has completed. Record the commands
+ * reading it before allocating again: running out of space submits the batch being recorded.
+ */
+struct UploadStaging Upload_AllocateStaging(VkDeviceSize size);
+
+/**
+ * @return the batch being recorded, begun on first use
+ */
+VkCommandBuffer Upload_CommandBuffer();
+
+/**
+ * Submits the batch being recorded, if anything was recorded
+ * @return timeline value signalled once every upload so far has completed
+ */
+uint64_t Upload_Flush();
+
+/**
+ * Reclaims the staging memory and command buffers of completed batches without waiting
+ */
+void Upload_Collect();
+
+VkSemaphore Upload_Semaphore();
@@ -21,4 +21,17 @@ inline
 bool IsPowerOfTwo(unsigned long x)
 {
 	return (x != 0) && ((x & (x - 1)) == 0);
+}
+
+static inline
+uint64_t HashFnv1a64(const void *data, uint64_t size)
+{
+	const unsigned char *bytes = data;
+	uint64_t hash = 14695981039346656037ULL;
+	for (uint64_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
 }
\ No newline at end of file
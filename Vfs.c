@@ -0,0 +1,625 @@
+#include "Vfs.h"
+#include "Utilities.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define VFS_MAX_MOUNTS 16
+
+/*
+ * Sequentially consistent, so a reader counted after a retired pack was found unused loads its replacement.
+ * The interlocked functions are full barriers.
+ */
+#ifdef _MSC_VER
+#define LoadPack(pointer) (*(struct VfsPack *volatile *)(pointer))
+#define PublishPack(pointer, pack) _InterlockedExchangePointer((void *volatile *)(pointer), (pack))
+#define AtomicIncrement(value) _InterlockedIncrement((volatile long *)(value))
+#define AtomicDecrement(value) _InterlockedDecrement((volatile long *)(value))
+#define AtomicLoad(value) (*(volatile uint32_t *)(value))
+#else
+#define LoadPack(pointer) __atomic_load_n((pointer), __ATOMIC_SEQ_CST)
+#define PublishPack(pointer, pack) __atomic_store_n((pointer), (pack), __ATOMIC_SEQ_CST)
+#define AtomicIncrement(value) __atomic_add_fetch((value), 1, __ATOMIC_SEQ_CST)
+#define AtomicDecrement(value) __atomic_sub_fetch((value), 1, __ATOMIC_SEQ_CST)
+#define AtomicLoad(value) __atomic_load_n((value), __ATOMIC_SEQ_CST)
+#endif
+
+#define VFS_PACK_HEADER_SIZE (4 * sizeof(uint32_t))
+#define VFS_PACK_ENTRY_SIZE (3 * sizeof(uint64_t) + sizeof(uint32_t))
+
+enum VfsMountType {
+	VFS_MOUNT_DIRECTORY,
+	VFS_MOUNT_PACK
+};
+
+struct VfsPackEntry {
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	const char *path; // points into the mapping, not terminated
+	uint32_t pathLength;
+};
+
+// a mapping of a pack with the index of its table of contents, never changed once published
+struct VfsPack {
+	struct VfsPackEntry *entries;
+	uint32_t entryCount;
+	uint32_t *slots; // open addressing table of entry index + 1, 0 marks an empty slot
+	uint32_t slotMask;
+
+	const unsigned char *mapping;
+	uint64_t mappingSize;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mappingHandle;
+#endif
+
+	struct VfsPack *nextRetired; // in s_RetiredPacks once Vfs_RemountPack replaced it
+};
+
+struct VfsMount {
+	enum VfsMountType type;
+	char hostPath[VFS_MAX_PATH];
+	char mountPoint[VFS_MAX_PATH]; // normalized, empty or ending in '/'
+	size_t mountPointLength;
+
+	struct VfsPack *pack; // read with LoadPack, other threads may be resolving while a pack is remounted
+};
+
+static struct VfsMount s_Mounts[VFS_MAX_MOUNTS];
+static uint32_t s_MountCount = 0;
+
+// packs Vfs_RemountPack replaced, kept until no lookup or view that may have loaded them is left
+static struct VfsPack *s_RetiredPacks = NULL;
+static uint32_t s_Readers = 0; // lookups in progress and open views into packs
+
+/*
+ * Converts to forward slashes and drops leading "./" and "/" so a file hashes the same
+ * however it was spelled. Returns false if the path does not fit.
+ */
+static bool NormalizePath(const char *path, char *normalized)
+{
+	while (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+	{
+		path += 2;
+	}
+	while (path[0] == '/' || path[0] == '\\')
+	{
+		++path;
+	}
+
+	size_t length = 0;
+	for (; path[length] != '\0'; ++length)
+	{
+		if (length + 1 >= VFS_MAX_PATH)
+		{
+			return false;
+		}
+		normalized[length] = path[length] == '\\' ? '/' : path[length];
+	}
+	normalized[length] = '\0';
+
+	return true;
+}
+
+static bool IsHostAbsolute(const char *path)
+{
+	return path[0] == '/' || path[0] == '\\' || (path[0] != '\0' && path[1] == ':');
+}
+
+static bool HostFileSize(const char *hostPath, uint64_t *size)
+{
+	struct stat sb;
+	if (stat(hostPath, &sb) != 0 || (sb.st_mode & S_IFMT) != S_IFREG)
+	{
+		return false;
+	}
+
+	*size = sb.st_size;
+	return true;
+}
+
+static bool ReadHostFile(const char *hostPath, struct VfsView *view)
+{
+	FILE *file = fopen(hostPath, "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
+
+	// one spare byte so text readers can terminate the copy
+	void *data = malloc((size_t)size + 1);
+	if (data == NULL)
+	{
+		fprintf(stderr, "Could not allocate %ld bytes for %s\n", size, hostPath);
+		fclose(file);
+		abort();
+	}
+
+	size_t bytesRead = fread(data, 1, (size_t)size, file);
+	fclose(file);
+
+	if (bytesRead != (size_t)size)
+	{
+		fprintf(stderr, "Could not read %s\n", hostPath);
+		free(data);
+		return false;
+	}
+
+	view->data = data;
+	view->size = bytesRead;
+	view->owned = data;
+
+	return true;
+}
+
+static const struct VfsPackEntry *FindPackEntry(const struct VfsPack *pack, const char *relativePath)
+{
+	size_t length = strlen(relativePath);
+	uint64_t hash = HashFnv1a64(relativePath, length);
+
+	for (uint32_t slot = (uint32_t)hash & pack->slotMask;; slot = (slot + 1) & pack->slotMask)
+	{
+		uint32_t index = pack->slots[slot];
+		if (index == 0)
+		{
+			return NULL;
+		}
+
+		const struct VfsPackEntry *entry = &pack->entries[index - 1];
+		if (entry->hash == hash && entry->pathLength == length && memcmp(entry->path, relativePath, length) == 0)
+		{
+			return entry;
+		}
+	}
+}
+
+static bool MapPack(const char *hostPath, struct VfsPack *pack)
+{
+#ifdef _WIN32
+	pack->file = CreateFileA(hostPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (pack->file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(pack->file, &fileSize);
+	pack->mappingSize = fileSize.QuadPart;
+
+	pack->mappingHandle = CreateFileMappingA(pack->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	pack->mapping = pack->mappingHandle != NULL ? MapViewOfFile(pack->mappingHandle, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (pack->mapping == NULL)
+	{
+		if (pack->mappingHandle != NULL)
+		{
+			CloseHandle(pack->mappingHandle);
+		}
+		CloseHandle(pack->file);
+		return false;
+	}
+#else
+	int fd = open(hostPath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat sb;
+	fstat(fd, &sb);
+	pack->mappingSize = sb.st_size;
+
+	void *mapping = pack->mappingSize > 0 ? mmap(NULL, pack->mappingSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+	pack->mapping = mapping;
+#endif
+
+	return true;
+}
+
+static void UnmapPack(struct VfsPack *pack)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(pack->mapping);
+	CloseHandle(pack->mappingHandle);
+	CloseHandle(pack->file);
+#else
+	munmap((void *)pack->mapping, pack->mappingSize);
+#endif
+	pack->mapping = NULL;
+}
+
+static bool IndexPack(const char *hostPath, struct VfsPack *pack)
+{
+	uint32_t header[4];
+	if (pack->mappingSize < VFS_PACK_HEADER_SIZE)
+	{
+		return false;
+	}
+	memcpy(header, pack->mapping, sizeof header);
+
+	if (header[0] != VFS_PACK_MAGIC || header[1] != VFS_PACK_VERSION)
+	{
+		fprintf(stderr, "%s is not a version %u pack\n", hostPath, VFS_PACK_VERSION);
+		return false;
+	}
+
+	pack->entryCount = header[2];
+	pack->entries = malloc(pack->entryCount * sizeof(struct VfsPackEntry));
+
+	// at most half full so probe sequences stay short
+	uint32_t slotCount = 16;
+	while (slotCount < pack->entryCount * 2)
+	{
+		slotCount *= 2;
+	}
+	pack->slotMask = slotCount - 1;
+	pack->slots = calloc(slotCount, sizeof(uint32_t));
+
+	if ((pack->entries == NULL && pack->entryCount > 0) || pack->slots == NULL)
+	{
+		fprintf(stderr, "Could not allocate the index of %s\n", hostPath);
+		abort();
+	}
+
+	uint64_t cursor = VFS_PACK_HEADER_SIZE;
+	for (uint32_t i = 0; i < pack->entryCount; ++i)
+	{
+		struct VfsPackEntry *entry = &pack->entries[i];
+		if (cursor + VFS_PACK_ENTRY_SIZE > pack->mappingSize)
+		{
+			fprintf(stderr, "%s has a truncated table of contents\n", hostPath);
+			return false;
+		}
+
+		memcpy(&entry->hash, pack->mapping + cursor, sizeof(uint64_t));
+		memcpy(&entry->offset, pack->mapping + cursor + 8, sizeof(uint64_t));
+		memcpy(&entry->size, pack->mapping + cursor + 16, sizeof(uint64_t));
+		memcpy(&entry->pathLength, pack->mapping + cursor + 24, sizeof(uint32_t));
+		cursor += VFS_PACK_ENTRY_SIZE;
+
+		entry->path = (const char *)pack->mapping + cursor;
+		cursor += entry->pathLength;
+
+		if (cursor > pack->mappingSize || entry->offset > pack->mappingSize ||
+		    entry->size > pack->mappingSize - entry->offset)
+		{
+			fprintf(stderr, "%s has an entry outside of the file\n", hostPath);
+			return false;
+		}
+
+		uint32_t slot = (uint32_t)entry->hash & pack->slotMask;
+		while (pack->slots[slot] != 0)
+		{
+			slot = (slot + 1) & pack->slotMask;
+		}
+		pack->slots[slot] = i + 1;
+	}
+
+	return true;
+}
+
+static void FreePack(struct VfsPack *pack)
+{
+	while (pack != NULL)
+	{
+		struct VfsPack *retired = pack->nextRetired;
+		if (pack->mapping != NULL)
+		{
+			UnmapPack(pack);
+		}
+		free(pack->entries);
+		free(pack->slots);
+		free(pack);
+		pack = retired;
+	}
+}
+
+/**
+ * Maps and indexes the pack at hostPath
+ * @return NULL if it could not be opened or is malformed
+ */
+static struct VfsPack *OpenPack(const char *hostPath)
+{
+	struct VfsPack *pack = calloc(1, sizeof(struct VfsPack));
+	if (pack == NULL)
+	{
+		fprintf(stderr, "Could not allocate the pack %s\n", hostPath);
+		abort();
+	}
+
+	if (!MapPack(hostPath, pack) || !IndexPack(hostPath, pack))
+	{
+		FreePack(pack);
+		return NULL;
+	}
+
+	return pack;
+}
+
+static void FreeMount(struct VfsMount *mount)
+{
+	if (mount->type == VFS_MOUNT_PACK)
+	{
+		FreePack(mount->pack);
+	}
+
+	memset(mount, 0, sizeof(struct VfsMount));
+}
+
+static struct VfsMount *AddMount(enum VfsMountType type, const char *hostPath, const char *mountPoint)
+{
+	if (s_MountCount == VFS_MAX_MOUNTS)
+	{
+		fprintf(stderr, "Too many mounts, %s is not mounted\n", hostPath);
+		return NULL;
+	}
+
+	struct VfsMount *mount = &s_Mounts[s_MountCount];
+	memset(mount, 0, sizeof(struct VfsMount));
+	mount->type = type;
+
+	if (strlen(hostPath) >= VFS_MAX_PATH || !NormalizePath(mountPoint, mount->mountPoint) ||
+	    strlen(mount->mountPoint) + 2 > VFS_MAX_PATH)
+	{
+		fprintf(stderr, "Mount path too long: %s\n", hostPath);
+		return NULL;
+	}
+	strcpy(mount->hostPath, hostPath);
+
+	mount->mountPointLength = strlen(mount->mountPoint);
+	if (mount->mountPointLength > 0 && mount->mountPoint[mount->mountPointLength - 1] != '/')
+	{
+		mount->mountPoint[mount->mountPointLength++] = '/';
+		mount->mountPoint[mount->mountPointLength] = '\0';
+	}
+
+	return mount;
+}
+
+bool Vfs_MountDirectory(const char *hostDirectory, const char *mountPoint)
+{
+	assert(hostDirectory != NULL && mountPoint != NULL);
+
+	struct stat sb;
+	if (stat(hostDirectory, &sb) != 0 || (sb.st_mode & S_IFMT) != S_IFDIR)
+	{
+		fprintf(stderr, "Could not mount directory %s\n", hostDirectory);
+		return false;
+	}
+
+	struct VfsMount *mount = AddMount(VFS_MOUNT_DIRECTORY, hostDirectory, mountPoint);
+	if (mount == NULL)
+	{
+		return false;
+	}
+
+	++s_MountCount;
+
+	printf("Mounted directory %s at /%s\n", hostDirectory, mount->mountPoint);
+
+	return true;
+}
+
+bool Vfs_MountPack(const char *packFileName, const char *mountPoint)
+{
+	assert(packFileName != NULL && mountPoint != NULL);
+
+	struct VfsMount *mount = AddMount(VFS_MOUNT_PACK, packFileName, mountPoint);
+	if (mount == NULL)
+	{
+		return false;
+	}
+
+	mount->pack = OpenPack(packFileName);
+	if (mount->pack == NULL)
+	{
+		FreeMount(mount);
+		return false;
+	}
+
+	++s_MountCount;
+
+	printf("Mounted pack %s at /%s with %u files\n", packFileName, mount->mountPoint, mount->pack->entryCount);
+
+	return true;
+}
+
+bool Vfs_RemountPack(const char *packFileName)
+{
+	assert(packFileName != NULL);
+
+	bool remounted = false;
+	for (uint32_t i = 0; i < s_MountCount; ++i)
+	{
+		struct VfsMount *mount = &s_Mounts[i];
+		if (mount->type != VFS_MOUNT_PACK || strcmp(mount->hostPath, packFileName) != 0)
+		{
+			continue;
+		}
+
+		struct VfsPack *pack = OpenPack(packFileName);
+		if (pack == NULL)
+		{
+			fprintf(stderr, "Could not remount %s, keeping the contents it had\n", packFileName);
+			return false;
+		}
+
+		struct VfsPack *retired = mount->pack;
+		PublishPack(&mount->pack, pack);
+		retired->nextRetired = s_RetiredPacks;
+		s_RetiredPacks = retired;
+		remounted = true;
+
+		printf("Remounted pack %s at /%s with %u files\n", packFileName, mount->mountPoint, pack->entryCount);
+	}
+
+	Vfs_ReleaseRetiredPacks();
+
+	return remounted;
+}
+
+void Vfs_ReleaseRetiredPacks()
+{
+	// readers counted from now on load the current packs, so the retired ones are unused for good
+	if (s_RetiredPacks == NULL || AtomicLoad(&s_Readers) != 0)
+	{
+		return;
+	}
+
+	FreePack(s_RetiredPacks);
+	s_RetiredPacks = NULL;
+}
+
+void Vfs_UnmountAll()
+{
+	for (uint32_t i = 0; i < s_MountCount; ++i)
+	{
+		FreeMount(&s_Mounts[i]);
+	}
+
+	s_MountCount = 0;
+
+	FreePack(s_RetiredPacks);
+	s_RetiredPacks = NULL;
+}
+
+static bool Resolve(const char *path, struct VfsLocation *location, const struct VfsPack **resolvedPack,
+		    const struct VfsPackEntry **resolvedEntry)
+{
+	assert(path != NULL);
+
+	*resolvedPack = NULL;
+	*resolvedEntry = NULL;
+
+	char normalized[VFS_MAX_PATH];
+	if (!IsHostAbsolute(path) && NormalizePath(path, normalized))
+	{
+		for (uint32_t i = s_MountCount; i-- > 0;)
+		{
+			const struct VfsMount *mount = &s_Mounts[i];
+			if (strncmp(normalized, mount->mountPoint, mount->mountPointLength) != 0)
+			{
+				continue;
+			}
+
+			const char *relativePath = normalized + mount->mountPointLength;
+
+			if (mount->type == VFS_MOUNT_PACK)
+			{
+				// the entry and the mapping it points into have to come from the same pack
+				const struct VfsPack *pack = LoadPack(&mount->pack);
+				const struct VfsPackEntry *entry = FindPackEntry(pack, relativePath);
+				if (entry != NULL)
+				{
+					strcpy(location->hostPath, mount->hostPath);
+					location->offset = entry->offset;
+					location->size = entry->size;
+					*resolvedPack = pack;
+					*resolvedEntry = entry;
+					return true;
+				}
+				continue;
+			}
+
+			int length = snprintf(location->hostPath, VFS_MAX_PATH, "%s/%s", mount->hostPath, relativePath);
+			if (length > 0 && length < VFS_MAX_PATH && HostFileSize(location->hostPath, &location->size))
+			{
+				location->offset = 0;
+				return true;
+			}
+		}
+	}
+
+	// the host filesystem is the bottom layer, tools keep working with plain paths
+	if (strlen(path) >= VFS_MAX_PATH || !HostFileSize(path, &location->size))
+	{
+		return false;
+	}
+
+	strcpy(location->hostPath, path);
+	location->offset = 0;
+
+	return true;
+}
+
+bool Vfs_Locate(const char *path, struct VfsLocation *location)
+{
+	const struct VfsPack *pack;
+	const struct VfsPackEntry *entry;
+	AtomicIncrement(&s_Readers);
+	bool found = Resolve(path, location, &pack, &entry);
+	AtomicDecrement(&s_Readers);
+
+	return found;
+}
+
+bool Vfs_Exists(const char *path)
+{
+	struct VfsLocation location;
+	return Vfs_Locate(path, &location);
+}
+
+bool Vfs_Open(const char *path, struct VfsView *view)
+{
+	assert(view != NULL);
+
+	view->data = NULL;
+	view->size = 0;
+	view->owned = NULL;
+
+	struct VfsLocation location;
+	const struct VfsPack *pack;
+	const struct VfsPackEntry *entry;
+	AtomicIncrement(&s_Readers);
+	if (!Resolve(path, &location, &pack, &entry))
+	{
+		AtomicDecrement(&s_Readers);
+		return false;
+	}
+
+	// a view into a pack stays counted until Vfs_Close, its mapping must outlive a remount
+	if (entry != NULL)
+	{
+		view->data = pack->mapping + entry->offset;
+		view->size = entry->size;
+		return true;
+	}
+
+	AtomicDecrement(&s_Readers);
+	return ReadHostFile(location.hostPath, view);
+}
+
+void Vfs_Close(struct VfsView *view)
+{
+	if (view->data != NULL && view->owned == NULL)
+	{
+		AtomicDecrement(&s_Readers);
+	}
+
+	free(view->owned);
+
+	view->data = NULL;
+	view->size = 0;
+	view->owned = NULL;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VFS_MAX_PATH 260
+
+/*
+ * Pack layout: magic, version, file count, file alignment, then per file the FNV-1a hash of its path,
+ * the offset and size of its data, the path length and the path without terminator.
+ * File data starts at multiples of the file alignment so it can be read with O_DIRECT.
+ */
+#define VFS_PACK_MAGIC 0x564E484Fu // "OHNV"
+#define VFS_PACK_VERSION 1
+#define VFS_PACK_ALIGNMENT 4096
+
+// Read-only contents of a file, valid until Vfs_Close or until its mount is removed
+struct VfsView {
+	const void *data;
+	uint64_t size;
+	void *owned; // copy read from a directory mount, NULL for views into a mapped pack
+};
+
+// Where the bytes of a file live on the host, for readers that do their own IO such as AsyncIO
+struct VfsLocation {
+	char hostPath[VFS_MAX_PATH];
+	uint64_t offset;
+	uint64_t size;
+};
+
+/**
+ * Mounts a host directory. Mounts are searched newest first, so later mounts overlay earlier ones.
+ * @param hostDirectory directory on the host filesystem
+ * @param mountPoint virtual directory the contents appear under, "" for the root
+ */
+bool Vfs_MountDirectory(const char *hostDirectory, const char *mountPoint);
+
+/**
+ * Maps a pack file and indexes its table of contents, lookups in it never touch the host filesystem
+ * @param packFileName pack written by PackCreator
+ * @param mountPoint virtual directory the contents appear under, "" for the root
+ * @return false if the pack could not be opened or is malformed
+ */
+bool Vfs_MountPack(const char *packFileName, const char *mountPoint);
+
+/**
+ * Maps and indexes the pack again after it was replaced on disk, for every mount of it. Lookups and views from
+ * other threads stay valid: the old mapping is kept until Vfs_ReleaseRetiredPacks finds it unused. Replace packs
+ * by renaming a new file over them, a pack rewritten in place is truncated under its mapping.
+ * Call from one thread at a time.
+ * @return false if the pack is not mounted or the new file is malformed, the old contents stay mounted then
+ */
+bool Vfs_RemountPack(const char *packFileName);
+
+/**
+ * Unmaps the packs Vfs_RemountPack replaced if no lookup is running and no view into a pack is open, otherwise
+ * leaves them for a later call. Call regularly from the thread remounting packs.
+ */
+void Vfs_ReleaseRetiredPacks();
+
+void Vfs_UnmountAll();
+
+/**
+ * Resolves a virtual path. Paths no mount provides fall through to the host filesystem as they are.
+ * @return false if the file does not exist
+ */
+bool Vfs_Locate(const char *path, struct VfsLocation *location);
+
+bool Vfs_Exists(const char *path);
+
+/**
+ * Opens a read-only view of a file. Files in packs are not copied.
+ * @return false if the file does not exist or could not be read
+ */
+bool Vfs_Open(const char *path, struct VfsView *view);
+
+void Vfs_Close(struct VfsView *view);
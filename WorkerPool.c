@@ -0,0 +1,165 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct WorkerPoolSlice {
+	uint32_t first;
+	uint32_t count;
+};
+
+struct WorkerPoolWorker {
+	struct WorkerPool *pool;
+	uint32_t index; // runs slice index + 1, slice 0 belongs to the calling thread
+	SDL_Thread *thread;
+	SDL_sem *start;
+};
+
+struct WorkerPool {
+	const char *name;
+	uint32_t threadCount; // workers + 1
+	struct WorkerPoolWorker workers[WORKER_POOL_MAX_THREADS - 1];
+	SDL_sem *done;
+
+	/*
+	 * The job is written before the start semaphores are posted and only read by the workers until they post done,
+	 * the semaphores order the accesses
+	 */
+	WorkerPoolSliceFunction function;
+	void *userData;
+	struct WorkerPoolSlice slices[WORKER_POOL_MAX_THREADS];
+	bool quit;
+};
+
+static int WorkerMain(void *data)
+{
+	struct WorkerPoolWorker *worker = data;
+	struct WorkerPool *pool = worker->pool;
+	Profiler_SetThreadName(pool->name);
+
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+		if (pool->quit)
+		{
+			break;
+		}
+
+		const struct WorkerPoolSlice *slice = &pool->slices[worker->index + 1];
+		pool->function(worker->index + 1, slice->first, slice->count, pool->userData);
+
+		SDL_SemPost(pool->done);
+	}
+
+	Profiler_ReleaseThread();
+	return 0;
+}
+
+struct WorkerPool *WorkerPool_Create(const char *name, uint32_t threadCount)
+{
+	struct WorkerPool *pool = calloc(1, sizeof(struct WorkerPool));
+	if (pool == NULL)
+	{
+		printf("Could not allocate worker pool %s\n", name);
+		abort();
+	}
+
+	if (threadCount == 0)
+	{
+		// leave a core for the thread running the jobs
+		int cpuCount = SDL_GetCPUCount();
+		threadCount = cpuCount > 2 ? (uint32_t)cpuCount - 1 : 1;
+	}
+
+	pool->name = name;
+	pool->threadCount = threadCount > WORKER_POOL_MAX_THREADS ? WORKER_POOL_MAX_THREADS : threadCount;
+
+	pool->done = SDL_CreateSemaphore(0);
+	if (pool->done == NULL)
+	{
+		printf("Could not create %s semaphore: %s\n", name, SDL_GetError());
+		abort();
+	}
+
+	for (uint32_t i = 0; i < pool->threadCount - 1; ++i)
+	{
+		struct WorkerPoolWorker *worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->start = SDL_CreateSemaphore(0);
+		worker->thread = SDL_CreateThread(WorkerMain, name, worker);
+		if (worker->start == NULL || worker->thread == NULL)
+		{
+			printf("Could not create %s thread: %s\n", name, SDL_GetError());
+			abort();
+		}
+	}
+
+	return pool;
+}
+
+void WorkerPool_Destroy(struct WorkerPool *pool)
+{
+	pool->quit = true;
+	for (uint32_t i = 0; i < pool->threadCount - 1; ++i)
+	{
+		SDL_SemPost(pool->workers[i].start);
+		SDL_WaitThread(pool->workers[i].thread, NULL);
+		SDL_DestroySemaphore(pool->workers[i].start);
+	}
+
+	SDL_DestroySemaphore(pool->done);
+	free(pool);
+}
+
+uint32_t WorkerPool_ThreadCount(const struct WorkerPool *pool)
+{
+	return pool->threadCount;
+}
+
+uint32_t WorkerPool_Run(struct WorkerPool *pool, uint32_t itemCount, uint32_t minSlice, uint32_t granularity,
+			WorkerPoolSliceFunction function, void *userData)
+{
+	uint32_t sliceCount = (itemCount + minSlice - 1) / minSlice;
+	if (sliceCount > pool->threadCount)
+	{
+		sliceCount = pool->threadCount;
+	}
+	if (sliceCount == 0)
+	{
+		sliceCount = 1;
+	}
+
+	pool->function = function;
+	pool->userData = userData;
+
+	// contiguous slices of near equal size rounded up to the granularity, so the last one may be shorter
+	uint32_t sliceSize = (itemCount + sliceCount - 1) / sliceCount;
+	sliceSize = (sliceSize + granularity - 1) / granularity * granularity;
+	uint32_t first = 0;
+	for (uint32_t slice = 0; slice < sliceCount; ++slice)
+	{
+		uint32_t count = itemCount - first < sliceSize ? itemCount - first : sliceSize;
+		pool->slices[slice] = (struct WorkerPoolSlice){ .first = first, .count = count };
+		first += count;
+	}
+
+	for (uint32_t slice = 1; slice < sliceCount; ++slice)
+	{
+		SDL_SemPost(pool->workers[slice - 1].start);
+	}
+
+	function(0, pool->slices[0].first, pool->slices[0].count, userData);
+
+	PROFILE_BEGIN("WaitForWorkers");
+	for (uint32_t slice = 1; slice < sliceCount; ++slice)
+	{
+		SDL_SemWait(pool->done);
+	}
+	PROFILE_END();
+
+	return sliceCount;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// threads running the slices of a job, the calling thread included
+#define WORKER_POOL_MAX_THREADS 8
+
+/**
+ * Runs items [first, first + count) of a job
+ * @param slice index of the slice, slices are numbered in item order
+ */
+typedef void (*WorkerPoolSliceFunction)(uint32_t slice, uint32_t first, uint32_t count, void *userData);
+
+struct WorkerPool;
+
+/**
+ * Starts the worker threads, which sleep on a semaphore each until a job is run
+ * @param name of the threads in the debugger and the profiler, kept until WorkerPool_Destroy
+ * @param threadCount threads including the calling one, 0 for one per core but one, at most WORKER_POOL_MAX_THREADS
+ */
+struct WorkerPool *WorkerPool_Create(const char *name, uint32_t threadCount);
+
+/**
+ * Stops the worker threads, no job may be running
+ */
+void WorkerPool_Destroy(struct WorkerPool *pool);
+
+/**
+ * @return threads including the calling one, the most slices a job is split into
+ */
+uint32_t WorkerPool_ThreadCount(const struct WorkerPool *pool);
+
+/**
+ * Splits itemCount items into contiguous slices and runs them in parallel, the calling thread runs slice 0.
+ * Returns once every slice has run. Only one thread may run jobs on a pool.
+ * @param minSlice fewest items worth a slice of its own, smaller ones cost more to hand over than they save
+ * @param granularity every slice but the last is a multiple of it
+ * @return number of slices, 1 when there are no items
+ */
+uint32_t WorkerPool_Run(struct WorkerPool *pool, uint32_t itemCount, uint32_t minSlice, uint32_t granularity,
+			WorkerPoolSliceFunction function, void *userData);
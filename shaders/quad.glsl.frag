@@ -1,12 +1,18 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(set = 1, binding = 0) uniform sampler texSampler;
+// TEXTURE_SLOT_COUNT, only the slots of live textures are written
+layout(set = 1, binding = 1) uniform texture2D textures[1024];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec4 fragTint;
+layout(location = 3) flat in uint fragTexture;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord * 1.0);
+    // instances of one draw may sample different textures
+    outColor = texture(sampler2D(textures[nonuniformEXT(fragTexture)], texSampler), fragTexCoord * 1.0) * fragTint;
 }
\ No newline at end of file
@@ -1,10 +1,25 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 viewProj;
+} frame;
+
+struct InstanceData {
     mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+    vec4 color;
+    vec4 boundingSphere;
+    uint batch;
+    uint textureSlot;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+// instances that passed culling, the first instance of each draw is where its batch starts
+layout(std430, set = 0, binding = 2) readonly buffer VisibleBuffer {
+    uint visible[];
+};
 
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
@@ -24,10 +39,16 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec4 fragTint;
+layout(location = 3) flat out uint fragTexture;
 
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    uint instance = visible[gl_InstanceIndex];
+
+    gl_Position = frame.viewProj * instances[instance].model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragTint = instances[instance].color;
+    fragTexture = instances[instance].textureSlot;
 }
\ No newline at end of file